@@ -1,6 +1,7 @@
 #version 450 core
 
-#define MAX_LIGHT 5
+#define MAX_LIGHT 8
+#define MAX_DIFFUSE 8
 
 out vec4 FragColor;
 
@@ -8,138 +9,248 @@ in vec3 v_Pos;
 in vec2 v_UV0;
 in vec3 v_Normal;
 in vec4 v_lightSpacePos[MAX_LIGHT];
+//material comes from uniforms or the per object buffer, see the vertex shaders
+flat in vec3 v_Ka;
+flat in vec3 v_Kd;
+flat in vec3 v_Ks;
+flat in float v_Shininess;
+flat in int v_DiffuseSlot;
 
 struct PointLight {
-  float intensity;
   vec3 pos;
+  float intensity;
   vec3 color;
-  sampler2D shadowMap;
 };
 
-uniform sampler2D diffuseTex;
-uniform int hasDiffuseTex;
-uniform vec3 ka;
-uniform vec3 kd;
-uniform vec3 ks;
-uniform float shininess;
-uniform int lightCount;
+layout (std140, binding = 0) uniform PerFrame {
+  mat4 viewProj;
+  mat4 lightVP[MAX_LIGHT];
+  vec3 eyePos;
+  int lightCount;
+  PointLight light[MAX_LIGHT];
+  vec4 shadowTile[MAX_LIGHT];  //atlas uv offset xy, size z, highest moment mip w
+};
+
+//LIGHT_COUNT comes from the variant defines, see ShadowPipeline::GetLightDefines
+#ifdef LIGHT_COUNT
+#define LIGHT_LOOP_COUNT LIGHT_COUNT
+#else
+#define LIGHT_LOOP_COUNT lightCount
+#endif
 
-uniform vec3 eyePos;
-uniform PointLight light[MAX_LIGHT];
+uniform sampler2D diffuseTex[MAX_DIFFUSE];          //units 0 to 7
+//VSM lights share the moment atlas, the others the depth atlas, shadowTile picks the region
+uniform sampler2D shadowAtlas;               //unit 8, depth for the blocker search
+uniform sampler2DShadow shadowAtlasCompare;  //unit 9, same depth with hardware 2x2 compare
+uniform sampler2D shadowMoments;             //unit 10, moment atlas
 
 #define BIAS 0.001
-#define PI 3.141592653589793
 #define PI2 6.283185307179586
-#define NUM_SAMPLES 96
-#define PCF_NUM_SAMPLES NUM_SAMPLES
-#define BLOCKER_SEARCH_NUM_SAMPLES NUM_SAMPLES
-#define NUM_RINGS 10
+
+//variant defines, see ShadowPipeline::GetLightDefines.
+//SHADOW_MODE_<i> is the filter of light i, TEXTURED 0 skips the diffuse fetch
+#define SHADOW_NONE 0
+#define SHADOW_HARD 1
+#define SHADOW_PCF 2
+#define SHADOW_PCSS 3
+#define SHADOW_VSM 4
+#define SHADOW_KERNEL_SIZE 64  //SHADOW_KERNEL_SIZE in ShadowPipeline.h
+#ifndef NUM_SAMPLES
+#define NUM_SAMPLES 32
+#endif
+#ifndef TEXTURED
+#define TEXTURED 1
+#endif
+#define PCF_FILTER_SIZE 0.001
+#define COARSE_NUM_SAMPLES 8  //pre-test, skips the full filter when all taps agree
+#define BLOCKER_SEARCH_NUM_SAMPLES max(NUM_SAMPLES / 4, COARSE_NUM_SAMPLES)  //4 texels per gather
 #define ZNEAR 0.1
+#define VSM_MIN_VARIANCE 0.00001
+#define VSM_BLEEDING 0.3  //lower part of the Chebyshev bound cut off, hides light bleeding between occluders
 #define LIGHT_SIZE 0.005
 
-vec2 poissonDisk[NUM_SAMPLES];
+//unit disk, every prefix is evenly spread, so any tap count can use the first taps
+layout (std140, binding = 2) uniform ShadowKernel {
+  vec4 kernel[SHADOW_KERNEL_SIZE / 2];  //two points per element
+};
+
+mat2 kernelRotation;  //per pixel, turns banding into noise
+vec2 atlasTexel;
+vec2 momentTexel;
 
-highp float rand_1to1(highp float x) {
-  // -1 -1
-  return fract(sin(x)*10000.0);
+//light map uv to atlas uv, clamped inset texels into the tile so filtering never reaches a neighbour
+vec2 tileUV(vec4 tile, vec2 uv, vec2 inset) {
+  return clamp(tile.xy + uv * tile.z, tile.xy + inset, tile.xy + tile.z - inset);
 }
 
-highp float rand_2to1(vec2 uv ) { 
-  // 0 - 1
-	const highp float a = 12.9898, b = 78.233, c = 43758.5453;
-	highp float dt = dot( uv.xy, vec2( a,b ) ), sn = mod( dt, PI );
-	return fract(sin(sn) * c);
+vec2 kernelPoint(int i) {
+  vec4 k = kernel[i >> 1];
+  return kernelRotation * ((i & 1) == 0 ? k.xy : k.zw);
 }
 
-void poissonDiskSamples( const in vec2 randomSeed ) {
-  float ANGLE_STEP = PI2 * float( NUM_RINGS ) / float( NUM_SAMPLES );
-  float INV_NUM_SAMPLES = 1.0 / float( NUM_SAMPLES );
-  float angle = rand_2to1( randomSeed ) * PI2;
-  float radius = INV_NUM_SAMPLES;
-  float radiusStep = radius;
-
-  for( int i = 0; i < NUM_SAMPLES; i ++ ) {
-    poissonDisk[i] = vec2( cos( angle ), sin( angle ) ) * pow( radius, 0.75 );
-    radius += radiusStep;
-    angle += ANGLE_STEP;
-  }
+void initShadowSampling() {
+  atlasTexel = 1.0 / vec2(textureSize(shadowAtlas, 0));
+  momentTexel = 1.0 / vec2(textureSize(shadowMoments, 0));
+  //interleaved gradient noise
+  float angle = PI2 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+  float c = cos(angle);
+  float s = sin(angle);
+  kernelRotation = mat2(c, s, -s, c);
 }
 
 vec3 blinnPhong(float intensity, vec3 lightPos, vec3 lightColor, float visibility) {
-  vec3 color = pow(texture2D(diffuseTex, v_UV0).rgb, vec3(2.2));
-  vec3 ambient = ka * color;//环境光
+#if TEXTURED
+  vec3 color = pow(texture2D(diffuseTex[v_DiffuseSlot], v_UV0).rgb, vec3(2.2));
+#else
+  vec3 color = vec3(0.0);  //what sampling the empty unit gave
+#endif
+  vec3 ambient = v_Ka * color;//环境光
 
   vec3 lightDir = normalize(lightPos - v_Pos);
   vec3 normal = normalize(v_Normal);
   float lightCoff = intensity / length(lightPos - v_Pos);
   float diff = max(dot(normal, lightDir), 0);
-  vec3 diffuse = kd * diff * lightCoff * color; //漫反射
+  vec3 diffuse = v_Kd * diff * lightCoff * color; //漫反射
 
   vec3 viewDir = normalize(eyePos - v_Pos);
   vec3 halfDir = normalize(lightDir + viewDir);
-  float spec = max(pow(dot(halfDir, v_Normal), shininess), 0);
-  vec3 specular = ks * lightCoff * spec;//高光
+  float spec = max(pow(dot(halfDir, v_Normal), v_Shininess), 0);
+  vec3 specular = v_Ks * lightCoff * spec;//高光
 
   return pow(ambient + (diffuse + specular) * lightColor * visibility, vec3(1.0 / 2.2));
 }
 
-float shadowMap(sampler2D map, vec3 shadowCoord) {
-  float depth = texture2D(map, shadowCoord.xy).r;
-  return depth + BIAS < shadowCoord.z ? 0 : 1;
+//filter sizes are in light map uv, tileUV maps every tap into the atlas
+float shadowMap(vec4 tile, vec3 shadowCoord) {
+  return texture(shadowAtlasCompare, vec3(tileUV(tile, shadowCoord.xy, atlasTexel * 0.5), shadowCoord.z - BIAS));
 }
 
-float pcf(sampler2D map, vec3 shadowCoord, float filterSize) {
+//lit fraction of the first samples taps, each tap is a bilinear 2x2 compare
+float pcf(vec4 tile, vec3 shadowCoord, float filterSize, int samples) {
   float sum = 0.0;
-  for(int i = 0; i < PCF_NUM_SAMPLES; i++) {
-    vec2 pos = poissonDisk[i] * filterSize;
-    float depth = texture2D(map, pos + shadowCoord.xy).r;
-    if(depth + BIAS > shadowCoord.z) {
-      sum += 1.0;
-    }
+  for(int i = 0; i < samples; i++) {
+    vec2 uv = tileUV(tile, shadowCoord.xy + kernelPoint(i) * filterSize, atlasTexel * 0.5);
+    sum += texture(shadowAtlasCompare, vec3(uv, shadowCoord.z - BIAS));
   }
-  float result = sum / float(PCF_NUM_SAMPLES);
-  return result;
+  return sum / float(samples);
+}
+
+//1 or 0 when the coarse taps agree over filterSize, -1 otherwise
+float coarseTest(vec4 tile, vec3 shadowCoord, float filterSize) {
+  float lit = pcf(tile, shadowCoord, filterSize, COARSE_NUM_SAMPLES);
+  return lit == 0.0 || lit == 1.0 ? lit : -1.0;
 }
 
-vec2 findBlocker(sampler2D map, vec2 uv, float zReceiver) {
-  float search = LIGHT_SIZE * (zReceiver - ZNEAR) / zReceiver;
+vec2 findBlocker(vec4 tile, vec2 uv, float zReceiver, float search) {
   float allDepth = 0.0;
   float blockNum = 0.0;
   for(int i = 0; i < BLOCKER_SEARCH_NUM_SAMPLES; i++) {
-    vec2 pos = uv + poissonDisk[i] * search;
-    float depth = texture2D(map, pos).r;
-    if (depth < zReceiver) {
-      allDepth += depth;
-      blockNum += 1.0;
-    }
+    //a gather reads the 2x2 texels around the point, one full texel keeps them in the tile
+    vec4 depth = textureGather(shadowAtlas, tileUV(tile, uv + kernelPoint(i) * search, atlasTexel));
+    vec4 blocker = vec4(lessThan(depth, vec4(zReceiver)));
+    allDepth += dot(depth, blocker);
+    blockNum += dot(blocker, vec4(1.0));
   }
-  float avgDep = allDepth / blockNum;
-	return vec2(avgDep, blockNum);
+  return vec2(allDepth / max(blockNum, 1.0), blockNum);
 }
 
-float pcss(sampler2D map, vec3 shadowCoord) {
-  vec2 blocker = findBlocker(map, shadowCoord.xy, shadowCoord.z);
+float pcss(vec4 tile, vec3 shadowCoord) {
+  //the penumbra is never wider than the search region, agreeing taps there decide alone
+  float search = LIGHT_SIZE * (shadowCoord.z - ZNEAR) / shadowCoord.z;
+  float coarse = coarseTest(tile, shadowCoord, search);
+  if (coarse >= 0.0) {
+    return coarse;
+  }
+  vec2 blocker = findBlocker(tile, shadowCoord.xy, shadowCoord.z, search);
   if(blocker.y < 1.0) {
     return 1.0;
   }
   float proportion = (shadowCoord.z - blocker.x) / blocker.x;
   float penumbra = proportion * (LIGHT_SIZE * ZNEAR) / shadowCoord.z;
-  float result = pcf(map, shadowCoord, penumbra);
-  return result;
+  //taps grow with the penumbra area in texels, a tap covers 2x2
+  float texels = penumbra * tile.z / atlasTexel.x;
+  int samples = clamp(int(texels * texels), COARSE_NUM_SAMPLES, NUM_SAMPLES);
+  return pcf(tile, shadowCoord, penumbra, samples);
 }
 
+//Chebyshev upper bound on the lit fraction from blurred, mipmapped moments.
+//coarse mips average across tile borders, tile.w caps the level and the inset grows with it
+float vsm(vec4 tile, vec3 shadowCoord) {
+  vec2 uv = tile.xy + shadowCoord.xy * tile.z;
+  float lod = clamp(textureQueryLod(shadowMoments, uv).y, 0.0, tile.w);
+  vec2 moments = textureLod(shadowMoments, tileUV(tile, shadowCoord.xy, momentTexel * 0.5 * exp2(lod)), lod).rg;
+  float z = shadowCoord.z - BIAS;
+  if (z <= moments.x) {
+    return 1.0;
+  }
+  float variance = max(moments.y - moments.x * moments.x, VSM_MIN_VARIANCE);
+  float d = z - moments.x;
+  float pMax = variance / (variance + d * d);
+  return clamp((pMax - VSM_BLEEDING) / (1.0 - VSM_BLEEDING), 0.0, 1.0);
+}
+
+//mode is a constant after unrolling, the other branches are compiled out
+float visibility(const int mode, vec4 tile, vec4 lightSpacePos, vec3 lightPos) {
+  if (mode == SHADOW_NONE) {
+    return 1.0;
+  }
+  vec3 homoCrop = lightSpacePos.xyz / lightSpacePos.w;
+  vec3 depthSpace = homoCrop * 0.5 + 0.5;
+  //before any early out, the mip selection needs derivatives in uniform control flow
+  if (mode == SHADOW_VSM) {
+    return vsm(tile, depthSpace);
+  }
+  //faces turned away from the light are shadowed by the object itself
+  if (dot(v_Normal, lightPos - v_Pos) <= 0.0) {
+    return 0.0;
+  }
+  if (mode == SHADOW_HARD) {
+    return shadowMap(tile, depthSpace);
+  }
+  if (mode == SHADOW_PCF) {
+    float coarse = coarseTest(tile, depthSpace, PCF_FILTER_SIZE);
+    return coarse >= 0.0 ? coarse : pcf(tile, depthSpace, PCF_FILTER_SIZE, NUM_SAMPLES);
+  }
+  return pcss(tile, depthSpace);
+}
+
+#define SHADE_LIGHT(i, mode) \
+  result += blinnPhong(light[i].intensity, light[i].pos, light[i].color, \
+                       visibility(mode, shadowTile[i], v_lightSpacePos[i], light[i].pos))
+
 void main()
 {
-  vec3 result;
-  for(int i = 0; i < lightCount; i++) {
-    vec4 lightSpacePos = v_lightSpacePos[i];
-    vec3 homoCrop = lightSpacePos.xyz / lightSpacePos.w;
-    vec3 depthSpace = homoCrop * 0.5 + 0.5;
-    poissonDiskSamples(depthSpace.xy);
-    // float visibable = shadowMap(light[i].shadowMap, depthSpace);
-    // float visibable = pcf(light[i].shadowMap, depthSpace, 0.001);
-    float visibable = pcss(light[i].shadowMap, depthSpace);
-    result += blinnPhong(light[i].intensity, light[i].pos, light[i].color, visibable);
+  initShadowSampling();
+  vec3 result = vec3(0.0);
+#ifdef LIGHT_COUNT
+#if LIGHT_COUNT > 0
+  SHADE_LIGHT(0, SHADOW_MODE_0);
+#endif
+#if LIGHT_COUNT > 1
+  SHADE_LIGHT(1, SHADOW_MODE_1);
+#endif
+#if LIGHT_COUNT > 2
+  SHADE_LIGHT(2, SHADOW_MODE_2);
+#endif
+#if LIGHT_COUNT > 3
+  SHADE_LIGHT(3, SHADOW_MODE_3);
+#endif
+#if LIGHT_COUNT > 4
+  SHADE_LIGHT(4, SHADOW_MODE_4);
+#endif
+#if LIGHT_COUNT > 5
+  SHADE_LIGHT(5, SHADOW_MODE_5);
+#endif
+#if LIGHT_COUNT > 6
+  SHADE_LIGHT(6, SHADOW_MODE_6);
+#endif
+#if LIGHT_COUNT > 7
+  SHADE_LIGHT(7, SHADOW_MODE_7);
+#endif
+#else
+  for(int i = 0; i < LIGHT_LOOP_COUNT; i++) {
+    SHADE_LIGHT(i, SHADOW_PCSS);
   }
+#endif
   FragColor = vec4(result, 1);
-}
\ No newline at end of file
+}
@@ -1,27 +1,87 @@
 #version 450 core
 
-#define MAX_LIGHT 5
+#define MAX_LIGHT 8
+//NORMAL_OCT 1 reads octahedral normals, ShadowPipeline picks it from the mesh layout
+#ifndef NORMAL_OCT
+#define NORMAL_OCT 0
+#endif
 
 layout (location = 0) in vec3 a_Pos;
 layout (location = 1) in vec2 a_UV0;
+#if NORMAL_OCT
+layout (location = 3) in vec2 a_NormalOct;  //VERTEX_NORMAL_OCT_LOCATION in MeshQuantizer.h
+#else
 layout (location = 2) in vec3 a_Normal;
+#endif
 
-uniform mat4 mvp;
-uniform mat4 lightMVP[MAX_LIGHT];
-uniform int lightCount;
+struct PointLight {
+  vec3 pos;
+  float intensity;
+  vec3 color;
+};
+
+//same block in every shader, uploaded once per frame by ShadowPipeline
+layout (std140, binding = 0) uniform PerFrame {
+  mat4 viewProj;
+  mat4 lightVP[MAX_LIGHT];
+  vec3 eyePos;
+  int lightCount;
+  PointLight light[MAX_LIGHT];
+  vec4 shadowTile[MAX_LIGHT];  //atlas uv offset xy, size z, highest moment mip w
+};
+
+//LIGHT_COUNT comes from the variant defines, see ShadowPipeline::GetLightDefines
+#ifdef LIGHT_COUNT
+#define LIGHT_LOOP_COUNT LIGHT_COUNT
+#else
+#define LIGHT_LOOP_COUNT lightCount
+#endif
+
+//per draw, a range of the ring buffer
+layout (std140, binding = 1) uniform PerObject {
+  mat4 model;  //includes position decode, uniform scale only
+  vec4 ka;
+  vec4 kd;
+  vec4 ks;     //w is shininess
+};
 
 out vec3 v_Pos;
 out vec2 v_UV0;
 out vec3 v_Normal;
 out vec4 v_lightSpacePos[MAX_LIGHT];
+flat out vec3 v_Ka;
+flat out vec3 v_Kd;
+flat out vec3 v_Ks;
+flat out float v_Shininess;
+flat out int v_DiffuseSlot;
+
+#if NORMAL_OCT
+vec3 OctDecode(vec2 e) {
+  vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+  if (n.z < 0) {
+    n.xy = (1.0f - abs(n.yx)) * vec2(n.x >= 0 ? 1.0f : -1.0f, n.y >= 0 ? 1.0f : -1.0f);
+  }
+  return normalize(n);
+}
+#endif
 
 void main()
 {
-  gl_Position = mvp * vec4(a_Pos, 1.0f);
-  v_Pos = a_Pos;
+  vec4 worldPos = model * vec4(a_Pos, 1.0f);
+  gl_Position = viewProj * worldPos;
+  v_Pos = worldPos.xyz;
   v_UV0 = a_UV0;
-  v_Normal = a_Normal;
-  for(int i = 0; i < lightCount; i++) {
-    v_lightSpacePos[i] = lightMVP[i] * vec4(a_Pos, 1.0f);
+#if NORMAL_OCT
+  v_Normal = mat3(model) * OctDecode(a_NormalOct);
+#else
+  v_Normal = mat3(model) * a_Normal;
+#endif
+  v_Ka = ka.xyz;
+  v_Kd = kd.xyz;
+  v_Ks = ks.xyz;
+  v_Shininess = ks.w;
+  v_DiffuseSlot = 0;  //bound per draw
+  for(int i = 0; i < LIGHT_LOOP_COUNT; i++) {
+    v_lightSpacePos[i] = lightVP[i] * worldPos;
   }
 }
\ No newline at end of file
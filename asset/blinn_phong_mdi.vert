@@ -0,0 +1,107 @@
+#version 450 core
+#extension GL_ARB_shader_draw_parameters : enable
+
+#define MAX_LIGHT 8
+//NORMAL_OCT 1 reads octahedral normals, ShadowPipeline picks it from the mesh layout
+#ifndef NORMAL_OCT
+#define NORMAL_OCT 0
+#endif
+
+layout (location = 0) in vec3 a_Pos;
+layout (location = 1) in vec2 a_UV0;
+#if NORMAL_OCT
+layout (location = 3) in vec2 a_NormalOct;  //VERTEX_NORMAL_OCT_LOCATION in MeshQuantizer.h
+#else
+layout (location = 2) in vec3 a_Normal;
+#endif
+layout (location = 4) in uint a_DrawID;     //baseInstance of the draw, MeshPoolOpenGL
+
+#ifdef GL_ARB_shader_draw_parameters
+#define DRAW_ID gl_DrawIDARB
+#else
+#define DRAW_ID a_DrawID
+#endif
+
+struct PointLight {
+  vec3 pos;
+  float intensity;
+  vec3 color;
+};
+
+//same block in every shader, uploaded once per frame by ShadowPipeline
+layout (std140, binding = 0) uniform PerFrame {
+  mat4 viewProj;
+  mat4 lightVP[MAX_LIGHT];
+  vec3 eyePos;
+  int lightCount;
+  PointLight light[MAX_LIGHT];
+  vec4 shadowTile[MAX_LIGHT];  //atlas uv offset xy, size z, highest moment mip w
+};
+
+//LIGHT_COUNT comes from the variant defines, see ShadowPipeline::GetLightDefines
+#ifdef LIGHT_COUNT
+#define LIGHT_LOOP_COUNT LIGHT_COUNT
+#else
+#define LIGHT_LOOP_COUNT lightCount
+#endif
+
+struct ObjectData {
+  mat4 model;  //includes position decode, uniform scale only
+  vec4 ka;
+  vec4 kd;
+  vec4 ks;     //w is shininess
+};
+
+//every object once per frame
+layout (std430, binding = 0) readonly buffer Objects {
+  ObjectData objects[];
+};
+
+//per draw of one multi draw, x is the object, y the diffuse slot
+layout (std430, binding = 1) readonly buffer Draws {
+  uvec2 draws[];
+};
+
+out vec3 v_Pos;
+out vec2 v_UV0;
+out vec3 v_Normal;
+out vec4 v_lightSpacePos[MAX_LIGHT];
+flat out vec3 v_Ka;
+flat out vec3 v_Kd;
+flat out vec3 v_Ks;
+flat out float v_Shininess;
+flat out int v_DiffuseSlot;
+
+#if NORMAL_OCT
+vec3 OctDecode(vec2 e) {
+  vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+  if (n.z < 0) {
+    n.xy = (1.0f - abs(n.yx)) * vec2(n.x >= 0 ? 1.0f : -1.0f, n.y >= 0 ? 1.0f : -1.0f);
+  }
+  return normalize(n);
+}
+#endif
+
+void main()
+{
+  uvec2 draw = draws[DRAW_ID];
+  ObjectData o = objects[draw.x];
+  mat4 model = o.model;
+  vec4 worldPos = model * vec4(a_Pos, 1.0f);
+  gl_Position = viewProj * worldPos;
+  v_Pos = worldPos.xyz;
+  v_UV0 = a_UV0;
+#if NORMAL_OCT
+  v_Normal = mat3(model) * OctDecode(a_NormalOct);
+#else
+  v_Normal = mat3(model) * a_Normal;
+#endif
+  v_Ka = o.ka.xyz;
+  v_Kd = o.kd.xyz;
+  v_Ks = o.ks.xyz;
+  v_Shininess = o.ks.w;
+  v_DiffuseSlot = int(draw.y);
+  for(int i = 0; i < LIGHT_LOOP_COUNT; i++) {
+    v_lightSpacePos[i] = lightVP[i] * worldPos;
+  }
+}
\ No newline at end of file
@@ -1,8 +1,26 @@
 #version 450 core
+
+#define MAX_LIGHT 8
+
 layout (location = 0) in vec3 a_Pos;
 
-uniform mat4 mvp;
+struct PointLight {
+  vec3 pos;
+  float intensity;
+  vec3 color;
+};
+
+layout (std140, binding = 0) uniform PerFrame {
+  mat4 viewProj;
+  mat4 lightVP[MAX_LIGHT];
+  vec3 eyePos;
+  int lightCount;
+  PointLight light[MAX_LIGHT];
+  vec4 shadowTile[MAX_LIGHT];  //atlas uv offset xy, size z, highest moment mip w
+};
+
+uniform mat4 model;
 
 void main() {
-  gl_Position = mvp * vec4(a_Pos, 1.0f);
+  gl_Position = viewProj * (model * vec4(a_Pos, 1.0f));
 }
\ No newline at end of file
@@ -1,3 +1,20 @@
 #version 450 core
+
+//MOMENTS 1 writes the variance shadow map, otherwise depth only
+#ifndef MOMENTS
+#define MOMENTS 0
+#endif
+
+#if MOMENTS
+layout (location = 0) out vec2 moments;
+#endif
+
 void main() {
+#if MOMENTS
+  float z = gl_FragCoord.z;
+  //depth slope over the pixel widens the variance, less acne on sloped receivers
+  float dx = dFdx(z);
+  float dy = dFdy(z);
+  moments = vec2(z, z * z + 0.25 * (dx * dx + dy * dy));
+#endif
 }
\ No newline at end of file
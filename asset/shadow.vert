@@ -1,8 +1,15 @@
 #version 450 core
 layout (location = 0) in vec3 a_Pos;
 
-uniform mat4 lightMVP;
+layout (std140, binding = 1) uniform PerObject {
+  mat4 model;
+  vec4 ka;
+  vec4 kd;
+  vec4 ks;
+};
+
+uniform mat4 lightVP;
 
 void main() {
-  gl_Position = lightMVP * vec4(a_Pos, 1.0f);
+  gl_Position = lightVP * (model * vec4(a_Pos, 1.0f));
 }
\ No newline at end of file
@@ -0,0 +1,29 @@
+#version 450 core
+
+//one direction of the separable gaussian over the moments of one atlas tile, binomial 7 taps
+#define BLUR_RADIUS 3
+
+layout (location = 0) out vec2 moments;
+
+uniform sampler2D source;  //level 0 only, the moment mips are rebuilt after the blur
+uniform int axis;          //0 blurs along x, 1 along y
+uniform vec3 tile;         //atlas uv offset xy, size z, the viewport covers it
+
+const float weights[BLUR_RADIUS + 1] = float[](20.0 / 64.0, 15.0 / 64.0, 6.0 / 64.0, 1.0 / 64.0);
+
+vec2 fetch(vec2 uv, vec2 halfTexel) {
+  //taps stay in the tile, neighbours belong to other lights
+  return textureLod(source, clamp(uv, tile.xy + halfTexel, tile.xy + tile.z - halfTexel), 0.0).rg;
+}
+
+void main() {
+  vec2 texel = 1.0 / vec2(textureSize(source, 0));
+  vec2 direction = axis == 0 ? vec2(texel.x, 0.0) : vec2(0.0, texel.y);
+  vec2 uv = gl_FragCoord.xy * texel;
+  vec2 sum = fetch(uv, texel * 0.5) * weights[0];
+  for (int i = 1; i <= BLUR_RADIUS; i++) {
+    sum += fetch(uv + direction * float(i), texel * 0.5) * weights[i];
+    sum += fetch(uv - direction * float(i), texel * 0.5) * weights[i];
+  }
+  moments = sum;
+}
\ No newline at end of file
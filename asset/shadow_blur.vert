@@ -0,0 +1,7 @@
+#version 450 core
+
+void main() {
+  //one triangle covering the viewport, DrawFullScreenTriangleOpenGL
+  vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+  gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+#version 450 core
+layout (location = 0) in vec3 a_Pos;
+layout (location = 5) in mat4 a_Model;  //per instance
+
+uniform mat4 lightVP;
+
+void main() {
+  gl_Position = lightVP * (a_Model * vec4(a_Pos, 1.0f));
+}
\ No newline at end of file
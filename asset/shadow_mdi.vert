@@ -0,0 +1,32 @@
+#version 450 core
+#extension GL_ARB_shader_draw_parameters : enable
+
+layout (location = 0) in vec3 a_Pos;
+layout (location = 4) in uint a_DrawID;  //baseInstance of the draw, MeshPoolOpenGL
+
+#ifdef GL_ARB_shader_draw_parameters
+#define DRAW_ID gl_DrawIDARB
+#else
+#define DRAW_ID a_DrawID
+#endif
+
+struct ObjectData {
+  mat4 model;
+  vec4 ka;
+  vec4 kd;
+  vec4 ks;
+};
+
+layout (std430, binding = 0) readonly buffer Objects {
+  ObjectData objects[];
+};
+
+layout (std430, binding = 1) readonly buffer Draws {
+  uvec2 draws[];
+};
+
+uniform mat4 lightVP;
+
+void main() {
+  gl_Position = lightVP * (objects[draws[DRAW_ID].x].model * vec4(a_Pos, 1.0f));
+}
\ No newline at end of file
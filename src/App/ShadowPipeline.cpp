@@ -1,150 +1,1068 @@
 #include "ShadowPipeline.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <string>
+
+#include <Hash.h>
+#include <MeshQuantizer.h>
+#include <ThreadPool.h>
+
 using namespace Mine;
 
-void BlinnPhongMaterial::SetValues(ShadowPipeline& pipeline, ShaderUniformOpenGL& uniform) const {
-  uniform.SetValue("ka", ka);
-  uniform.SetValue("kd", kd);
-  uniform.SetValue("ks", ks);
-  uniform.SetValue("shininess", shininess);
-  if (diffuseTex.expired()) {
-    MineGLFuncCall(glActiveTexture(GL_TEXTURE0));
-    MineGLFuncCall(glBindTexture(GL_TEXTURE_2D, 0));
-    uniform.SetValue("diffuseTex", 0);
-  } else {
-    auto ptr = diffuseTex.lock();
-    ptr->Bind(GL_TEXTURE0);
-    uniform.SetValue("diffuseTex", 0);
+//diffuse textures fill units 0 to 7, shadow maps follow them
+static void _SetSamplerUnits(ShaderUniformOpenGL& uniform) {
+  auto diffuseTex = uniform.GetHandle("diffuseTex");
+  for (int i = 0; i < MAX_DIFFUSE_COUNT && diffuseTex >= 0; i++) {
+    uniform.SetArray(diffuseTex, i, i);
+  }
+  std::pair<const char*, int> shadow[] = {{"shadowAtlas", SHADOW_MAP_UNIT},
+                                          {"shadowAtlasCompare", SHADOW_COMPARE_UNIT},
+                                          {"shadowMoments", SHADOW_MOMENT_UNIT}};
+  for (const auto& [name, unit] : shadow) {
+    auto handle = uniform.GetHandle(name);
+    if (handle >= 0) {
+      uniform.SetValue(handle, unit);
+    }
+  }
+}
+
+constexpr float SHADOW_EXTENT = 30;  //ortho box of every light
+
+//Mitchell's best candidate in the unit disk, every prefix stays evenly spread
+static ShadowKernelStd140 _CreateShadowKernel() {
+  std::minstd_rand random(1);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  Vector2 points[SHADOW_KERNEL_SIZE];
+  for (int i = 0; i < SHADOW_KERNEL_SIZE; i++) {
+    float best = -1;
+    for (int c = 0; c < 4 * i + 1; c++) {
+      float r = std::sqrt(uniform(random));
+      float a = 2 * MINE_PI * uniform(random);
+      Vector2 p(r * std::cos(a), r * std::sin(a));
+      float nearest = 4;
+      for (int j = 0; j < i; j++) {
+        float dx = p.x - points[j].x;
+        float dy = p.y - points[j].y;
+        nearest = std::min(nearest, dx * dx + dy * dy);
+      }
+      if (nearest > best) {
+        best = nearest;
+        points[i] = p;
+      }
+    }
+  }
+  ShadowKernelStd140 kernel;
+  for (int i = 0; i < SHADOW_KERNEL_SIZE / 2; i++) {
+    kernel.points[i] = Vector4(points[i * 2].x, points[i * 2].y, points[i * 2 + 1].x, points[i * 2 + 1].y);
+  }
+  return kernel;
+}
+
+static bool _SameVector(const Vector3& a, const Vector3& b) {
+  return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static bool _SameMaterial(const BlinnPhongMaterial& a, const BlinnPhongMaterial& b) {
+  return _SameVector(a.ka, b.ka) && _SameVector(a.kd, b.kd) && _SameVector(a.ks, b.ks) &&
+         a.shininess == b.shininess && a.diffuseTex.lock() == b.diffuseTex.lock();
+}
+
+static void _CheckUniformBlock(const ShaderProgramOpenGL& shader, const char* name, GLuint binding, size_t size) {
+  const auto& blocks = shader.GetUniformBlockDesc();
+  auto iter = blocks.find(name);
+  if (iter != blocks.end() && (iter->second.binding != (GLint)binding || iter->second.size != (GLint)size)) {
+    throw "uniform block layout does not match its CPU struct";
+  }
+}
+
+static void _CheckBlinnPhongBlocks(const ShaderProgramOpenGL& shader) {
+  _CheckUniformBlock(shader, "PerFrame", PER_FRAME_BLOCK_BINDING, sizeof(PerFrameStd140));
+  _CheckUniformBlock(shader, "PerObject", PER_OBJECT_BLOCK_BINDING, sizeof(ObjectStd430));
+  _CheckUniformBlock(shader, "ShadowKernel", SHADOW_KERNEL_BLOCK_BINDING, sizeof(ShadowKernelStd140));
+}
+
+//anything that changes the pixels of a shadow layer
+static uint64_t _HashShadowCasters(const std::vector<GameObject>& objects, const std::vector<ShadowCaster>& casters, uint64_t seed) {
+  uint64_t h = seed;
+  for (const auto& c : casters) {
+    const auto& go = objects[c.index];
+    h = Hash64(&c.index, sizeof(c.index), h);
+    h = Hash64(&c.lod, sizeof(c.lod), h);
+    h = Hash64(&go.pos, sizeof(go.pos), h);
+    h = Hash64(&go.scale, sizeof(go.scale), h);
   }
+  return h | 1;  //0 is never a valid key
 }
 
-static std::string __head("light[");
-static std::string __shadowMapTail("].shadowMap");
+static GLsizeiptr _AlignUp(GLsizeiptr size, GLsizeiptr alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+static uint32_t _GetSortId(std::vector<const void*>& ids, const void* ptr) {
+  auto iter = std::find(ids.begin(), ids.end(), ptr);
+  if (iter == ids.end()) {
+    ids.emplace_back(ptr);
+    return (uint32_t)(ids.size() - 1);
+  }
+  return (uint32_t)(iter - ids.begin());
+}
 
-void Light::SetValues(ShadowPipeline& pipeline, int index, int texSlot, ShaderUniformOpenGL& uniform) const {
-  if (hasShadow) {
-    shadowMap.GetDepthMap().Bind(GL_TEXTURE0 + texSlot);
-    uniform.SetValue(__head + std::to_string(index) + __shadowMapTail, texSlot);
+void BlinnPhongMaterial::SetValues(ObjectStd430& object) const {
+  object.ka = Vector4(ka.x, ka.y, ka.z, 0);
+  object.kd = Vector4(kd.x, kd.y, kd.z, 0);
+  object.ks = Vector4(ks.x, ks.y, ks.z, shininess);
+}
+
+void BlinnPhongMaterial::BindDiffuse(GLuint unit) const {
+  if (diffuseTex.expired()) {
+    BindTextureOpenGL(unit, GL_TEXTURE_2D, 0);
   } else {
-    MineGLFuncCall(glActiveTexture(GL_TEXTURE0 + texSlot));
-    MineGLFuncCall(glBindTexture(GL_TEXTURE_2D, 0));
+    diffuseTex.lock()->Bind(GL_TEXTURE0 + unit);
   }
 }
 
+void ShadowProgram::Delete() {
+  shader->Delete();
+}
+
+static ShadowProgram _CreateShadowProgram(const std::filesystem::path& vsPath, const std::filesystem::path& fsPath, bool moments) {
+  ShadowProgram program;
+  program.shader = Mine::CreateShaderProgramCachedOpenGL(vsPath, fsPath, {{"MOMENTS", moments ? "1" : "0"}});
+  program.uniform = Mine::CreateShaderUniformOpenGL(*program.shader);
+  program.lightVPHandle = program.uniform->GetHandle("lightVP");
+  _CheckBlinnPhongBlocks(*program.shader);
+  return program;
+}
+
+ShadowFilter Light::GetShadowFilter() const {
+  return hasShadow && shadowTile.size > 0 ? shadowFilter : ShadowFilter::None;
+}
+
+int GameObject::SelectLod(float maxError) const {
+  float s = std::max(std::max(std::abs(scale.x), std::abs(scale.y)), std::abs(scale.z));
+  return meshPtr.lock()->SelectLod(subMesh, s > 0 ? maxError / s : maxError);
+}
+
+BoundingBox GameObject::GetWorldBounds() const {
+  return Transform(Scale(Translation(pos), scale), meshPtr.lock()->GetBounds(subMesh));
+}
+
 void ShadowPipeline::Init() {
-  auto cube = Mine::LoadObjFromFile(std::filesystem::current_path() / "asset" / "cube");
-  _lightCube = Mine::CreateMeshBufferOpenGL(cube, false, false);
-  _lightCubeShader = Mine::CreateShaderProgramOpenGL(std::filesystem::current_path() / "asset" / "light");
-  _shadowShader = Mine::CreateShaderProgramOpenGL(std::filesystem::current_path() / "asset" / "shadow");
-  _shadowShaderUniform = Mine::CreateShaderUniformOpenGL(*_shadowShader);
+  _lightCube = Mine::CreateMeshBufferCachedOpenGL(std::filesystem::current_path() / "asset" / "cube", false, false);
+  _lightCubeShader = Mine::CreateShaderProgramCachedOpenGL(std::filesystem::current_path() / "asset" / "light");
+  auto assetPath = std::filesystem::current_path() / "asset";
+  for (int moments = 0; moments < 2; moments++) {
+    _shadowPrograms[moments] = _CreateShadowProgram(assetPath / "shadow.vert", assetPath / "shadow.frag", moments);
+    _shadowMultiDrawPrograms[moments] = _CreateShadowProgram(assetPath / "shadow_mdi.vert", assetPath / "shadow.frag", moments);
+    _shadowInstancedPrograms[moments] = _CreateShadowProgram(assetPath / "shadow_instanced.vert", assetPath / "shadow.frag", moments);
+  }
+  _shadowBlurShader = Mine::CreateShaderProgramCachedOpenGL(assetPath / "shadow_blur");
+  _shadowBlurUniform = Mine::CreateShaderUniformOpenGL(*_shadowBlurShader);
+  _shadowBlurUniform->SetValue("source", 0);
+  _shadowBlurAxisHandle = _shadowBlurUniform->GetHandle("axis");
+  _shadowBlurTileHandle = _shadowBlurUniform->GetHandle("tile");
+  _perFrame = PerFrameStd140();
+  auto kernel = _CreateShadowKernel();
+  _shadowKernel = GPUBufferOpenGL(GL_UNIFORM_BUFFER, GL_STATIC_DRAW, &kernel, sizeof(kernel));
+  SamplerDescOpenGL compare;
+  compare.wrapS = GL_CLAMP_TO_EDGE;
+  compare.wrapT = GL_CLAMP_TO_EDGE;
+  compare.minFliter = GL_LINEAR;  //linear compare filters 2x2 texels per tap
+  compare.magFliter = GL_LINEAR;
+  compare.compareFunc = GL_LEQUAL;
+  _shadowCompareSampler = Mine::CreateSamplerOpenGL(compare);
+  _CheckBlinnPhongBlocks(*_lightCubeShader);
+  _GetSortId(_programIds, _lightCubeShader.get());
+  _GetSortId(_meshIds, _lightCube.get());
+
+  //variants compile once lights and objects are known, see UpdateVariants
+  _multiDrawVariants = Mine::CreateShaderVariantsOpenGL(assetPath / "blinn_phong_mdi.vert", assetPath / "blinn_phong.frag");
+  _multiDrawShaders[0] = nullptr;
+  _multiDrawShaders[1] = nullptr;
+  _lightDefines.clear();
+  _diffuseSlotCount = 0;
+
+  _instancedVariants = Mine::CreateShaderVariantsOpenGL(assetPath / "blinn_phong_instanced.vert", assetPath / "blinn_phong.frag");
+
+  _uniformAlignment = GetBufferOffsetAlignmentOpenGL(GL_UNIFORM_BUFFER);
+  _storageAlignment = GetBufferOffsetAlignmentOpenGL(GL_SHADER_STORAGE_BUFFER);
+  _objectBlockStride = _AlignUp(sizeof(ObjectStd430), _uniformAlignment);
+  _ringAlignment = std::lcm(std::lcm(_uniformAlignment, _storageAlignment), (GLsizeiptr)16);
+  _ring = Mine::CreateRingBufferOpenGL(_AlignUp(1 << 20, _ringAlignment), framesInFlight);
 }
 
 void ShadowPipeline::Terminate() {
   _lightCube->Delete();
   _lightCubeShader->Delete();
-  _shadowShader->Delete();
-  for (auto& l : _lights) {
-    l.shadowMap.Delete();
+  for (int moments = 0; moments < 2; moments++) {
+    _shadowPrograms[moments].Delete();
+    _shadowMultiDrawPrograms[moments].Delete();
+    _shadowInstancedPrograms[moments].Delete();
+  }
+  _shadowBlurShader->Delete();
+  _shadowKernel.Delete();
+  _shadowCompareSampler->Delete();
+  _ring->Delete();
+  _multiDrawVariants->Delete();
+  for (auto& pool : _meshPools) {
+    pool.Delete();
   }
+  _instancedVariants->Delete();
+  _shadowAtlas.Delete();
+  _momentAtlas.Delete();
+  _staticShadowAtlas.Delete();
+  _staticMomentAtlas.Delete();
 }
 
-void ShadowPipeline::AddLight(const PointLight& light, bool hasShadow) {
+void ShadowPipeline::AddLight(const PointLight& light, bool hasShadow, ShadowFilter filter, int samples) {
   Light l;
   l.hasShadow = hasShadow;
+  l.shadowFilter = filter;
+  l.shadowSamples = samples;
   l.light = light;
   l.material = Mine::CreateShaderUniformOpenGL(*_lightCubeShader);
-  if (l.hasShadow) {
-    l.shadowMap = ShadowMap2DOpenGL(shadowWidth, shadowHeight);
-  }
+  l.modelHandle = l.material->GetHandle("model");
+  l.colorHandle = l.material->GetHandle("color");
+  l.shadowTile = AtlasTile{0, 0, 0};
+  l.shadowTileLevel = -1;
+  l.shadowTileMoments = false;
+  l.staticShadowKey = 0;
+  l.shadowKey = 0;
+  l.shadowLightPos = light.pos;
+  l.shadowImportance = 0;
+  l.shadowStaleFrames = 0;
   _lights.emplace_back(std::move(l));
+  AllocateShadowTiles();
 }
 
 void ShadowPipeline::AddObject(const std::shared_ptr<GPUMeshOpenGL>& ptr,
-                               const std::shared_ptr<Mine::ShaderProgramOpenGL>& shader,
+                               const std::shared_ptr<Mine::ShaderVariantsOpenGL>& shader,
                                const BlinnPhongMaterial& blinn,
                                const Vector3& pos,
-                               const Vector3& scale) {
+                               const Vector3& scale,
+                               int subMesh,
+                               bool isStatic) {
+  UpdateVariants();
   GameObject go;
   go.meshPtr = std::weak_ptr<GPUMeshOpenGL>(ptr);
-  go.shader = shader;
-  go.material = Mine::CreateShaderUniformOpenGL(*shader);
+  go.subMesh = subMesh;
+  go.shaderVariants = shader;
   go.pos = pos;
   go.scale = scale;
+  go.isStatic = isStatic;
   go.materialData = blinn;
+  SelectVariant(go);
+  go.textureId = _GetSortId(_textureIds, blinn.diffuseTex.lock().get());
+  go.meshId = _GetSortId(_meshIds, ptr.get());
+  go.meshPool = -1;
+  go.poolRange = MeshPoolRangeOpenGL{0, 0};
+  //the multi draw program replaces the object's own, only the same fragment shader may take that path
+  if (multiDrawIndirect && shader->GetFragmentPath() == _multiDrawVariants->GetFragmentPath()) {
+    AddToMeshPool(go, *ptr);
+  }
+  AddToInstanceGroup(go);
   _objects.emplace_back(std::move(go));
 }
 
+void ShadowPipeline::AddToInstanceGroup(GameObject& go) {
+  for (size_t i = 0; i < _instanceGroups.size(); i++) {
+    const auto& other = _objects[_instanceGroups[i].objects[0]];
+    if (other.meshId == go.meshId && other.subMesh == go.subMesh &&
+        other.shaderVariants == go.shaderVariants && _SameMaterial(other.materialData, go.materialData)) {
+      go.instanceGroup = (int)i;
+      _instanceGroups[i].objects.emplace_back((uint32_t)_objects.size());
+      return;
+    }
+  }
+  InstanceGroup group;
+  group.objects.emplace_back((uint32_t)_objects.size());
+  SelectVariant(group, go);
+  go.instanceGroup = (int)_instanceGroups.size();
+  _instanceGroups.emplace_back(std::move(group));
+}
+
+ShaderDefinesOpenGL ShadowPipeline::GetLightDefines() const {
+  ShaderDefinesOpenGL defines;
+  int lightCount = std::min((int)_lights.size(), MAX_LIGHT_COUNT);
+  defines.emplace_back("LIGHT_COUNT", std::to_string(lightCount));
+  int samples = 0;
+  for (int i = 0; i < lightCount; i++) {
+    auto filter = _lights[i].GetShadowFilter();
+    defines.emplace_back("SHADOW_MODE_" + std::to_string(i), std::to_string((int)filter));
+    if (filter == ShadowFilter::PCF || filter == ShadowFilter::PCSS) {
+      samples = std::max(samples, std::min(_lights[i].shadowSamples, SHADOW_KERNEL_SIZE));
+    }
+  }
+  if (samples > 0) {
+    defines.emplace_back("NUM_SAMPLES", std::to_string(samples));
+  }
+  return defines;
+}
+
+//QuantizeMeshDescOpenGL moves octahedral normals to their own location
+static bool _HasOctNormals(const std::vector<VertexAttribDescOpenGL>& attribDesc) {
+  return std::any_of(attribDesc.begin(), attribDesc.end(), [](const VertexAttribDescOpenGL& a) { return a.index == VERTEX_NORMAL_OCT_LOCATION; });
+}
+
+const std::shared_ptr<ShaderProgramOpenGL>& ShadowPipeline::GetVariant(ShaderVariantsOpenGL& variants, bool textured, bool octNormals) const {
+  auto defines = _lightDefines;
+  defines.emplace_back("TEXTURED", textured ? "1" : "0");
+  defines.emplace_back("NORMAL_OCT", octNormals ? "1" : "0");
+  const auto& program = variants.Get(defines);
+  _CheckBlinnPhongBlocks(*program);
+  return program;
+}
+
+void ShadowPipeline::SelectVariant(GameObject& go) {
+  bool octNormals = _HasOctNormals(go.meshPtr.lock()->GetAttribDesc());
+  const auto& program = GetVariant(*go.shaderVariants, !go.materialData.diffuseTex.expired(), octNormals);
+  if (go.shader.lock() == program) {
+    return;
+  }
+  go.shader = program;
+  go.material = Mine::CreateShaderUniformOpenGL(*program);
+  _SetSamplerUnits(*go.material);
+  go.programId = _GetSortId(_programIds, program.get());
+}
+
+void ShadowPipeline::SelectVariant(InstanceGroup& group, const GameObject& first) {
+  bool octNormals = _HasOctNormals(first.meshPtr.lock()->GetAttribDesc());
+  const auto& program = GetVariant(*_instancedVariants, !first.materialData.diffuseTex.expired(), octNormals);
+  if (group.shader == program) {
+    return;
+  }
+  group.shader = program;
+  group.material = Mine::CreateShaderUniformOpenGL(*program);
+  _SetSamplerUnits(*group.material);
+}
+
+uint64_t ShadowPipeline::GetLightConfigKey() const {
+  int lightCount = std::min((int)_lights.size(), MAX_LIGHT_COUNT);
+  uint64_t key = Hash64(&lightCount, sizeof(lightCount));
+  for (int i = 0; i < lightCount; i++) {
+    int config[2] = {(int)_lights[i].GetShadowFilter(), _lights[i].shadowSamples};
+    key = Hash64(config, sizeof(config), key);
+  }
+  return key;
+}
+
+void ShadowPipeline::UpdateVariants() {
+  //defines are strings, only build them when the inputs changed
+  auto key = GetLightConfigKey();
+  //_lightDefines stays empty until the first call
+  if (!_lightDefines.empty() && key == _lightConfigKey) {
+    return;
+  }
+  _lightConfigKey = key;
+  auto defines = GetLightDefines();
+  if (defines == _lightDefines) {
+    return;
+  }
+  _lightDefines = std::move(defines);
+  _multiDrawShaders[0] = nullptr;
+  _multiDrawShaders[1] = nullptr;
+  for (auto& go : _objects) {
+    SelectVariant(go);
+  }
+  for (auto& group : _instanceGroups) {
+    SelectVariant(group, _objects[group.objects[0]]);
+  }
+}
+
+bool ShadowPipeline::IsInstanced(const GameObject& go) const {
+  return (int)_instanceGroups[go.instanceGroup].objects.size() >= minInstanceCount;
+}
+
+void ShadowPipeline::AddInstance(const GameObject& go, uint32_t index, float depth, int lod) {
+  auto& group = _instanceGroups[go.instanceGroup];
+  if (group.visible.empty()) {
+    group.depth = depth;
+    group.lod = lod;
+  } else {
+    group.depth = std::min(group.depth, depth);
+    group.lod = std::min(group.lod, lod);  //finest lod of any member
+  }
+  group.visible.emplace_back(index);
+}
+
+void ShadowPipeline::PushInstanceGroups(uint32_t pass) {
+  size_t count = 0;
+  for (const auto& group : _instanceGroups) {
+    count += group.visible.size();
+  }
+  if (count == 0) {
+    return;
+  }
+  auto instances = _ring->Allocate(count * sizeof(Matrix4x4), sizeof(Vector4));
+  auto dst = (Matrix4x4*)instances.ptr;
+  for (size_t g = 0; g < _instanceGroups.size(); g++) {
+    auto& group = _instanceGroups[g];
+    if (group.visible.empty()) {
+      continue;
+    }
+    group.instanceOffset = instances.offset + (GLintptr)((unsigned char*)dst - (unsigned char*)instances.ptr);
+    for (auto index : group.visible) {
+      const auto& go = _objects[index];
+      *dst++ = Mul(Scale(Translation(go.pos), go.scale), go.meshPtr.lock()->GetPositionDecodeMatrix());
+    }
+    const auto& go = _objects[group.objects[0]];
+    _queue.Push(MakeSortKey(SortKeyOrder::FrontToBack, pass, go.programId, go.textureId, go.meshId, group.depth), (uint32_t)g, group.lod);
+  }
+}
+
+void ShadowPipeline::AllocateShadowTiles() {
+  //screen pixels covered by the shadowed region bound the largest useful tile
+  auto [fbw, fbh] = Mine::GetFrameBufferSizeOpenGL();
+  float pixelSize = 2 * std::tan(mainCamera.fov * 0.5f) / std::max(fbh, 1);
+  float regionPixels = SHADOW_EXTENT / (std::max(Length(mainCamera.pos), 1.0f) * pixelSize);
+  float baseLevel = std::max(std::log2(maxShadowTile / std::max(regionPixels, 1.0f)), 0.0f);
+  int maxLevel = 0;
+  while ((maxShadowTile >> (maxLevel + 1)) >= minShadowTile) {
+    maxLevel++;
+  }
+
+  //light reaching the eye, blinn_phong.frag falls off with 1 / distance
+  float maxImportance = 0;
+  std::vector<float> importance(_lights.size(), 0.0f);
+  for (size_t i = 0; i < _lights.size() && i < MAX_LIGHT_COUNT; i++) {
+    const auto& l = _lights[i];
+    if (!l.hasShadow) {
+      continue;
+    }
+    importance[i] = l.light.intensity / std::max(Length(Sub(l.light.pos, mainCamera.pos)), 1.0f);
+    maxImportance = std::max(maxImportance, importance[i]);
+  }
+
+  bool changed = false;
+  std::vector<int> depthSizes(_lights.size(), 0);
+  std::vector<int> momentSizes(_lights.size(), 0);
+  for (size_t i = 0; i < _lights.size(); i++) {
+    auto& l = _lights[i];
+    int level = -1;
+    if (importance[i] > 0) {
+      //half a level of slack, lights near a boundary would repack every frame
+      float ideal = baseLevel + std::log2(maxImportance / importance[i]);
+      level = l.shadowTileLevel >= 0 && std::abs(ideal - l.shadowTileLevel) <= 0.75f ? l.shadowTileLevel : (int)std::round(ideal);
+      level = std::min(level, maxLevel);
+    }
+    bool moments = l.shadowFilter == ShadowFilter::VSM;
+    changed = changed || level != l.shadowTileLevel || moments != l.shadowTileMoments;
+    l.shadowTileLevel = level;
+    l.shadowImportance = importance[i];
+    (moments ? momentSizes : depthSizes)[i] = level < 0 ? 0 : maxShadowTile >> level;
+  }
+
+  int atlasSize = FloorPowerOfTwo(shadowAtlasSize);
+  int depthSize = FitAtlasSize(depthSizes, atlasSize, minShadowTile);
+  int momentSize = FitAtlasSize(momentSizes, atlasSize, minShadowTile);
+  if (_shadowAtlasSize != depthSize || _momentAtlasSize != momentSize || _shadowAtlasCached != shadowCaching) {
+    for (auto* atlas : {&_shadowAtlas, &_momentAtlas, &_staticShadowAtlas, &_staticMomentAtlas}) {
+      atlas->Delete();
+      *atlas = ShadowMap2DOpenGL();
+    }
+    if (depthSize > 0) {
+      _shadowAtlas = ShadowMap2DOpenGL(depthSize, depthSize);
+      if (shadowCaching) {
+        _staticShadowAtlas = ShadowMap2DOpenGL(depthSize, depthSize);
+      }
+    }
+    if (momentSize > 0) {
+      _momentAtlas = ShadowMap2DOpenGL(momentSize, momentSize, true);
+      if (shadowCaching) {
+        //never blurred or mipmapped, CopyRegion reads level 0
+        _staticMomentAtlas = ShadowMap2DOpenGL(momentSize, momentSize, true, false);
+      }
+    }
+    _shadowAtlasSize = depthSize;
+    _momentAtlasSize = momentSize;
+    _shadowAtlasCached = shadowCaching;
+    for (auto& l : _lights) {
+      l.staticShadowKey = 0;
+      l.shadowKey = 0;
+    }
+    changed = true;
+  }
+  if (!changed) {
+    return;
+  }
+  auto depthTiles = PackAtlasTiles(std::max(depthSize, 1), depthSizes, importance, minShadowTile);
+  auto momentTiles = PackAtlasTiles(std::max(momentSize, 1), momentSizes, importance, minShadowTile);
+  for (size_t i = 0; i < _lights.size(); i++) {
+    auto& l = _lights[i];
+    bool moments = l.shadowFilter == ShadowFilter::VSM;
+    const auto& tile = moments ? momentTiles[i] : depthTiles[i];
+    //a moved tile holds nothing of this light, it can't wait for the update budget
+    if (tile.x != l.shadowTile.x || tile.y != l.shadowTile.y || tile.size != l.shadowTile.size || moments != l.shadowTileMoments) {
+      l.shadowKey = 0;
+    }
+    l.shadowTile = tile;
+    l.shadowTileMoments = moments;
+  }
+}
+
+static Matrix4x4 _LightSpaceVP(const Vector3& lightPos) {
+  auto&& look = Mine::LookAtRH(lightPos, Vector3(0, 0, 0), Vector3(0, 1, 0));
+  auto&& ortho = Mine::OrthoRH(-SHADOW_EXTENT * 0.5f, SHADOW_EXTENT * 0.5f, -SHADOW_EXTENT * 0.5f, SHADOW_EXTENT * 0.5f, 0.1f, 30);
+  return Mul(ortho, look);
+}
+
+void ShadowPipeline::CollectShadowCasters(const Light& light, ShadowCasterLists& lists) {
+  const auto& lightSpaceVP = lists.lightSpaceVP;
+  const auto& tile = light.shadowTile;
+  float shadowError = lodPixelError * shadowLodBias * SHADOW_EXTENT / tile.size;
+  //light is orthographic, so boxes stay boxes in light clip space and z grows away from the light
+  CullBoundingBoxes(ExtractFrustum(lightSpaceVP), _worldBounds.data(), _worldBounds.size(), _casters.data());
+  bool hasReceiver = false;
+  BoundingBox receivers;
+  for (size_t i = 0; i < _objects.size(); i++) {
+    if (_visible[i]) {
+      auto box = Transform(lightSpaceVP, _worldBounds[i]);
+      receivers = hasReceiver ? Merge(receivers, box) : box;
+      hasReceiver = true;
+    }
+  }
+  lists.staticCasters.clear();
+  lists.dynamicCasters.clear();
+  for (size_t index = 0; index < _objects.size(); index++) {
+    const auto& go = _objects[index];
+    //the static layer skips receiver culling, it must not depend on the camera
+    bool cached = shadowCaching && go.isStatic;
+    if (!_casters[index] || (!hasReceiver && !cached)) {
+      continue;
+    }
+    //shadow volume extruded away from the light must overlap receivers
+    auto box = Transform(lightSpaceVP, _worldBounds[index]);
+    if (!cached &&
+        (box.max.x < receivers.min.x || box.min.x > receivers.max.x ||
+         box.max.y < receivers.min.y || box.min.y > receivers.max.y ||
+         box.min.z > receivers.max.z)) {
+      continue;
+    }
+    //nearest to the light first, clip z is in [-1, 1]
+    ShadowCaster caster{(uint32_t)index, box.min.z * 0.5f + 0.5f, go.SelectLod(shadowError)};
+    (go.isStatic ? lists.staticCasters : lists.dynamicCasters).push_back(caster);
+  }
+
+  int moments = light.shadowFilter == ShadowFilter::VSM ? 1 : 0;
+  uint64_t view = Hash64(&lightSpaceVP, sizeof(lightSpaceVP));
+  view = Hash64(&tile, sizeof(tile), view);
+  view = Hash64(&moments, sizeof(moments), view);
+  lists.staticKey = _HashShadowCasters(_objects, lists.staticCasters, view);
+  lists.key = _HashShadowCasters(_objects, lists.dynamicCasters, lists.staticKey);
+}
+
+void ShadowPipeline::DrawShadowCasters(const Light& light, int moments, const std::vector<ShadowCaster>& casters) {
+  constexpr uint32_t instancedPass = 1;  //after single objects in every pass
+  if (casters.empty()) {
+    return;
+  }
+  const auto& shadow = _shadowPrograms[moments];
+  const auto& shadowMultiDraw = _shadowMultiDrawPrograms[moments];
+  const auto& shadowInstanced = _shadowInstancedPrograms[moments];
+  _queue.Clear();
+  for (const auto& c : casters) {
+    const auto& go = _objects[c.index];
+    if (IsInstanced(go)) {
+      AddInstance(go, c.index, c.depth, c.lod);
+      continue;
+    }
+    auto key = MakeSortKey(SortKeyOrder::FrontToBack, 0, 0, 0, go.meshId, c.depth);
+    _queue.Push(key, c.index, c.lod);
+  }
+  PushInstanceGroups(instancedPass);
+  _queue.Sort();
+  if (multiDrawIndirect && !_meshPools.empty()) {
+    shadowMultiDraw.uniform->SetValue(shadowMultiDraw.lightVPHandle, light.lightSpaceVP);
+    shadowMultiDraw.shader->SetPass(shadowMultiDraw.uniform->GetUniformObjects());
+    SubmitMultiDraw(false, 0);
+  }
+  MeshRendererOpenGL mr;
+  shadow.uniform->SetValue(shadow.lightVPHandle, light.lightSpaceVP);
+  mr.shader = shadow.shader;
+  mr.material = shadow.uniform;
+  for (const auto& r : _queue) {
+    if (GetSortKeyPass(r.key) == instancedPass) {
+      const auto& group = _instanceGroups[r.index];
+      const auto& go = _objects[group.objects[0]];
+      shadowInstanced.uniform->SetValue(shadowInstanced.lightVPHandle, light.lightSpaceVP);
+      go.meshPtr.lock()->BindInstanceBuffer(_ring->GetHandle(), group.instanceOffset);
+      mr.shader = shadowInstanced.shader;
+      mr.material = shadowInstanced.uniform;
+      mr.mesh = go.meshPtr;
+      mr.subMesh = go.subMesh;
+      mr.lod = r.lod;
+      mr.instanceCount = (GLsizei)group.visible.size();
+      mr.Render();
+      mr.instanceCount = 1;
+      mr.shader = shadow.shader;
+      mr.material = shadow.uniform;
+      _stats.drawCalls++;
+      _stats.instancedObjects += (int)group.visible.size();
+      continue;
+    }
+    const auto& go = _objects[r.index];
+    if (multiDrawIndirect && go.meshPool >= 0) {
+      continue;
+    }
+    _ring->BindRange(GL_UNIFORM_BUFFER, PER_OBJECT_BLOCK_BINDING, GetObjectBlock(r.index));
+    mr.mesh = go.meshPtr;
+    mr.subMesh = go.subMesh;
+    mr.lod = r.lod;
+    mr.Render();
+    _stats.drawCalls++;
+  }
+  for (auto& group : _instanceGroups) {
+    group.visible.clear();
+  }
+}
+
+void ShadowPipeline::BlurMoments(const Light& light) {
+  //the viewport still covers the tile
+  const auto& tile = light.shadowTile;
+  float texel = 1.0f / _momentAtlasSize;
+  SetEnableOpenGL(GL_DEPTH_TEST, false);
+  _shadowBlurUniform->SetValue(_shadowBlurTileHandle, Vector3(tile.x * texel, tile.y * texel, tile.size * texel));
+  _momentAtlas.BindBlurTarget();
+  _momentAtlas.GetMomentMap().Bind(GL_TEXTURE0);
+  _shadowBlurUniform->SetValue(_shadowBlurAxisHandle, 0);
+  _shadowBlurShader->SetPass(_shadowBlurUniform->GetUniformObjects());
+  DrawFullScreenTriangleOpenGL();
+  _momentAtlas.BindMomentTarget();
+  _momentAtlas.GetBlurMap().Bind(GL_TEXTURE0);
+  _shadowBlurUniform->SetValue(_shadowBlurAxisHandle, 1);
+  _shadowBlurShader->SetPass(_shadowBlurUniform->GetUniformObjects());
+  DrawFullScreenTriangleOpenGL();
+  _stats.drawCalls += 2;
+}
+
+void ShadowPipeline::ReserveRing() {
+  //upper bound of one frame, every object in every pass
+  auto count = (GLsizeiptr)_objects.size();
+  auto passes = (GLsizeiptr)_lights.size() + 1;
+  GLsizeiptr size = _AlignUp(sizeof(PerFrameStd140), _uniformAlignment);
+  size += count * _objectBlockStride + _uniformAlignment;
+  size += count * (GLsizeiptr)sizeof(ObjectStd430) + _storageAlignment;
+  size += (GLsizeiptr)_instanceGroups.size() * (_objectBlockStride + _uniformAlignment);
+  size += passes * (count * (GLsizeiptr)sizeof(Matrix4x4) + (GLsizeiptr)sizeof(Vector4));
+  //multi draw flushes, at most one per pool plus one per object
+  GLsizeiptr drawSize = (GLsizeiptr)(sizeof(DrawElementsIndirectCommandOpenGL) + 2 * sizeof(uint32_t));
+  size += passes * (count * drawSize + (count + (GLsizeiptr)_meshPools.size()) * (_storageAlignment + 4));
+  if (size > _ring->GetFrameSize()) {
+    //gl keeps the old storage alive until pending draws finish
+    _ring->Delete();
+    _ring = Mine::CreateRingBufferOpenGL(_AlignUp(size * 2, _ringAlignment), framesInFlight);
+  }
+}
+
+void ShadowPipeline::WriteObjectData() {
+  size_t count = _objects.size();
+  _objectBlocks = _ring->Allocate(count * _objectBlockStride, _uniformAlignment);
+  bool multiDraw = multiDrawIndirect && !_meshPools.empty();
+  RingAllocationOpenGL objectArray = {nullptr, 0, 0};
+  if (multiDraw) {
+    objectArray = _ring->Allocate(count * sizeof(ObjectStd430), _storageAlignment);
+  }
+  //the mapping is plain memory, no gl calls on the workers
+  constexpr size_t chunk = 256;
+  ThreadPool::GetInstance().ParallelFor((count + chunk - 1) / chunk, [&](size_t c) {
+    for (size_t i = c * chunk; i < std::min(count, c * chunk + chunk); i++) {
+      const auto& go = _objects[i];
+      ObjectStd430 o;
+      o.model = Mul(Scale(Translation(go.pos), go.scale), go.meshPtr.lock()->GetPositionDecodeMatrix());
+      go.materialData.SetValues(o);
+      memcpy((unsigned char*)_objectBlocks.ptr + i * _objectBlockStride, &o, sizeof(o));
+      if (multiDraw) {
+        memcpy((ObjectStd430*)objectArray.ptr + i, &o, sizeof(o));
+      }
+    }
+  });
+  if (multiDraw) {
+    _ring->BindRange(GL_SHADER_STORAGE_BUFFER, OBJECT_BUFFER_BINDING, objectArray);
+  }
+}
+
+RingAllocationOpenGL ShadowPipeline::GetObjectBlock(uint32_t index) const {
+  GLsizeiptr offset = index * _objectBlockStride;
+  return RingAllocationOpenGL{(unsigned char*)_objectBlocks.ptr + offset, _objectBlocks.offset + offset, sizeof(ObjectStd430)};
+}
+
+void ShadowPipeline::AddToMeshPool(GameObject& go, const GPUMeshOpenGL& mesh) {
+  for (size_t i = 0; i < _pooledMeshes.size(); i++) {
+    if (_pooledMeshes[i].first == &mesh) {
+      go.meshPool = _pooledMeshes[i].second;
+      go.poolRange = _pooledRanges[i];
+      return;
+    }
+  }
+  if (mesh.GetAttribDesc().empty()) {
+    return;
+  }
+  int pool = -1;
+  for (size_t i = 0; i < _meshPools.size(); i++) {
+    if (_meshPools[i].IsCompatible(mesh)) {
+      pool = (int)i;
+      break;
+    }
+  }
+  if (pool < 0) {
+    _meshPools.emplace_back(MeshPoolOpenGL(mesh.GetAttribDesc(), mesh.GetIndexType()));
+    pool = (int)_meshPools.size() - 1;
+  }
+  go.meshPool = pool;
+  go.poolRange = _meshPools[pool].Add(mesh);
+  _pooledMeshes.emplace_back(&mesh, pool);
+  _pooledRanges.emplace_back(go.poolRange);
+}
+
+void ShadowPipeline::FlushMultiDraw(MeshPoolOpenGL& pool) {
+  if (_commands.empty()) {
+    return;
+  }
+  auto drawCount = (GLsizei)_commands.size();
+  auto draws = _ring->Allocate(_drawData.size() * sizeof(uint32_t), _storageAlignment);
+  memcpy(draws.ptr, _drawData.data(), draws.size);
+  _ring->BindRange(GL_SHADER_STORAGE_BUFFER, DRAW_BUFFER_BINDING, draws);
+  auto commands = _ring->Allocate(drawCount * sizeof(DrawElementsIndirectCommandOpenGL), 4);
+  memcpy(commands.ptr, _commands.data(), commands.size);
+  pool.ReserveDraws((GLuint)drawCount);
+  pool.Bind();
+  BindBufferOpenGL(GL_DRAW_INDIRECT_BUFFER, _ring->GetHandle());
+  MineGLFuncCall(glMultiDrawElementsIndirect(GL_TRIANGLES, pool.GetIndexType(), (void*)commands.offset, drawCount, 0));
+  _stats.drawCalls++;
+  _commands.clear();
+  _drawData.clear();
+}
+
+void ShadowPipeline::SetMultiDrawPass(const MeshPoolOpenGL& pool) {
+  int octNormals = _HasOctNormals(pool.GetAttribDesc()) ? 1 : 0;
+  auto& shader = _multiDrawShaders[octNormals];
+  auto& uniform = _multiDrawUniforms[octNormals];
+  if (shader == nullptr) {
+    //null diffuse slots sample the empty unit, same as the untextured variant
+    shader = GetVariant(*_multiDrawVariants, true, octNormals != 0);
+    uniform = Mine::CreateShaderUniformOpenGL(*shader);
+    _SetSamplerUnits(*uniform);
+  }
+  shader->SetPass(uniform->GetUniformObjects());
+}
+
+void ShadowPipeline::SubmitMultiDraw(bool mainPass, uint32_t pass) {
+  for (size_t p = 0; p < _meshPools.size(); p++) {
+    auto& pool = _meshPools[p];
+    if (mainPass) {
+      //each pool has one vertex layout, its program decodes that layout's normals
+      SetMultiDrawPass(pool);
+    }
+    _diffuseSlotCount = 0;
+    for (const auto& r : _queue) {
+      const auto& go = _objects[r.index];
+      if (GetSortKeyPass(r.key) != pass || go.meshPool != (int)p) {
+        continue;
+      }
+      uint32_t slot = 0;
+      if (mainPass) {
+        auto tex = go.materialData.diffuseTex.lock().get();
+        auto end = _diffuseSlots + _diffuseSlotCount;
+        auto iter = std::find(_diffuseSlots, end, tex);
+        if (iter == end) {
+          if (_diffuseSlotCount == MAX_DIFFUSE_COUNT) {
+            FlushMultiDraw(pool);
+            _diffuseSlotCount = 0;
+          }
+          _diffuseSlots[_diffuseSlotCount] = tex;
+          if (tex == nullptr) {
+            BindTextureOpenGL(_diffuseSlotCount, GL_TEXTURE_2D, 0);
+          } else {
+            tex->Bind(GL_TEXTURE0 + _diffuseSlotCount);
+          }
+          iter = _diffuseSlots + _diffuseSlotCount++;
+        }
+        slot = (uint32_t)(iter - _diffuseSlots);
+      }
+      auto [offset, count] = go.meshPtr.lock()->GetIndexRange(go.subMesh, r.lod);
+      DrawElementsIndirectCommandOpenGL cmd;
+      cmd.count = (GLuint)count;
+      cmd.instanceCount = 1;
+      cmd.firstIndex = go.poolRange.firstIndex + (GLuint)offset;
+      cmd.baseVertex = go.poolRange.baseVertex;
+      cmd.baseInstance = (GLuint)_commands.size();  //draw id where gl_DrawIDARB is missing
+      _commands.emplace_back(cmd);
+      _drawData.emplace_back(r.index);
+      _drawData.emplace_back(slot);
+    }
+    FlushMultiDraw(pool);
+  }
+}
+
 void ShadowPipeline::Render() {
   MeshRendererOpenGL mr;
   auto [fbw, fbh] = Mine::GetFrameBufferSizeOpenGL();
 
-  //shadow pass
-  for (auto& light : _lights) {
-    if (light.hasShadow) {
-      light.shadowMap.Bind();
-      mr.shader = _shadowShader;
-      MineGLFuncCall(glClearColor(0, 0, 0, 1));
-      MineGLFuncCall(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
-      MineGLFuncCall(glViewport(0, 0, shadowWidth, shadowWidth));
-      MineGLFuncCall(glEnable(GL_DEPTH_TEST));
-      MineGLFuncCall(glDisable(GL_CULL_FACE));
-      auto&& look = Mine::LookAtRH(light.light.pos, Vector3(0, 0, 0), Vector3(0, 1, 0));
-      auto&& ortho = Mine::OrthoRH(-15, 15, -15, 15, 0.1f, 30);
-      light.lightSpaceVP = Mul(ortho, look);
-      for (const auto& go : _objects) {
-        auto&& model = Scale(Translation(go.pos), go.scale);
-        auto&& mvp = Mul(light.lightSpaceVP, model);
-        _shadowShaderUniform->SetValue("lightMVP", mvp);
-        mr.material = _shadowShaderUniform;
-        mr.mesh = go.meshPtr;
-        mr.Render();
+  //visibility first, shadow casters are culled against visible receivers
+  _worldBounds.resize(_objects.size());
+  _visible.resize(_objects.size());
+  _casters.resize(_objects.size());
+  for (size_t i = 0; i < _objects.size(); i++) {
+    _worldBounds[i] = _objects[i].GetWorldBounds();
+  }
+  auto visibleCount = CullBoundingBoxes(mainCamera.GetFrustum(), _worldBounds.data(), _worldBounds.size(), _visible.data());
+  _stats.visibleObjects = (int)visibleCount;
+  _stats.culledObjects = (int)(_objects.size() - visibleCount);
+  _stats.shadowCasters = 0;
+  _stats.culledShadowCasters = 0;
+  _stats.drawCalls = 0;
+  _stats.instancedObjects = 0;
+
+  AllocateShadowTiles();
+  UpdateVariants();
+  ReserveRing();
+  _ring->BeginFrame();
+  WriteObjectData();
+
+  //shadow pass, every light draws into its tile of an atlas.
+  //static casters are cached in second atlases, tiles whose casters did not change keep last frame's content.
+  //changed tiles are redrawn by priority within the update budget, the others keep their old lightSpaceVP
+  _stats.shadowTilesDrawn = 0;
+  _stats.staticShadowLayersDrawn = 0;
+  _stats.staleShadowTiles = 0;
+  _shadowUpdates.clear();
+  _shadowCasters.resize(_lights.size());
+  for (uint32_t i = 0; i < (uint32_t)_lights.size(); i++) {
+    auto& light = _lights[i];
+    if (light.GetShadowFilter() == ShadowFilter::None) {
+      continue;
+    }
+    auto& lists = _shadowCasters[i];
+    lists.lightSpaceVP = _LightSpaceVP(light.light.pos);
+    CollectShadowCasters(light, lists);
+    if (shadowCaching && lists.key == light.shadowKey) {
+      light.shadowStaleFrames = 0;
+      continue;
+    }
+    //bright at the camera, long waiting and far moved lights first, an empty tile can't wait
+    float motion = Length(Sub(light.light.pos, light.shadowLightPos));
+    float priority = light.shadowKey == 0 ? std::numeric_limits<float>::max()
+                                          : light.shadowImportance * (light.shadowStaleFrames + 1) * (1 + motion);
+    _shadowUpdates.emplace_back(priority, i);
+  }
+  std::sort(_shadowUpdates.begin(), _shadowUpdates.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+  SetClearColorOpenGL(1, 1, 1, 1);  //farthest moments, the depth atlas has no color
+  bool blurred = false;
+  int64_t texels = 0;
+  for (const auto& [priority, i] : _shadowUpdates) {
+    auto& light = _lights[i];
+    const auto& tile = light.shadowTile;
+    int64_t area = (int64_t)tile.size * tile.size;
+    bool inBudget = (maxShadowUpdates <= 0 || _stats.shadowTilesDrawn < maxShadowUpdates) &&
+                    (shadowTexelBudget <= 0 || texels + area <= shadowTexelBudget);
+    //the first tile always goes, a budget below one tile would starve every light
+    if (!inBudget && _stats.shadowTilesDrawn > 0 && light.shadowKey != 0) {
+      light.shadowStaleFrames++;
+      _stats.staleShadowTiles++;
+      continue;
+    }
+    texels += area;
+    _stats.shadowTilesDrawn++;
+
+    //the lists of the change test are current, nothing moved since
+    const auto& lists = _shadowCasters[i];
+    light.lightSpaceVP = lists.lightSpaceVP;
+    light.shadowLightPos = light.light.pos;
+    light.shadowStaleFrames = 0;
+    light.shadowKey = lists.key;
+    int casters = (int)(lists.staticCasters.size() + lists.dynamicCasters.size());
+    _stats.shadowCasters += casters;
+    _stats.culledShadowCasters += (int)_objects.size() - casters;
+
+    int moments = light.shadowTileMoments ? 1 : 0;
+    auto& atlas = moments ? _momentAtlas : _shadowAtlas;
+    auto& cache = moments ? _staticMomentAtlas : _staticShadowAtlas;
+    SetViewportOpenGL(tile.x, tile.y, tile.size, tile.size);
+    SetEnableOpenGL(GL_DEPTH_TEST, true);
+    SetEnableOpenGL(GL_CULL_FACE, false);
+    MineGLFuncCall(glScissor(tile.x, tile.y, tile.size, tile.size));
+    if (shadowCaching) {
+      if (lists.staticKey != light.staticShadowKey) {
+        cache.Bind();
+        SetEnableOpenGL(GL_SCISSOR_TEST, true);
+        MineGLFuncCall(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+        SetEnableOpenGL(GL_SCISSOR_TEST, false);
+        DrawShadowCasters(light, moments, lists.staticCasters);
+        light.staticShadowKey = lists.staticKey;
+        _stats.staticShadowLayersDrawn++;
       }
-      light.shadowMap.Unbind();
+      atlas.CopyRegion(cache, tile.x, tile.y, tile.size, tile.size);
+      atlas.Bind();
+    } else {
+      atlas.Bind();
+      SetEnableOpenGL(GL_SCISSOR_TEST, true);
+      MineGLFuncCall(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+      SetEnableOpenGL(GL_SCISSOR_TEST, false);
+      DrawShadowCasters(light, moments, lists.staticCasters);
+    }
+    DrawShadowCasters(light, moments, lists.dynamicCasters);
+    if (moments) {
+      BlurMoments(light);
+      blurred = true;
     }
   }
-  MineGLFuncCall(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+  if (blurred) {
+    _momentAtlas.GetMomentMap().GenerateMipmap();
+  }
+  BindFrameBufferOpenGL(GL_FRAMEBUFFER, 0);
 
-  //normal pass
-  MineGLFuncCall(glClearColor(0, 0, 0, 1));
-  MineGLFuncCall(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
-  MineGLFuncCall(glViewport(0, 0, fbw, fbh));
-  MineGLFuncCall(glEnable(GL_DEPTH_TEST));
-  MineGLFuncCall(glEnable(GL_CULL_FACE));
+  //per frame block, shared by every draw of the main pass
   auto&& view = mainCamera.View();
   auto&& proj = mainCamera.Projection();
-  auto&& vp = Mul(proj, view);
-  mr.mesh = _lightCube;
-  mr.shader = _lightCubeShader;
-  for (const auto& light : _lights) {
-    auto&& model = Scale(Translation(light.light.pos), Vector3(0.01f, 0.01f, 0.01f));
-    auto&& mvp = Mul(vp, model);
-    light.material->SetValue("mvp", mvp);
-    light.material->SetValue("color", light.light.color);
-    mr.material = light.material;
-    mr.Render();
+  int lightCount = std::min((int)_lights.size(), MAX_LIGHT_COUNT);
+  _perFrame.viewProj = Mul(proj, view);
+  _perFrame.eyePos = mainCamera.pos;
+  _perFrame.lightCount = lightCount;
+  for (int i = 0; i < lightCount; i++) {
+    const auto& l = _lights[i];
+    _perFrame.lightVP[i] = l.lightSpaceVP;
+    _perFrame.light[i].pos = l.light.pos;
+    _perFrame.light[i].intensity = l.light.intensity;
+    _perFrame.light[i].color = l.light.color;
+    float texel = 1.0f / std::max(l.shadowTileMoments ? _momentAtlasSize : _shadowAtlasSize, 1);
+    //a tile keeps minShadowTile texels at its highest level, coarser ones mix in the neighbours
+    float maxLod = std::max(std::log2((float)l.shadowTile.size / minShadowTile), 0.0f);
+    _perFrame.shadowTile[i] = Vector4(l.shadowTile.x * texel, l.shadowTile.y * texel, l.shadowTile.size * texel, maxLod);
   }
+  auto perFrame = _ring->Allocate(sizeof(_perFrame), _uniformAlignment);
+  memcpy(perFrame.ptr, &_perFrame, sizeof(_perFrame));
+  _ring->BindRange(GL_UNIFORM_BUFFER, PER_FRAME_BLOCK_BINDING, perFrame);
 
-  for (const auto& go : _objects) {
-    auto&& model = Scale(Translation(go.pos), go.scale);
-    auto&& mvp = Mul(vp, model);
+  //normal pass
+  SetClearColorOpenGL(0, 0, 0, 1);
+  MineGLFuncCall(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+  SetViewportOpenGL(0, 0, fbw, fbh);
+  SetEnableOpenGL(GL_DEPTH_TEST, true);
+  SetEnableOpenGL(GL_CULL_FACE, true);
+  //world size of one pixel at unit distance
+  float pixelSize = 2 * std::tan(mainCamera.fov * 0.5f) / fbh;
 
-    go.material->SetValue("mvp", mvp);
-    go.material->SetValue("lightCount", (int)_lights.size());
-    go.material->SetValue("eyePos", mainCamera.pos);
-    go.materialData.SetValues(*this, *go.material);
-    for (int i = 0; i < _lights.size(); i++) {
-      go.material->SetArray("lightMVP", i, Mul(_lights[i].lightSpaceVP, model));
-      Mine::SetPointLightValues(_lights[i].light, i, *go.material);
-      _lights[i].SetValues(*this, i, i + 1, *go.material);  //hard core shadow map slot
+  //opaque objects front to back for early z under the pcss shader, light cubes after them grouped by state
+  constexpr uint32_t opaquePass = 0;
+  constexpr uint32_t instancedPass = 1;
+  constexpr uint32_t lightCubePass = 2;
+  _queue.Clear();
+  for (size_t index = 0; index < _objects.size(); index++) {
+    if (!_visible[index]) {
+      continue;
+    }
+    const auto& go = _objects[index];
+    const auto& box = _worldBounds[index];
+    //distance to the box surface along the center direction, camera inside counts as 0
+    float distance = std::max(Length(Sub(box.Center(), mainCamera.pos)) - Length(box.Extent()), 0.0f);
+    float lodDistance = Length(Sub(go.pos, mainCamera.pos));
+    int lod = go.SelectLod(lodPixelError * pixelSize * lodDistance);
+    if (IsInstanced(go)) {
+      AddInstance(go, (uint32_t)index, distance / mainCamera.zFar, lod);
+      continue;
     }
+    auto key = MakeSortKey(SortKeyOrder::FrontToBack, opaquePass, go.programId, go.textureId, go.meshId, distance / mainCamera.zFar);
+    _queue.Push(key, (uint32_t)index, lod);
+  }
+  PushInstanceGroups(instancedPass);
+  for (size_t i = 0; i < _lights.size(); i++) {
+    _queue.Push(MakeSortKey(SortKeyOrder::State, lightCubePass, 0, 0, 0, 0), (uint32_t)i);  //one shader, one mesh
+  }
+  _queue.Sort();
+
+  if (_shadowAtlasSize > 0) {
+    _shadowAtlas.GetDepthMap().Bind(GL_TEXTURE0 + SHADOW_MAP_UNIT);
+    _shadowAtlas.GetDepthMap().Bind(GL_TEXTURE0 + SHADOW_COMPARE_UNIT);
+  } else {
+    BindTextureOpenGL(SHADOW_MAP_UNIT, GL_TEXTURE_2D, 0);
+    BindTextureOpenGL(SHADOW_COMPARE_UNIT, GL_TEXTURE_2D, 0);
+  }
+  _shadowCompareSampler->Bind(SHADOW_COMPARE_UNIT);
+  if (_momentAtlasSize > 0) {
+    _momentAtlas.GetMomentMap().Bind(GL_TEXTURE0 + SHADOW_MOMENT_UNIT);
+  } else {
+    BindTextureOpenGL(SHADOW_MOMENT_UNIT, GL_TEXTURE_2D, 0);
+  }
+  _shadowKernel.BindBase(SHADOW_KERNEL_BLOCK_BINDING);
+  if (multiDrawIndirect && !_meshPools.empty()) {
+    SubmitMultiDraw(true, opaquePass);
+  }
+  for (const auto& r : _queue) {
+    if (GetSortKeyPass(r.key) == lightCubePass) {
+      const auto& light = _lights[r.index];
+      auto&& model = Scale(Translation(light.light.pos), Vector3(0.01f, 0.01f, 0.01f));
+      light.material->SetValue(light.modelHandle, model);
+      light.material->SetValue(light.colorHandle, light.light.color);
+      mr.material = light.material;
+      mr.mesh = _lightCube;
+      mr.subMesh = -1;
+      mr.lod = 0;
+      mr.shader = _lightCubeShader;
+      mr.Render();
+      _stats.drawCalls++;
+      continue;
+    }
+    if (GetSortKeyPass(r.key) == instancedPass) {
+      const auto& group = _instanceGroups[r.index];
+      const auto& go = _objects[group.objects[0]];
+      auto block = _ring->Allocate(sizeof(ObjectStd430), _uniformAlignment);
+      ObjectStd430 o;
+      o.model = Matrix4x4::Identity();
+      go.materialData.SetValues(o);
+      memcpy(block.ptr, &o, sizeof(o));
+      _ring->BindRange(GL_UNIFORM_BUFFER, PER_OBJECT_BLOCK_BINDING, block);
+      go.materialData.BindDiffuse(0);
+      go.meshPtr.lock()->BindInstanceBuffer(_ring->GetHandle(), group.instanceOffset);
+      mr.material = group.material;
+      mr.mesh = go.meshPtr;
+      mr.subMesh = go.subMesh;
+      mr.lod = r.lod;
+      mr.shader = group.shader;
+      mr.instanceCount = (GLsizei)group.visible.size();
+      mr.Render();
+      mr.instanceCount = 1;
+      _stats.drawCalls++;
+      _stats.instancedObjects += (int)group.visible.size();
+      continue;
+    }
+    const auto& go = _objects[r.index];
+    if (multiDrawIndirect && go.meshPool >= 0) {
+      continue;
+    }
+    _ring->BindRange(GL_UNIFORM_BUFFER, PER_OBJECT_BLOCK_BINDING, GetObjectBlock(r.index));
+    go.materialData.BindDiffuse(0);
 
     mr.material = go.material;
     mr.mesh = go.meshPtr;
+    mr.subMesh = go.subMesh;
+    mr.lod = r.lod;
     mr.shader = go.shader;
     mr.Render();
+    _stats.drawCalls++;
+  }
+  for (auto& group : _instanceGroups) {
+    group.visible.clear();
   }
+  _ring->EndFrame();
 }
 
 std::vector<Light>& ShadowPipeline::GetLights() {
   return _lights;
+}
+
+void ShadowPipeline::SetObjectTransform(size_t index, const Vector3& pos, const Vector3& scale) {
+  assert(index < _objects.size());
+  _objects[index].pos = pos;
+  _objects[index].scale = scale;
+}
+
+const PipelineStats& ShadowPipeline::GetStats() const {
+  return _stats;
 }
\ No newline at end of file
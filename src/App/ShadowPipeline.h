@@ -3,12 +3,68 @@
 #include <vector>
 
 #include <OpenGLContext.h>
+#include <MeshCache.h>
+#include <ProgramCache.h>
+#include <ShadowAtlas.h>
 #include <Camera.h>
+#include <RenderQueue.h>
 
 namespace Mine {
 
 class ShadowPipeline;
 
+constexpr int MAX_LIGHT_COUNT = 8;    //MAX_LIGHT in asset shaders
+constexpr int MAX_DIFFUSE_COUNT = 8;  //MAX_DIFFUSE in blinn_phong.frag, units 0 to 7
+constexpr int SHADOW_MAP_UNIT = MAX_DIFFUSE_COUNT;   //atlas depth
+constexpr int SHADOW_COMPARE_UNIT = SHADOW_MAP_UNIT + 1;  //atlas depth through a compare sampler
+constexpr int SHADOW_MOMENT_UNIT = SHADOW_MAP_UNIT + 2;   //atlas moments of VSM lights
+constexpr int SHADOW_KERNEL_SIZE = 64;  //SHADOW_KERNEL_SIZE in blinn_phong.frag, upper bound of NUM_SAMPLES
+constexpr GLuint PER_FRAME_BLOCK_BINDING = 0;
+constexpr GLuint PER_OBJECT_BLOCK_BINDING = 1;
+constexpr GLuint SHADOW_KERNEL_BLOCK_BINDING = 2;
+constexpr GLuint OBJECT_BUFFER_BINDING = 0;  //shader storage, multi draw path
+constexpr GLuint DRAW_BUFFER_BINDING = 1;
+
+/*
+ * std140 mirror of the PerFrame block in asset shaders
+ */
+struct PointLightStd140 {
+  Vector3 pos;
+  float intensity;
+  Vector3 color;
+  float padding;
+};
+
+struct PerFrameStd140 {
+  Matrix4x4 viewProj;
+  Matrix4x4 lightVP[MAX_LIGHT_COUNT];
+  Vector3 eyePos;
+  int lightCount;
+  PointLightStd140 light[MAX_LIGHT_COUNT];
+  Vector4 shadowTile[MAX_LIGHT_COUNT];  //atlas uv offset xy, size z, highest moment mip w
+};
+
+/*
+ * std430 ObjectData of the multi draw shaders, same layout as the std140 PerObject block
+ */
+struct ObjectStd430 {
+  Matrix4x4 model;
+  Vector4 ka;
+  Vector4 kd;
+  Vector4 ks;  //w is shininess
+};
+
+/*
+ * std140 ShadowKernel block of blinn_phong.frag, two disk points per element
+ */
+struct ShadowKernelStd140 {
+  Vector4 points[SHADOW_KERNEL_SIZE / 2];
+};
+
+static_assert(sizeof(ObjectStd430) == 112, "std430 ObjectData stride");
+static_assert(sizeof(PointLightStd140) == 32, "std140 struct array stride");
+static_assert(sizeof(PerFrameStd140) == 64 + 64 * MAX_LIGHT_COUNT + 16 + 48 * MAX_LIGHT_COUNT, "std140 PerFrame size");
+
 struct BlinnPhongMaterial {
   Vector3 ka;
   Vector3 kd;
@@ -20,56 +76,300 @@ struct BlinnPhongMaterial {
                                    ks(Vector3(1, 1, 1)),
                                    shininess(64),
                                    diffuseTex() {}
-  void SetValues(ShadowPipeline& pipeline, ShaderUniformOpenGL& uniform) const;
+  /*
+   * material part of the per object block, model is left alone
+   */
+  void SetValues(ObjectStd430& object) const;
+  void BindDiffuse(GLuint unit) const;
+};
+
+/*
+ * SHADOW_MODE_<i> of blinn_phong.frag, cheapest first
+ */
+enum class ShadowFilter {
+  None = 0,
+  Hard = 1,
+  PCF = 2,
+  PCSS = 3,
+  VSM = 4  //blurred, mipmapped moments, one filtered fetch
 };
 
 class Light {
  public:
   PointLight light;
   std::shared_ptr<ShaderUniformOpenGL> material;
+  UniformHandleOpenGL modelHandle;
+  UniformHandleOpenGL colorHandle;
   bool hasShadow;
-  ShadowMap2DOpenGL shadowMap;
+  ShadowFilter shadowFilter;
+  int shadowSamples;  //NUM_SAMPLES of PCF and PCSS, the largest of all lights wins, PCSS scales down from it
+  AtlasTile shadowTile;     //region of the depth atlas, of the moment atlas for VSM
+  int shadowTileLevel;      //tile is maxShadowTile >> level, -1 without one
+  bool shadowTileMoments;   //tile is in the moment atlas
   Matrix4x4 lightSpaceVP;
+  //content of the cached static layer and of the atlas tile, 0 forces a redraw
+  uint64_t staticShadowKey;
+  uint64_t shadowKey;
+  //update scheduling, lightSpaceVP stays the one of the last drawn tile
+  Vector3 shadowLightPos;  //light position of lightSpaceVP
+  float shadowImportance;  //brightness at the camera, from AllocateShadowTiles
+  int shadowStaleFrames;   //frames a changed tile waited for the budget
 
-  void SetValues(ShadowPipeline& pipeline, int index, int texSlot, ShaderUniformOpenGL& uniform) const;
+  /*
+   * None without shadow or atlas tile
+   */
+  ShadowFilter GetShadowFilter() const;
 };
 
 class GameObject {
  public:
   std::weak_ptr<GPUMeshOpenGL> meshPtr;
-  std::weak_ptr<ShaderProgramOpenGL> shader;
-  std::shared_ptr<ShaderUniformOpenGL> material;
+  int subMesh;
+  std::shared_ptr<ShaderVariantsOpenGL> shaderVariants;
+  std::weak_ptr<ShaderProgramOpenGL> shader;      //variant of shaderVariants for the current lights
+  std::shared_ptr<ShaderUniformOpenGL> material;  //samplers, the rest is in the per object block
   BlinnPhongMaterial materialData;
+  uint32_t programId;  //sort key ids, dense per pipeline
+  uint32_t textureId;
+  uint32_t meshId;
+  int meshPool;  //-1 draws through MeshRendererOpenGL only, so does any fragment shader but blinn_phong.frag
+  int instanceGroup;
+  MeshPoolRangeOpenGL poolRange;
   Vector3 pos;
   Vector3 scale;
+  bool isStatic;  //casts into the cached shadow layer, moving it redraws that layer
+
+  /*
+   * maxError is world space distance
+   */
+  int SelectLod(float maxError) const;
+  BoundingBox GetWorldBounds() const;
+};
+
+/*
+ * shadow pass program with its lightVP, depth only or writing moments
+ */
+struct ShadowProgram {
+  std::shared_ptr<ShaderProgramOpenGL> shader;
+  std::shared_ptr<ShaderUniformOpenGL> uniform;
+  UniformHandleOpenGL lightVPHandle;
+
+  void Delete();
+};
+
+/*
+ * object queued into a shadow layer
+ */
+struct ShadowCaster {
+  uint32_t index;
+  float depth;  //from the light, clip z in [0, 1]
+  int lod;
+};
+
+/*
+ * casters of one light gathered by the change test, drawn as is when the light gets its update
+ */
+struct ShadowCasterLists {
+  Matrix4x4 lightSpaceVP;
+  std::vector<ShadowCaster> staticCasters;
+  std::vector<ShadowCaster> dynamicCasters;
+  uint64_t staticKey;  //of the static layer
+  uint64_t key;        //of the whole tile
+};
+
+/*
+ * objects sharing mesh, submesh, shader and material. drawn with one instanced call
+ * per pass once it has minInstanceCount objects
+ */
+struct InstanceGroup {
+  std::vector<uint32_t> objects;
+  std::shared_ptr<ShaderProgramOpenGL> shader;    //instanced variant
+  std::shared_ptr<ShaderUniformOpenGL> material;  //of shader
+  //members that pass culling in the current pass
+  std::vector<uint32_t> visible;
+  float depth;
+  int lod;
+  GLintptr instanceOffset;  //matrices of the visible members in the ring buffer
+};
+
+/*
+ * counters of last Render
+ */
+struct PipelineStats {
+  int visibleObjects;
+  int culledObjects;
+  int shadowCasters;  //summed over lights
+  int culledShadowCasters;
+  int drawCalls;  //a multi draw counts once
+  int instancedObjects;  //summed over passes
+  int shadowTilesDrawn;  //atlas tiles redrawn, the others kept last frame's content
+  int staticShadowLayersDrawn;
+  int staleShadowTiles;  //changed but over the update budget
 };
 
 class ShadowPipeline {
  private:
   std::shared_ptr<GPUMeshOpenGL> _lightCube;
   std::shared_ptr<ShaderProgramOpenGL> _lightCubeShader;
-  std::shared_ptr<ShaderProgramOpenGL> _shadowShader;
-  std::shared_ptr<ShaderUniformOpenGL> _shadowShaderUniform;
+  ShadowProgram _shadowPrograms[2];  //index is 1 for moment maps
+  std::shared_ptr<ShaderProgramOpenGL> _shadowBlurShader;
+  std::shared_ptr<ShaderUniformOpenGL> _shadowBlurUniform;
+  UniformHandleOpenGL _shadowBlurAxisHandle;
+  UniformHandleOpenGL _shadowBlurTileHandle;
+
+  /*
+   * tile sizes from screen coverage of the shadowed region and each light's brightness at the camera,
+   * repacks the atlas when a size changes
+   */
+  void AllocateShadowTiles();
+  PerFrameStd140 _perFrame;
+  //each sized to its tiles, only VSM tiles pay for moments, blur target and mips
+  ShadowMap2DOpenGL _shadowAtlas;  //depth only
+  ShadowMap2DOpenGL _momentAtlas;
+  int _shadowAtlasSize = 0;  //0 without any tile
+  int _momentAtlasSize = 0;
+  bool _shadowAtlasCached = false;
+  //static casters only, same tiles as _shadowAtlas and _momentAtlas
+  ShadowMap2DOpenGL _staticShadowAtlas;
+  ShadowMap2DOpenGL _staticMomentAtlas;
+  std::vector<ShadowCasterLists> _shadowCasters;  //per light, capacity kept across frames
+  std::vector<std::pair<float, uint32_t>> _shadowUpdates;  //priority, light
+
+  /*
+   * casters of the light seen through lists.lightSpaceVP, and the keys of both layers
+   */
+  void CollectShadowCasters(const Light& light, ShadowCasterLists& lists);
+
+  /*
+   * queue and draw casters into the bound atlas tile
+   */
+  void DrawShadowCasters(const Light& light, int moments, const std::vector<ShadowCaster>& casters);
+  GPUBufferOpenGL _shadowKernel;
+  std::shared_ptr<SamplerOpenGL> _shadowCompareSampler;
+
+  //per frame and per draw data, written through the persistent mapping
+  std::shared_ptr<RingBufferOpenGL> _ring;
+  GLsizeiptr _uniformAlignment;
+  GLsizeiptr _storageAlignment;
+  GLsizeiptr _ringAlignment;  //frame regions are a multiple of both alignments
+  GLsizeiptr _objectBlockStride;  //ObjectStd430 rounded up to _uniformAlignment
+  RingAllocationOpenGL _objectBlocks;
+
+  /*
+   * grow the ring when a frame might not fit
+   */
+  void ReserveRing();
+  /*
+   * PerObject block of every object, and the multi draw array, filled on worker threads
+   */
+  void WriteObjectData();
+  RingAllocationOpenGL GetObjectBlock(uint32_t index) const;
 
   std::vector<Light> _lights;
   std::vector<GameObject> _objects;
+  std::vector<BoundingBox> _worldBounds;
+  std::vector<unsigned char> _visible;
+  std::vector<unsigned char> _casters;
+  std::vector<const void*> _programIds;
+  std::vector<const void*> _textureIds;
+  std::vector<const void*> _meshIds;
+  RenderQueue _queue;
+
+  //variants of blinn_phong.frag for the current lights
+  ShaderDefinesOpenGL _lightDefines;
+  uint64_t _lightConfigKey;  //everything GetLightDefines reads, hashed without allocating
+
+  uint64_t GetLightConfigKey() const;
+
+  const std::shared_ptr<ShaderProgramOpenGL>& GetVariant(ShaderVariantsOpenGL& variants, bool textured, bool octNormals) const;
+  void SelectVariant(GameObject& go);
+  void SelectVariant(InstanceGroup& group, const GameObject& first);
+  /*
+   * reselects every program when the light setup changed, compiling only unseen permutations
+   */
+  void UpdateVariants();
+
+  //multi draw path
+  std::shared_ptr<ShaderVariantsOpenGL> _multiDrawVariants;
+  //by NORMAL_OCT of the pool, null until a pool of that layout draws
+  std::shared_ptr<ShaderProgramOpenGL> _multiDrawShaders[2];
+  std::shared_ptr<ShaderUniformOpenGL> _multiDrawUniforms[2];
+  ShadowProgram _shadowMultiDrawPrograms[2];
+  std::vector<MeshPoolOpenGL> _meshPools;
+  std::vector<std::pair<const GPUMeshOpenGL*, int>> _pooledMeshes;
+  std::vector<MeshPoolRangeOpenGL> _pooledRanges;
+  std::vector<DrawElementsIndirectCommandOpenGL> _commands;
+  std::vector<uint32_t> _drawData;  //object, diffuse slot
+  const GPUTexture2DOpenGL* _diffuseSlots[MAX_DIFFUSE_COUNT];
+  int _diffuseSlotCount;
+
+  void AddToMeshPool(GameObject& go, const GPUMeshOpenGL& mesh);
+  void FlushMultiDraw(MeshPoolOpenGL& pool);
+  /*
+   * draws the pooled records of _queue with one multi draw per pool,
+   * the main pass starts a new one when the diffuse slots run out
+   */
+  void SubmitMultiDraw(bool mainPass, uint32_t pass);
+  void SetMultiDrawPass(const MeshPoolOpenGL& pool);
+
+  //instancing
+  std::shared_ptr<ShaderVariantsOpenGL> _instancedVariants;
+  ShadowProgram _shadowInstancedPrograms[2];
+  std::vector<InstanceGroup> _instanceGroups;
+
+  void AddToInstanceGroup(GameObject& go);
+  bool IsInstanced(const GameObject& go) const;
+  void AddInstance(const GameObject& go, uint32_t index, float depth, int lod);
+  /*
+   * upload the visible members of every group and queue one record per group
+   */
+  void PushInstanceGroups(uint32_t pass);
+  /*
+   * separable gaussian over the atlas tile of a VSM light, mipmaps are rebuilt after every light
+   */
+  void BlurMoments(const Light& light);
+  PipelineStats _stats;
 
  public:
-  int shadowWidth;
-  int shadowHeight;
+  int shadowAtlasSize = 4096;  //upper bound of both atlases, rounded down to a power of two
+  int maxShadowTile = 2048;
+  int minShadowTile = 256;
+  bool shadowCaching = true;  //static casters draw once into a second atlas, unchanged tiles are skipped
+  //changed tiles redrawn per frame, 0 is unlimited. the most important one is always redrawn
+  int maxShadowUpdates = 0;
+  int shadowTexelBudget = 0;
   Camera mainCamera;
+  float lodPixelError = 1.0f;  //allowed simplification error on screen
+  float shadowLodBias = 4.0f;  //shadow maps tolerate coarser lods
+  bool multiDrawIndirect = false;  //pooled meshes go through glMultiDrawElementsIndirect
+  int minInstanceCount = 2;        //smaller groups draw per object
+  int framesInFlight = 3;          //ring buffer regions, read by Init
 
   void Init();
   void Terminate();
 
-  void AddLight(const PointLight& light, bool hasShadow);
+  void AddLight(const PointLight& light, bool hasShadow, ShadowFilter filter = ShadowFilter::PCSS, int samples = 32);
+  /*
+   * shader is compiled per light setup and per textured or untextured material
+   */
   void AddObject(const std::shared_ptr<GPUMeshOpenGL>& ptr,
-                 const std::shared_ptr<Mine::ShaderProgramOpenGL>& shader,
+                 const std::shared_ptr<Mine::ShaderVariantsOpenGL>& shader,
                  const BlinnPhongMaterial& blinn,
                  const Vector3& pos,
-                 const Vector3& scale);
+                 const Vector3& scale,
+                 int subMesh = -1,
+                 bool isStatic = false);
   void Render();
+  /*
+   * LIGHT_COUNT, SHADOW_MODE_<i> and NUM_SAMPLES of the cheapest variant for the lights
+   */
+  ShaderDefinesOpenGL GetLightDefines() const;
   std::vector<Light>& GetLights();
+  /*
+   * index is the order of AddObject, shadow tiles of the object redraw on the next Render
+   */
+  void SetObjectTransform(size_t index, const Vector3& pos, const Vector3& scale);
+  const PipelineStats& GetStats() const;
 };
 
 }  // namespace Mine
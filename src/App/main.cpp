@@ -1,6 +1,8 @@
 #include <chrono>
 
 #include <OpenGLContext.h>
+#include <MeshCache.h>
+#include <ProgramCache.h>
 #include <Camera.h>
 #include <Input.h>
 #include <iostream>
@@ -17,52 +19,60 @@ std::shared_ptr<Mine::GPUMeshOpenGL> cubeBuffer;
 std::shared_ptr<Mine::GPUTexture2DOpenGL> cubeTexBuffer;
 
 //ying
-std::vector<std::shared_ptr<Mine::GPUMeshOpenGL>> yingBuffer;
+std::shared_ptr<Mine::GPUMeshOpenGL> yingBuffer;
 std::vector<std::shared_ptr<Mine::GPUTexture2DOpenGL>> yingTexBuffer;
 
 void loadYing() {
-  Mine::MultiMesh ying;
   std::vector<Mine::Texture2D> yingTex;
-  ying = Mine::LoadObjWithChildFromFile(std::filesystem::current_path() / "asset" / "ying" / "ying");
+  Mine::ObjLoadStats objStats;
+  Mine::ObjLoadDesc objDesc;
+  objDesc.stats = &objStats;
+  yingBuffer = Mine::CreateMultiMeshBufferCachedOpenGL(std::filesystem::current_path() / "asset" / "ying" / "ying",
+                                                       true,
+                                                       true,
+                                                       objDesc,
+                                                       Mine::VertexFormatDesc::Compact());
+  if (objStats.fileSize > 0) {
+    std::cout << "load ying.obj: " << objStats.fileSize << " bytes, " << objStats.parseSeconds * 1000 << " ms, "
+              << objStats.ThroughputMBps() << " MB/s\n";
+  } else {
+    std::cout << "load ying.obj: cooked\n";
+  }
   yingTex.emplace_back(Mine::Texture2D(std::filesystem::current_path() / "asset" / "ying" / "hair.png"));
   yingTex.emplace_back(Mine::Texture2D(std::filesystem::current_path() / "asset" / "ying" / "face.png"));
   yingTex.emplace_back(Mine::Texture2D(std::filesystem::current_path() / "asset" / "ying" / "expression.png"));
   yingTex.emplace_back(Mine::Texture2D(std::filesystem::current_path() / "asset" / "ying" / "cloth.png"));
-  Mine::Mesh me;
-  me.attrib = std::move(ying.attrib);
-  for (auto& m : ying.obj) {
-    me.face = m.second;
-    yingBuffer.emplace_back(std::move(Mine::CreateMeshBufferOpenGL(me)));
-  }
   for (const auto& t : yingTex) {
     yingTexBuffer.emplace_back(std::move(Mine::CreateTexture2DOpenGL(t)));
   }
 }
 
 void destroyYing() {
-  for (auto& t : yingBuffer) {
-    t->Delete();
-  }
+  yingBuffer->Delete();
   for (auto& t : yingTexBuffer) {
     t->Delete();
   }
 }
 
 void loadGrassCube() {
-  Mine::Mesh cube;
-  Mine::Mesh plane;
   Mine::Texture2D cubeTex2d;
-  cube = Mine::LoadObjFromFile(std::filesystem::current_path() / "asset" / "cube");
   cubeTex2d = Mine::Texture2D(std::filesystem::current_path() / "asset" / "cube.png");
-  cubeBuffer = Mine::CreateMeshBufferOpenGL(cube);
+  cubeBuffer = Mine::CreateMeshBufferCachedOpenGL(std::filesystem::current_path() / "asset" / "cube",
+                                                  true,
+                                                  true,
+                                                  Mine::ObjLoadDesc(),
+                                                  Mine::VertexFormatDesc::Compact());
   cubeTexBuffer = Mine::CreateTexture2DOpenGL(cubeTex2d);
-  plane = Mine::LoadObjFromFile(std::filesystem::current_path() / "asset" / "plane");
-  planeBuffer = Mine::CreateMeshBufferOpenGL(plane);
+  planeBuffer = Mine::CreateMeshBufferCachedOpenGL(std::filesystem::current_path() / "asset" / "plane",
+                                                   true,
+                                                   true,
+                                                   Mine::ObjLoadDesc(),
+                                                   Mine::VertexFormatDesc::Compact());
 }
 
-std::shared_ptr<Mine::ShaderProgramOpenGL> unlit;
+std::shared_ptr<Mine::ShaderVariantsOpenGL> unlit;
 void loadBlinnPhongShader() {
-  unlit = Mine::CreateShaderProgramOpenGL(std::filesystem::current_path() / "asset" / "blinn_phong");
+  unlit = Mine::CreateShaderVariantsOpenGL(std::filesystem::current_path() / "asset" / "blinn_phong");
 }
 
 void clear() {
@@ -93,7 +103,7 @@ void setupPipeline() {
   l.pos = Mine::Vector3(4, 6, 4);
   l.intensity = 1;
   l.color = Mine::Vector3(0, 0, 1);
-  pipeline.AddLight(l, true);
+  pipeline.AddLight(l, true, Mine::ShadowFilter::VSM);
 
   Mine::BlinnPhongMaterial b;
   // b.ka = Mine::Vector3(0.01f, 0.01f, 0.01f);
@@ -108,11 +118,11 @@ void setupPipeline() {
   b.ks = Mine::Vector3(0.5f, 0.5f, 0.5f);
   b.shininess = 2;
   b.diffuseTex = std::weak_ptr<Mine::GPUTexture2DOpenGL>();
-  pipeline.AddObject(planeBuffer, unlit, b, Mine::Vector3(0, 0, 0), Mine::Vector3(1, 1, 1));
+  pipeline.AddObject(planeBuffer, unlit, b, Mine::Vector3(0, 0, 0), Mine::Vector3(1, 1, 1), -1, true);
 
   for (int i = 0; i < 4; i++) {
     b.diffuseTex = std::weak_ptr<Mine::GPUTexture2DOpenGL>(yingTexBuffer[i]);
-    pipeline.AddObject(yingBuffer[i], unlit, b, Mine::Vector3(0, 0, 0), Mine::Vector3(3, 3, 3));
+    pipeline.AddObject(yingBuffer, unlit, b, Mine::Vector3(0, 0, 0), Mine::Vector3(3, 3, 3), i, true);
   }
 }
 
@@ -124,10 +134,18 @@ int main() {
   loadGrassCube();
   loadYing();
   loadBlinnPhongShader();
-  pipeline.shadowWidth = 2048;
-  pipeline.shadowHeight = 2048;
+  pipeline.shadowAtlasSize = 4096;
+  pipeline.maxShadowTile = 2048;
+  pipeline.shadowTexelBudget = 2048 * 2048;  //about one full tile a frame, the moving lights take turns
+  pipeline.multiDrawIndirect = GLAD_GL_VERSION_4_3 != 0;
   pipeline.Init();
   setupPipeline();
+  {
+    //cold start compiles every program, warm start loads binaries
+    const auto& programs = Mine::GetProgramCacheStats();
+    std::cout << "programs loaded " << programs.loaded << ", compiled " << programs.compiled
+              << ", rejected " << programs.rejected << " in " << programs.milliseconds << " ms\n";
+  }
 
   do {
     auto start = std::chrono::steady_clock::now();
@@ -141,6 +159,17 @@ int main() {
     auto end = std::chrono::steady_clock::now();
     auto delta = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
     deltaTime = delta.count();
+    if (allTime / 2000000 != (allTime + deltaTime) / 2000000) {
+      const auto& stats = pipeline.GetStats();
+      std::cout << "objects visible " << stats.visibleObjects << ", culled " << stats.culledObjects
+                << "; shadow casters " << stats.shadowCasters << ", culled " << stats.culledShadowCasters
+                << "; draw calls " << stats.drawCalls << ", instanced objects " << stats.instancedObjects
+                << "; shadow tiles drawn " << stats.shadowTilesDrawn << ", static layers " << stats.staticShadowLayersDrawn
+                << ", stale " << stats.staleShadowTiles << "\n";
+      const auto& gl = Mine::GetFrameStatsOpenGL();
+      std::cout << "uniform calls " << gl.uniformCalls << ", skipped " << gl.uniformSkipped
+                << "; state calls " << gl.stateCalls << ", skipped " << gl.stateSkipped << "\n";
+    }
     allTime += deltaTime;
     for (auto& l : pipeline.GetLights()) {
       auto x = std::sin(allTime * 0.00005f) * 0.02f;
@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Camera.h>
+#include <Frustum.h>
+#include <Mesh.h>
+#include <MeshOptimizer.h>
+#include <MeshSimplifier.h>
+#include <RenderQueue.h>
+
+/*
+ * CPU side benchmarks, no OpenGL context needed.
+ * usage: MineBench [name] [args...], no name runs all with generated data
+ */
+
+using BenchArgs = std::vector<std::string>;
+
+template <typename Func>
+static double Measure(int repeat, Func&& func) {
+  double best = 1e30;
+  for (int i = 0; i < repeat; i++) {
+    auto start = std::chrono::steady_clock::now();
+    func();
+    auto end = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+  }
+  return best;
+}
+
+/*
+ * n x n quads, uv seam every 16 columns, triangles shuffled like a converted model
+ */
+static Mine::Mesh MakeGridMesh(int n) {
+  Mine::Mesh m;
+  int row = n + 1;
+  int seams = n / 16 + 1;
+  for (int y = 0; y <= n; y++) {
+    for (int x = 0; x <= n; x++) {
+      m.attrib.vertices.emplace_back(Mine::Vector3((float)x, 0, (float)y));
+      m.attrib.normals.emplace_back(Mine::Vector3(0, 1, 0));
+      m.attrib.texcoords.emplace_back(Mine::Vector2(x / (float)n, y / (float)n));
+    }
+  }
+  for (int y = 0; y <= n; y++) {
+    for (int s = 0; s < seams; s++) {
+      m.attrib.texcoords.emplace_back(Mine::Vector2(1, y / (float)n));
+    }
+  }
+  auto texOf = [&](int x, int y, int cellX) {
+    if (x % 16 == 0 && x != cellX && x > 0) {  //right edge of a seam cell uses duplicated uv
+      return row * row + y * seams + x / 16;
+    }
+    return y * row + x;
+  };
+  for (int y = 0; y < n; y++) {
+    for (int x = 0; x < n; x++) {
+      int c[4][2] = {{x, y}, {x + 1, y}, {x + 1, y + 1}, {x, y + 1}};
+      int tri[2][3] = {{0, 1, 2}, {0, 2, 3}};
+      for (auto& t : tri) {
+        Mine::Face f;
+        for (int i = 0; i < 3; i++) {
+          int cx = c[t[i]][0];
+          int cy = c[t[i]][1];
+          f.verticeIdx[i] = cy * row + cx;
+          f.texcoordIdx[i] = texOf(cx, cy, x);
+          f.normalIdx[i] = cy * row + cx;
+        }
+        m.face.emplace_back(f);
+      }
+    }
+  }
+  std::shuffle(m.face.begin(), m.face.end(), std::mt19937(1234));
+  return m;
+}
+
+static Mine::Mesh LoadBenchMesh(const BenchArgs& args) {
+  if (args.empty()) {
+    return MakeGridMesh(708);  //1002528 triangles
+  }
+  return Mine::LoadObjFromFile(args[0]);
+}
+
+static void BenchWeld(const BenchArgs& args) {
+  auto mesh = LoadBenchMesh(args);
+  std::cout << "weld: " << mesh.face.size() << " faces\n";
+  struct Mode {
+    const char* name;
+    Mine::VertexWeldMode mode;
+  };
+  Mode modes[] = {{"std::map", Mine::VertexWeldMode::Tree},
+                  {"hash", Mine::VertexWeldMode::Hash},
+                  {"parallel hash", Mine::VertexWeldMode::ParallelHash}};
+  std::vector<unsigned int> refIndices;
+  std::vector<Mine::VertexKey> refVertices;
+  double refTime = 0;
+  for (const auto& m : modes) {
+    std::vector<unsigned int> indices;
+    std::vector<Mine::VertexKey> vertices;
+    double ms = Measure(3, [&]() {
+      Mine::WeldVertices(Mine::FaceArrayList{&mesh.face}, true, true, m.mode, indices, vertices);
+    });
+    bool same = true;
+    if (refIndices.empty()) {
+      refIndices = indices;
+      refVertices = vertices;
+      refTime = ms;
+    } else {
+      same = indices == refIndices &&
+             vertices.size() == refVertices.size() &&
+             memcmp(vertices.data(), refVertices.data(), vertices.size() * sizeof(Mine::VertexKey)) == 0;
+    }
+    std::cout << "  " << std::setw(14) << m.name << ": " << std::setw(9) << std::fixed << std::setprecision(2) << ms
+              << " ms, " << vertices.size() << " vertices, x" << std::setprecision(2) << refTime / ms
+              << (same ? "" : " MISMATCH") << "\n";
+  }
+}
+
+static void BenchVertexCache(const BenchArgs& args) {
+  auto mesh = LoadBenchMesh(args);
+  auto raw = Mine::CreateMeshDescOpenGL(mesh);
+  size_t vertexCount = raw.data.size() / raw.attribDesc[0].stride;
+  std::cout << "vcache: " << raw.indices.size() / 3 << " triangles, " << vertexCount << " vertices\n";
+  auto report = [&](const char* name, double ms, const Mine::GPUMeshDescOpenGL& desc) {
+    size_t count = desc.data.size() / desc.attribDesc[0].stride;
+    auto s = Mine::AnalyzeVertexCache(desc.indices.data(), desc.indices.size(), count);
+    std::cout << "  " << std::setw(14) << name << ": " << std::setw(9) << std::fixed << std::setprecision(2) << ms
+              << " ms, ACMR " << std::setprecision(3) << s.acmr << ", ATVR " << s.atvr << "\n";
+  };
+  report("raw", 0, raw);
+  struct Stage {
+    const char* name;
+    bool vertexCache;
+    bool overdraw;
+    bool vertexFetch;
+  };
+  Stage stages[] = {{"tipsify", true, false, false},
+                    {"+overdraw", true, true, false},
+                    {"+fetch", true, true, true}};
+  for (const auto& st : stages) {
+    Mine::MeshOptimizeDesc opt;
+    opt.vertexCache = st.vertexCache;
+    opt.overdraw = st.overdraw;
+    opt.vertexFetch = st.vertexFetch;
+    Mine::GPUMeshDescOpenGL desc;
+    double ms = Measure(3, [&]() {
+      desc = raw;
+      Mine::OptimizeMeshDescOpenGL(desc, opt);
+    });
+    report(st.name, ms, desc);
+  }
+}
+
+static void BenchLod(const BenchArgs& args) {
+  auto mesh = LoadBenchMesh(args);
+  auto source = Mine::CreateMeshDescOpenGL(mesh);
+  Mine::OptimizeMeshDescOpenGL(source);
+  Mine::GPUMeshDescOpenGL desc;
+  double ms = Measure(1, [&]() {
+    desc = source;
+    Mine::GenerateLodMeshDescOpenGL(desc);
+  });
+  std::cout << "lod: " << std::fixed << std::setprecision(2) << ms << " ms\n";
+  for (const auto& s : desc.subMeshes) {
+    std::cout << "  lod0: " << s.indexCount / 3 << " triangles\n";
+    for (size_t i = 0; i < s.lods.size(); i++) {
+      std::cout << "  lod" << i + 1 << ": " << s.lods[i].indexCount / 3 << " triangles, error "
+                << std::setprecision(5) << s.lods[i].error << "\n";
+    }
+  }
+}
+
+static void BenchCull(const BenchArgs& args) {
+  size_t count = args.empty() ? 1000000 : std::stoul(args[0]);
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> posDist(-60, 60);
+  std::uniform_real_distribution<float> sizeDist(0.1f, 2);
+  std::vector<Mine::BoundingBox> boxes(count);
+  for (auto& b : boxes) {
+    Mine::Vector3 c(posDist(rng), posDist(rng) * 0.2f, posDist(rng));
+    Mine::Vector3 e(sizeDist(rng), sizeDist(rng), sizeDist(rng));
+    b = Mine::BoundingBox(Mine::Sub(c, e), Mine::Add(c, e));
+  }
+  Mine::Camera camera;
+  auto frustum = camera.GetFrustum();
+  std::vector<unsigned char> visible(count);
+  size_t batched = 0;
+  double batchMs = Measure(5, [&]() { batched = Mine::CullBoundingBoxes(frustum, boxes.data(), count, visible.data()); });
+  size_t scalar = 0;
+  bool same = true;
+  double scalarMs = Measure(5, [&]() {
+    scalar = 0;
+    for (size_t i = 0; i < count; i++) {
+      bool v = Mine::Intersect(frustum, boxes[i]);
+      same = same && v == (visible[i] != 0);
+      scalar += v;
+    }
+  });
+  std::cout << "cull: " << count << " boxes, " << batched << " visible\n";
+  std::cout << "  " << std::setw(14) << "scalar" << ": " << std::setw(9) << std::fixed << std::setprecision(2) << scalarMs << " ms\n";
+  std::cout << "  " << std::setw(14) << "batched" << ": " << std::setw(9) << batchMs << " ms, x" << scalarMs / batchMs
+            << (same && scalar == batched ? "" : " MISMATCH") << "\n";
+}
+
+static void BenchSort(const BenchArgs& args) {
+  size_t count = args.empty() ? 100000 : std::stoul(args[0]);
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<uint32_t> idDist(0, 63);
+  std::uniform_real_distribution<float> depthDist(0, 1);
+  std::vector<uint64_t> keys(count);
+  for (auto& k : keys) {
+    k = Mine::MakeSortKey(Mine::SortKeyOrder::FrontToBack, idDist(rng) & 1, idDist(rng) & 7, idDist(rng), idDist(rng), depthDist(rng));
+  }
+  Mine::RenderQueue queue;
+  double radixMs = Measure(5, [&]() {
+    queue.Clear();
+    for (size_t i = 0; i < count; i++) {
+      queue.Push(keys[i], (uint32_t)i);
+    }
+    queue.Sort();
+  });
+  std::vector<Mine::DrawRecord> records(count);
+  double stdMs = Measure(5, [&]() {
+    for (size_t i = 0; i < count; i++) {
+      records[i] = Mine::DrawRecord{keys[i], (uint32_t)i, 0};
+    }
+    std::stable_sort(records.begin(), records.end(), [](const auto& a, const auto& b) { return a.key < b.key; });
+  });
+  bool same = std::equal(queue.begin(), queue.end(), records.begin(), [](const auto& a, const auto& b) { return a.index == b.index; });
+  std::cout << "sort: " << count << " draw records\n";
+  std::cout << "  " << std::setw(14) << "stable_sort" << ": " << std::setw(9) << std::fixed << std::setprecision(2) << stdMs << " ms\n";
+  std::cout << "  " << std::setw(14) << "radix" << ": " << std::setw(9) << radixMs << " ms, x" << stdMs / radixMs
+            << (same ? "" : " MISMATCH") << "\n";
+}
+
+struct Benchmark {
+  const char* name;
+  std::function<void(const BenchArgs&)> run;
+};
+
+int main(int argc, char** argv) {
+  std::vector<Benchmark> benches = {
+      {"weld", BenchWeld},
+      {"vcache", BenchVertexCache},
+      {"lod", BenchLod},
+      {"cull", BenchCull},
+      {"sort", BenchSort},
+  };
+  if (argc < 2) {
+    for (const auto& b : benches) {
+      b.run(BenchArgs());
+    }
+    return 0;
+  }
+  BenchArgs args(argv + 2, argv + argc);
+  for (const auto& b : benches) {
+    if (b.name == std::string(argv[1])) {
+      b.run(args);
+      return 0;
+    }
+  }
+  std::cout << "unknown benchmark " << argv[1] << "\n";
+  return 1;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Frustum.h"
 #include "MathExt.h"
 
 namespace Mine {
@@ -25,6 +26,7 @@ struct Camera {
     return PerspectiveRH(fov, aspect, zNear, zFar);
     // return Mine::OrthoRH(-10, 10, -10, 10, 0.1f, 100);
   }
+  inline Frustum GetFrustum() const { return ExtractFrustum(Mul(Projection(), View())); }
 };
 
 /*
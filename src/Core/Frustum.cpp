@@ -0,0 +1,94 @@
+#include "Frustum.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define MINE_FRUSTUM_SSE
+#endif
+
+using namespace Mine;
+
+static Vector4 _NormalizePlane(float a, float b, float c, float d) {
+  float len = std::sqrt(a * a + b * b + c * c);
+  return Vector4(a / len, b / len, c / len, d / len);
+}
+
+Frustum Mine::ExtractFrustum(const Matrix4x4& m) {
+  Frustum f;
+  f.planes[0] = _NormalizePlane(m.m41 + m.m11, m.m42 + m.m12, m.m43 + m.m13, m.m44 + m.m14);
+  f.planes[1] = _NormalizePlane(m.m41 - m.m11, m.m42 - m.m12, m.m43 - m.m13, m.m44 - m.m14);
+  f.planes[2] = _NormalizePlane(m.m41 + m.m21, m.m42 + m.m22, m.m43 + m.m23, m.m44 + m.m24);
+  f.planes[3] = _NormalizePlane(m.m41 - m.m21, m.m42 - m.m22, m.m43 - m.m23, m.m44 - m.m24);
+  f.planes[4] = _NormalizePlane(m.m41 + m.m31, m.m42 + m.m32, m.m43 + m.m33, m.m44 + m.m34);
+  f.planes[5] = _NormalizePlane(m.m41 - m.m31, m.m42 - m.m32, m.m43 - m.m33, m.m44 - m.m34);
+  return f;
+}
+
+bool Mine::Intersect(const Frustum& frustum, const BoundingBox& box) {
+  auto c = box.Center();
+  auto e = box.Extent();
+  for (const auto& p : frustum.planes) {
+    float d = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+    float r = std::abs(p.x) * e.x + std::abs(p.y) * e.y + std::abs(p.z) * e.z;
+    if (d + r < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Mine::Intersect(const Frustum& frustum, const BoundingSphere& sphere) {
+  const auto& c = sphere.center;
+  for (const auto& p : frustum.planes) {
+    if (p.x * c.x + p.y * c.y + p.z * c.z + p.w < -sphere.radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t Mine::CullBoundingBoxes(const Frustum& frustum, const BoundingBox* boxes, size_t count, unsigned char* visible) {
+  size_t result = 0;
+  size_t i = 0;
+#ifdef MINE_FRUSTUM_SSE
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 signMask = _mm_set1_ps(-0.0f);
+  for (; i + 4 <= count; i += 4) {
+    //AoS min/max to SoA center/extent
+    const BoundingBox* b = boxes + i;
+    __m128 minX = _mm_setr_ps(b[0].min.x, b[1].min.x, b[2].min.x, b[3].min.x);
+    __m128 minY = _mm_setr_ps(b[0].min.y, b[1].min.y, b[2].min.y, b[3].min.y);
+    __m128 minZ = _mm_setr_ps(b[0].min.z, b[1].min.z, b[2].min.z, b[3].min.z);
+    __m128 maxX = _mm_setr_ps(b[0].max.x, b[1].max.x, b[2].max.x, b[3].max.x);
+    __m128 maxY = _mm_setr_ps(b[0].max.y, b[1].max.y, b[2].max.y, b[3].max.y);
+    __m128 maxZ = _mm_setr_ps(b[0].max.z, b[1].max.z, b[2].max.z, b[3].max.z);
+    __m128 cx = _mm_mul_ps(_mm_add_ps(minX, maxX), half);
+    __m128 cy = _mm_mul_ps(_mm_add_ps(minY, maxY), half);
+    __m128 cz = _mm_mul_ps(_mm_add_ps(minZ, maxZ), half);
+    __m128 ex = _mm_mul_ps(_mm_sub_ps(maxX, minX), half);
+    __m128 ey = _mm_mul_ps(_mm_sub_ps(maxY, minY), half);
+    __m128 ez = _mm_mul_ps(_mm_sub_ps(maxZ, minZ), half);
+    __m128 outside = _mm_setzero_ps();
+    for (const auto& p : frustum.planes) {
+      __m128 px = _mm_set1_ps(p.x);
+      __m128 py = _mm_set1_ps(p.y);
+      __m128 pz = _mm_set1_ps(p.z);
+      __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)),
+                            _mm_add_ps(_mm_mul_ps(pz, cz), _mm_set1_ps(p.w)));
+      __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, px), ex),
+                                       _mm_mul_ps(_mm_andnot_ps(signMask, py), ey)),
+                            _mm_mul_ps(_mm_andnot_ps(signMask, pz), ez));
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+    }
+    int mask = _mm_movemask_ps(outside);
+    for (int k = 0; k < 4; k++) {
+      visible[i + k] = (mask >> k & 1) == 0;
+      result += visible[i + k];
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    visible[i] = Intersect(frustum, boxes[i]);
+    result += visible[i];
+  }
+  return result;
+}
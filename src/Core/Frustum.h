@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+#include "MathExt.h"
+
+namespace Mine {
+
+/*
+ * planes point inward, xyz is unit normal, dot(xyz, p) + w >= 0 is inside
+ */
+struct Frustum {
+  Vector4 planes[6];  //left right bottom top near far
+};
+
+/*
+ * Gribb & Hartmann, clip space z in [-1, 1].
+ * viewProj gives world space planes, mvp gives object space planes
+ */
+Frustum ExtractFrustum(const Matrix4x4& viewProj);
+
+bool Intersect(const Frustum& frustum, const BoundingBox& box);
+bool Intersect(const Frustum& frustum, const BoundingSphere& sphere);
+
+/*
+ * 4 boxes per step with SSE, visible[i] is 1 if box i may intersect frustum.
+ * returns visible count
+ */
+size_t CullBoundingBoxes(const Frustum& frustum, const BoundingBox* boxes, size_t count, unsigned char* visible);
+
+}  // namespace Mine
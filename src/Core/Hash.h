@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Mine {
+
+constexpr uint64_t HashMix64(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+/*
+ * 8 bytes per step, good enough to detect changed content.
+ * not a cryptographic hash
+ */
+inline uint64_t Hash64(const void* data, size_t size, uint64_t seed = 0) {
+  constexpr uint64_t prime = 0x9e3779b97f4a7c15ull;
+  auto p = (const unsigned char*)data;
+  uint64_t h = seed ^ (size * prime);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t w;
+    memcpy(&w, p + i, 8);
+    h = (h ^ HashMix64(w)) * prime;
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, p + i, size - i);
+  h = (h ^ HashMix64(tail)) * prime;
+  return HashMix64(h);
+}
+
+}  // namespace Mine
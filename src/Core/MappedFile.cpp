@@ -0,0 +1,159 @@
+#include "MappedFile.h"
+
+using namespace Mine;
+
+#ifdef MINE_PLATFORM_WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+
+MappedFile::MappedFile() : _data(nullptr), _size(0), _file(nullptr), _mapping(nullptr) {}
+
+MappedFile::MappedFile(const std::filesystem::path& path) : MappedFile() {
+  HANDLE file = CreateFileW(path.c_str(),
+                            GENERIC_READ,
+                            FILE_SHARE_READ,
+                            nullptr,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return;
+  }
+  _file = file;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    Close();
+    return;
+  }
+  _size = (size_t)size.QuadPart;
+  if (_size == 0) {  //can't map empty file
+    return;
+  }
+  _mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (_mapping == nullptr) {
+    Close();
+    return;
+  }
+  _data = (const char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+  if (_data == nullptr) {
+    Close();
+  }
+}
+
+MappedFile::MappedFile(MappedFile&& o) noexcept {
+  _data = o._data;
+  _size = o._size;
+  _file = o._file;
+  _mapping = o._mapping;
+  o._data = nullptr;
+  o._size = 0;
+  o._file = nullptr;
+  o._mapping = nullptr;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& o) noexcept {
+  Close();
+  _data = o._data;
+  _size = o._size;
+  _file = o._file;
+  _mapping = o._mapping;
+  o._data = nullptr;
+  o._size = 0;
+  o._file = nullptr;
+  o._mapping = nullptr;
+  return *this;
+}
+
+bool MappedFile::IsOpen() const { return _file != nullptr; }
+
+void MappedFile::Close() {
+  if (_data != nullptr) {
+    UnmapViewOfFile(_data);
+  }
+  if (_mapping != nullptr) {
+    CloseHandle(_mapping);
+  }
+  if (_file != nullptr) {
+    CloseHandle(_file);
+  }
+  _data = nullptr;
+  _size = 0;
+  _file = nullptr;
+  _mapping = nullptr;
+}
+
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile() : _data(nullptr), _size(0), _fd(-1) {}
+
+MappedFile::MappedFile(const std::filesystem::path& path) : MappedFile() {
+  _fd = open(path.c_str(), O_RDONLY);
+  if (_fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(_fd, &st) != 0) {
+    Close();
+    return;
+  }
+  _size = (size_t)st.st_size;
+  if (_size == 0) {
+    return;
+  }
+  void* ptr = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+  if (ptr == MAP_FAILED) {
+    Close();
+    return;
+  }
+  madvise(ptr, _size, MADV_SEQUENTIAL);
+  _data = (const char*)ptr;
+}
+
+MappedFile::MappedFile(MappedFile&& o) noexcept {
+  _data = o._data;
+  _size = o._size;
+  _fd = o._fd;
+  o._data = nullptr;
+  o._size = 0;
+  o._fd = -1;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& o) noexcept {
+  Close();
+  _data = o._data;
+  _size = o._size;
+  _fd = o._fd;
+  o._data = nullptr;
+  o._size = 0;
+  o._fd = -1;
+  return *this;
+}
+
+bool MappedFile::IsOpen() const { return _fd >= 0; }
+
+void MappedFile::Close() {
+  if (_data != nullptr) {
+    munmap((void*)_data, _size);
+  }
+  if (_fd >= 0) {
+    close(_fd);
+  }
+  _data = nullptr;
+  _size = 0;
+  _fd = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+  Close();
+}
\ No newline at end of file
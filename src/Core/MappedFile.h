@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+namespace Mine {
+
+/*
+ * read-only view of a whole file through the OS page cache.
+ * no copy into user memory, the data lives as long as the object does
+ */
+class MappedFile {
+ private:
+  const char* _data;
+  size_t _size;
+#ifdef MINE_PLATFORM_WIN32
+  void* _file;
+  void* _mapping;
+#else
+  int _fd;
+#endif
+
+ public:
+  MappedFile();
+  MappedFile(const std::filesystem::path& path);
+  MappedFile(const MappedFile&) = delete;
+  MappedFile(MappedFile&& o) noexcept;
+  ~MappedFile();
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile& operator=(MappedFile&& o) noexcept;
+  bool IsOpen() const;
+  void Close();
+  constexpr const char* GetData() const { return _data; }
+  constexpr size_t GetSize() const { return _size; }
+};
+
+}  // namespace Mine
\ No newline at end of file
@@ -147,10 +147,10 @@ constexpr Matrix4x4 Mul(const Matrix4x4& a, const Matrix4x4& b) {
 }
 
 constexpr Vector4 Mul(const Matrix4x4& a, const Vector4& b) {
-  return Vector4(a.m11 * b.x + a.m12 * b.x + a.m13 * b.x + a.m14 * b.x,
-                 a.m21 * b.y + a.m22 * b.y + a.m23 * b.y + a.m24 * b.y,
-                 a.m31 * b.z + a.m32 * b.z + a.m33 * b.z + a.m34 * b.z,
-                 a.m41 * b.w + a.m42 * b.w + a.m43 * b.w + a.m44 * b.w);
+  return Vector4(a.m11 * b.x + a.m12 * b.y + a.m13 * b.z + a.m14 * b.w,
+                 a.m21 * b.x + a.m22 * b.y + a.m23 * b.z + a.m24 * b.w,
+                 a.m31 * b.x + a.m32 * b.y + a.m33 * b.z + a.m34 * b.w,
+                 a.m41 * b.x + a.m42 * b.y + a.m43 * b.z + a.m44 * b.w);
 }
 
 constexpr Matrix4x4 LookAtRH(const Vector3& eyePos, const Vector3& target, const Vector3& up) {
@@ -225,4 +225,40 @@ constexpr Matrix4x4 Scale(const Matrix4x4& m, const Vector3& scale) {
   return Mul(m, Scale(scale));
 }
 
+struct BoundingBox {
+  Vector3 min;
+  Vector3 max;
+  constexpr BoundingBox() : min(), max() {}
+  constexpr BoundingBox(const Vector3& min, const Vector3& max) : min(min), max(max) {}
+  constexpr Vector3 Center() const { return Mul(Add(min, max), 0.5f); }
+  constexpr Vector3 Extent() const { return Mul(Sub(max, min), 0.5f); }
+};
+
+struct BoundingSphere {
+  Vector3 center;
+  float radius;
+  constexpr BoundingSphere() : center(), radius(0) {}
+  constexpr BoundingSphere(const Vector3& center, float radius) : center(center), radius(radius) {}
+};
+
+inline BoundingBox Merge(const BoundingBox& a, const BoundingBox& b) {
+  return BoundingBox(Vector3(std::fmin(a.min.x, b.min.x), std::fmin(a.min.y, b.min.y), std::fmin(a.min.z, b.min.z)),
+                     Vector3(std::fmax(a.max.x, b.max.x), std::fmax(a.max.y, b.max.y), std::fmax(a.max.z, b.max.z)));
+}
+
+/*
+ * box of the transformed box (Arvo 1990)
+ */
+inline BoundingBox Transform(const Matrix4x4& m, const BoundingBox& box) {
+  auto c = box.Center();
+  auto e = box.Extent();
+  Vector3 center(m.m11 * c.x + m.m12 * c.y + m.m13 * c.z + m.m14,
+                 m.m21 * c.x + m.m22 * c.y + m.m23 * c.z + m.m24,
+                 m.m31 * c.x + m.m32 * c.y + m.m33 * c.z + m.m34);
+  Vector3 extent(std::abs(m.m11) * e.x + std::abs(m.m12) * e.y + std::abs(m.m13) * e.z,
+                 std::abs(m.m21) * e.x + std::abs(m.m22) * e.y + std::abs(m.m23) * e.z,
+                 std::abs(m.m31) * e.x + std::abs(m.m32) * e.y + std::abs(m.m33) * e.z);
+  return BoundingBox(Sub(center, extent), Add(center, extent));
+}
+
 }  // namespace Mine
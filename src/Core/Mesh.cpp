@@ -1,136 +1,793 @@
 #include "Mesh.h"
 
-#include <fstream>
 #include <string>
+#include <string_view>
 #include <cstring>
-#include <cassert>
+#include <cstdlib>
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+#include <map>
+
+#include "Hash.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
 
 using namespace Mine;
 
-static void _ParseObj(const char* line,
-                      std::vector<Vector3>& pos,
-                      std::vector<Vector2>& tex,
-                      std::vector<Vector3>& nor,
-                      std::vector<Face>& fac) {
-  if (line[0] == '#') {
-    return;
+/*
+ * .obj is scanned in place from a memory mapped file.
+ * no std::string per line, no sscanf, every record is tokenized by hand
+ */
+
+static inline bool _IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+static inline bool _IsDigit(char c) { return (unsigned)(c - '0') < 10; }
+
+static inline const char* _SkipSpace(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t')) {
+    p++;
+  }
+  return p;
+}
+
+static inline const char* _SkipToken(const char* p, const char* end) {
+  while (p < end && !_IsSpace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+static inline const char* _ParseInt(const char* p, const char* end, int& out) {
+  bool neg = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    neg = *p == '-';
+    p++;
+  }
+  int v = 0;
+  while (p < end && _IsDigit(*p)) {
+    v = v * 10 + (*p - '0');
+    p++;
+  }
+  out = neg ? -v : v;
+  return p;
+}
+
+static const double __pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static const char* _ParseFloatSlow(const char* p, const char* end, float& out) {
+  char buf[64];
+  auto len = (size_t)(_SkipToken(p, end) - p);
+  len = len < sizeof(buf) - 1 ? len : sizeof(buf) - 1;
+  memcpy(buf, p, len);
+  buf[len] = '\0';
+  char* stop;
+  out = strtof(buf, &stop);
+  return p + (stop - buf);
+}
+
+/*
+ * mantissa fits in 53 bits and power of ten is exact in double,
+ * so one multiply or divide gives the correct result (Clinger's fast path).
+ * anything else (long mantissa, huge exponent, inf, nan) falls back to strtof
+ */
+static const char* _ParseFloat(const char* p, const char* end, float& out) {
+  p = _SkipSpace(p, end);
+  const char* start = p;
+  bool neg = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    neg = *p == '-';
+    p++;
+  }
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exp10 = 0;
+  bool any = false;
+  while (p < end && _IsDigit(*p)) {
+    any = true;
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += mantissa != 0;
+    } else {
+      exp10++;
+    }
+    p++;
   }
-  if (strncmp(line, "v ", 2) == 0) {  //position
+  if (p < end && *p == '.') {
+    p++;
+    while (p < end && _IsDigit(*p)) {
+      any = true;
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += mantissa != 0;
+        exp10--;
+      }
+      p++;
+    }
+  }
+  if (!any) {
+    return _ParseFloatSlow(start, end, out);
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    int e;
+    p = _ParseInt(p + 1, end, e);
+    exp10 += e;
+  }
+  if (mantissa > (1ull << 53) || exp10 < -22 || exp10 > 22) {
+    return _ParseFloatSlow(start, end, out);
+  }
+  double v = (double)mantissa;
+  v = exp10 < 0 ? v / __pow10[-exp10] : v * __pow10[exp10];
+  out = (float)(neg ? -v : v);
+  return p;
+}
+
+static inline int _ResolveIndex(int idx, int count) {
+  //1-based, negative value is relative to the end of current list
+  return idx > 0 ? idx - 1 : (idx < 0 ? count + idx : -1);
+}
+
+static size_t _CountFaceCorners(const char* p, const char* end) {
+  size_t n = 0;
+  while (true) {
+    p = _SkipSpace(p, end);
+    if (p >= end || *p == '\r') {
+      break;
+    }
+    p = _SkipToken(p, end);
+    n++;
+  }
+  return n;
+}
+
+/*
+ * v/t/n, v//n, v/t or v.polygon is split into triangle fan
+ */
+template <typename Func>
+static void _ForEachFaceTriangle(const char* p, const char* end, int posCount, int texCount, int norCount, Func&& func) {
+  Face f;
+  int first[3];
+  int prev[3];
+  int n = 0;
+  while (true) {
+    p = _SkipSpace(p, end);
+    if (p >= end || *p == '\r') {
+      break;
+    }
+    int raw[3] = {0, 0, 0};
+    p = _ParseInt(p, end, raw[0]);
+    if (p < end && *p == '/') {
+      p++;
+      if (p < end && *p != '/') {
+        p = _ParseInt(p, end, raw[1]);
+      }
+      if (p < end && *p == '/') {
+        p = _ParseInt(p + 1, end, raw[2]);
+      }
+    }
+    p = _SkipToken(p, end);
+    int cur[3] = {_ResolveIndex(raw[0], posCount),
+                  _ResolveIndex(raw[1], texCount),
+                  _ResolveIndex(raw[2], norCount)};
+    if (n == 0) {
+      memcpy(first, cur, sizeof(cur));
+    } else if (n >= 2) {
+      f.verticeIdx[0] = first[0];
+      f.texcoordIdx[0] = first[1];
+      f.normalIdx[0] = first[2];
+      f.verticeIdx[1] = prev[0];
+      f.texcoordIdx[1] = prev[1];
+      f.normalIdx[1] = prev[2];
+      f.verticeIdx[2] = cur[0];
+      f.texcoordIdx[2] = cur[1];
+      f.normalIdx[2] = cur[2];
+      func(f);
+    }
+    memcpy(prev, cur, sizeof(cur));
+    n++;
+  }
+}
+
+template <typename Sink>
+static void _ScanObj(const char* p, const char* end, Sink& sink) {
+  while (p < end) {
+    auto lineEnd = (const char*)memchr(p, '\n', end - p);
+    if (lineEnd == nullptr) {
+      lineEnd = end;
+    }
+    const char* next = lineEnd == end ? end : lineEnd + 1;
+    if (lineEnd > p && lineEnd[-1] == '\r') {
+      lineEnd--;
+    }
+    const char* s = _SkipSpace(p, lineEnd);
+    auto len = lineEnd - s;
+    if (len >= 2) {
+      if (s[0] == 'v') {
+        if (_IsSpace(s[1])) {  //position
+          sink.OnPosition(s + 2, lineEnd);
+        } else if (len >= 3 && s[1] == 't' && _IsSpace(s[2])) {  //texcoord
+          sink.OnTexcoord(s + 3, lineEnd);
+        } else if (len >= 3 && s[1] == 'n' && _IsSpace(s[2])) {  //normal
+          sink.OnNormal(s + 3, lineEnd);
+        }
+      } else if (s[0] == 'f' && _IsSpace(s[1])) {  //face
+        sink.OnFace(s + 2, lineEnd);
+      } else if (len >= 7 && memcmp(s, "usemtl", 6) == 0 && _IsSpace(s[6])) {
+        const char* name = _SkipSpace(s + 7, lineEnd);
+        sink.OnMaterial(std::string_view(name, _SkipToken(name, lineEnd) - name));
+      }
+    }
+    p = next;
+  }
+}
+
+/*
+ * faces between two usemtl.first segment of a file has no name
+ */
+struct _ObjSegment {
+  std::string_view name;
+  bool hasName;
+  size_t faceCount;
+};
+
+struct _ObjCounter {
+  size_t posCount;
+  size_t texCount;
+  size_t norCount;
+  std::vector<_ObjSegment> segments;
+
+  _ObjCounter() : posCount(0), texCount(0), norCount(0) {
+    segments.emplace_back(_ObjSegment{std::string_view(), false, 0});
+  }
+  void OnPosition(const char*, const char*) { posCount++; }
+  void OnTexcoord(const char*, const char*) { texCount++; }
+  void OnNormal(const char*, const char*) { norCount++; }
+  void OnFace(const char* p, const char* end) {
+    size_t corners = _CountFaceCorners(p, end);
+    if (corners > 2) {
+      segments.back().faceCount += corners - 2;
+    }
+  }
+  void OnMaterial(std::string_view name) { segments.emplace_back(_ObjSegment{name, true, 0}); }
+  size_t FaceCount() const {
+    size_t n = 0;
+    for (const auto& s : segments) {
+      n += s.faceCount;
+    }
+    return n;
+  }
+};
+
+/*
+ * a piece of file split at line boundary.
+ * bases are prefix sums of the counts of all chunks before it
+ */
+struct _ObjChunk {
+  const char* begin;
+  const char* end;
+  _ObjCounter counter;
+  size_t posBase;
+  size_t texBase;
+  size_t norBase;
+  size_t faceBase;
+  size_t segmentBase;
+};
+
+/*
+ * write into arrays already sized by _ObjCounter
+ */
+struct _ObjWriter {
+  Vector3* pos;
+  Vector2* tex;
+  Vector3* nor;
+  Face* face;
+  int posCount;
+  int texCount;
+  int norCount;
+  Face* const* slices;  //face destination of each segment, null for Mesh
+  size_t slice;
+
+  _ObjWriter(VertexAttrib& attrib, const _ObjChunk& chunk, Face* face, Face* const* slices)
+      : pos(attrib.vertices.data() + chunk.posBase),
+        tex(attrib.texcoords.data() + chunk.texBase),
+        nor(attrib.normals.data() + chunk.norBase),
+        face(face),
+        posCount((int)chunk.posBase),
+        texCount((int)chunk.texBase),
+        norCount((int)chunk.norBase),
+        slices(slices),
+        slice(0) {}
+  void OnPosition(const char* p, const char* end) {
     Vector3 v;
-    int cnt = sscanf(line, "v %f %f %f", &v.x, &v.y, &v.z);
-    assert(cnt == 3);
-    pos.emplace_back(v);
-  } else if (strncmp(line, "vt ", 3) == 0) {  //texcoord
+    p = _ParseFloat(p, end, v.x);
+    p = _ParseFloat(p, end, v.y);
+    p = _ParseFloat(p, end, v.z);
+    *pos++ = v;
+    posCount++;
+  }
+  void OnTexcoord(const char* p, const char* end) {
     Vector2 vt;
-    int cnt = sscanf(line, "vt %f %f", &vt.x, &vt.y);
-    assert(cnt == 2);
-    tex.emplace_back(vt);
-  } else if (strncmp(line, "vn ", 3) == 0) {  //normal
+    p = _ParseFloat(p, end, vt.x);
+    p = _ParseFloat(p, end, vt.y);
+    *tex++ = vt;
+    texCount++;
+  }
+  void OnNormal(const char* p, const char* end) {
     Vector3 vn;
-    int cnt = sscanf(line, "vn %f %f %f", &vn.x, &vn.y, &vn.z);
-    assert(cnt == 3);
-    nor.emplace_back(vn);
-  } else if (strncmp(line, "f ", 2) == 0) {  //face
-    Face f;
-    int cnt = sscanf(line, "f %d/%d/%d %d/%d/%d %d/%d/%d",
-                     &f.verticeIdx[0], &f.texcoordIdx[0], &f.normalIdx[0],
-                     &f.verticeIdx[1], &f.texcoordIdx[1], &f.normalIdx[1],
-                     &f.verticeIdx[2], &f.texcoordIdx[2], &f.normalIdx[2]);
-    assert(cnt == 9);
-    for (auto& v : f.verticeIdx) {
-      v -= 1;
+    p = _ParseFloat(p, end, vn.x);
+    p = _ParseFloat(p, end, vn.y);
+    p = _ParseFloat(p, end, vn.z);
+    *nor++ = vn;
+    norCount++;
+  }
+  void OnFace(const char* p, const char* end) {
+    _ForEachFaceTriangle(p, end, posCount, texCount, norCount, [this](const Face& f) { *face++ = f; });
+  }
+  void OnMaterial(std::string_view) {
+    if (slices != nullptr) {
+      face = slices[++slice];
     }
-    for (auto& t : f.texcoordIdx) {
-      t -= 1;
+  }
+};
+
+/*
+ * no pre-pass, arrays grow while scanning
+ */
+struct _ObjAppender {
+  VertexAttrib& attrib;
+  MultiMesh::ObjArray* groups;  //null for Mesh
+  MultiMesh::FaceArray faces;
+  std::string name;
+
+  _ObjAppender(VertexAttrib& attrib, MultiMesh::ObjArray* groups) : attrib(attrib), groups(groups) {}
+  void OnPosition(const char* p, const char* end) {
+    Vector3 v;
+    p = _ParseFloat(p, end, v.x);
+    p = _ParseFloat(p, end, v.y);
+    p = _ParseFloat(p, end, v.z);
+    attrib.vertices.emplace_back(v);
+  }
+  void OnTexcoord(const char* p, const char* end) {
+    Vector2 vt;
+    p = _ParseFloat(p, end, vt.x);
+    p = _ParseFloat(p, end, vt.y);
+    attrib.texcoords.emplace_back(vt);
+  }
+  void OnNormal(const char* p, const char* end) {
+    Vector3 vn;
+    p = _ParseFloat(p, end, vn.x);
+    p = _ParseFloat(p, end, vn.y);
+    p = _ParseFloat(p, end, vn.z);
+    attrib.normals.emplace_back(vn);
+  }
+  void OnFace(const char* p, const char* end) {
+    _ForEachFaceTriangle(p, end,
+                         (int)attrib.vertices.size(),
+                         (int)attrib.texcoords.size(),
+                         (int)attrib.normals.size(),
+                         [this](const Face& f) { faces.emplace_back(f); });
+  }
+  void OnMaterial(std::string_view n) {
+    if (groups == nullptr) {
+      return;
     }
-    for (auto& n : f.normalIdx) {
-      n -= 1;
+    Flush();
+    name = std::string(n);
+  }
+  void Flush() {
+    if (!faces.empty()) {
+      faces.shrink_to_fit();
+      groups->emplace_back(std::make_pair(std::move(name), std::move(faces)));
+      faces = MultiMesh::FaceArray();
     }
-    fac.emplace_back(f);
   }
-}
+  void Finish() {
+    attrib.vertices.shrink_to_fit();
+    attrib.texcoords.shrink_to_fit();
+    attrib.normals.shrink_to_fit();
+    if (groups != nullptr) {
+      Flush();
+      groups->shrink_to_fit();
+    }
+  }
+};
 
-Mesh Mine::LoadObjFromFile(const std::filesystem::path& p) {
-  std::ifstream fs(p.generic_u8string() + ".obj", std::ios::in);
-  if (!fs.is_open()) {
-    throw "can't load obj";
+constexpr size_t MIN_OBJ_CHUNK_SIZE = 1 << 20;
+
+static std::vector<_ObjChunk> _SplitObj(const char* begin, const char* end, int threadCount) {
+  auto size = (size_t)(end - begin);
+  size_t n = threadCount > 0 ? (size_t)threadCount : ThreadPool::GetInstance().GetThreadCount();
+  n = std::min(n, size / MIN_OBJ_CHUNK_SIZE);
+  n = std::max(n, (size_t)1);
+  std::vector<_ObjChunk> chunks(n);
+  const char* p = begin;
+  for (size_t i = 0; i < n; i++) {
+    const char* e = i + 1 == n ? end : std::max(p, begin + size / n * (i + 1));
+    if (e < end) {
+      auto nl = (const char*)memchr(e, '\n', end - e);
+      e = nl == nullptr ? end : nl + 1;
+    }
+    chunks[i].begin = p;
+    chunks[i].end = e;
+    p = e;
   }
+  return chunks;
+}
+
+template <typename Func>
+static void _ForEachObjChunk(std::vector<_ObjChunk>& chunks, Func&& func) {
+  ThreadPool::GetInstance().ParallelFor(chunks.size(), [&](size_t i) { func(chunks[i]); });
+}
 
-  std::vector<Vector3> pos;
-  std::vector<Vector2> tex;
-  std::vector<Vector3> nor;
-  std::vector<Face> fac;
+/*
+ * count every chunk in parallel, then prefix sum to find where each chunk writes.
+ * segments of all chunks are joined in file order, the first segment of
+ * a chunk has no name so it continues the group of the chunk before
+ */
+static std::vector<_ObjSegment> _CountObjChunks(std::vector<_ObjChunk>& chunks, VertexAttrib& attrib, size_t& faceCount) {
+  _ForEachObjChunk(chunks, [](_ObjChunk& c) { _ScanObj(c.begin, c.end, c.counter); });
+  size_t pos = 0, tex = 0, nor = 0, face = 0;
+  std::vector<_ObjSegment> segments;
+  for (auto& c : chunks) {
+    c.posBase = pos;
+    c.texBase = tex;
+    c.norBase = nor;
+    c.faceBase = face;
+    c.segmentBase = segments.size();
+    pos += c.counter.posCount;
+    tex += c.counter.texCount;
+    nor += c.counter.norCount;
+    face += c.counter.FaceCount();
+    segments.insert(segments.end(), c.counter.segments.begin(), c.counter.segments.end());
+  }
+  attrib.vertices.resize(pos);
+  attrib.texcoords.resize(tex);
+  attrib.normals.resize(nor);
+  faceCount = face;
+  return segments;
+}
 
-  std::string linebuf;
-  while (fs.peek() != -1) {
-    std::getline(fs, linebuf);
-    const char* line = linebuf.c_str();
-    if (linebuf.empty()) {
-      continue;
+/*
+ * same grouping rule as reading line by line:
+ * a new usemtl closes current group if it has faces, otherwise only renames it.
+ * returns face destination of each segment
+ */
+static std::vector<Face*> _BuildObjGroups(const std::vector<_ObjSegment>& segments, MultiMesh::ObjArray& obj) {
+  std::vector<std::pair<size_t, size_t>> place(segments.size());
+  std::string_view name;
+  size_t count = 0;
+  size_t named = 0;
+  for (const auto& seg : segments) {
+    named += seg.hasName;
+  }
+  obj.reserve(named + 1);
+  for (size_t i = 0; i < segments.size(); i++) {
+    const auto& seg = segments[i];
+    if (seg.hasName) {
+      if (count > 0) {
+        obj.emplace_back(std::make_pair(std::string(name), MultiMesh::FaceArray(count)));
+      }
+      name = seg.name;
+      count = 0;
     }
-    _ParseObj(line, pos, tex, nor, fac);
+    place[i] = std::make_pair(obj.size(), count);
+    count += seg.faceCount;
+  }
+  if (count > 0) {
+    obj.emplace_back(std::make_pair(std::string(name), MultiMesh::FaceArray(count)));
+  }
+  obj.shrink_to_fit();
+  std::vector<Face*> slices(segments.size(), nullptr);
+  for (size_t i = 0; i < segments.size(); i++) {
+    if (segments[i].faceCount > 0) {
+      slices[i] = obj[place[i].first].second.data() + place[i].second;
+    }
+  }
+  return slices;
+}
+
+static MappedFile _OpenObj(const std::filesystem::path& p) {
+  std::filesystem::path objPath = p;
+  objPath += ".obj";
+  MappedFile file(objPath);
+  if (!file.IsOpen()) {
+    throw "can't load obj";
+  }
+  return file;
+}
+
+static void _RecordStats(const ObjLoadDesc& desc, size_t fileSize, std::chrono::steady_clock::time_point start) {
+  if (desc.stats == nullptr) {
+    return;
   }
+  auto end = std::chrono::steady_clock::now();
+  desc.stats->fileSize = fileSize;
+  desc.stats->parseSeconds = std::chrono::duration<double>(end - start).count();
+}
+
+double ObjLoadStats::ThroughputMBps() const {
+  return parseSeconds > 0 ? fileSize / (1024.0 * 1024.0) / parseSeconds : 0;
+}
 
-  pos.shrink_to_fit();
-  tex.shrink_to_fit();
-  nor.shrink_to_fit();
-  fac.shrink_to_fit();
+Mesh Mine::LoadObjFromFile(const std::filesystem::path& p, const ObjLoadDesc& desc) {
+  auto start = std::chrono::steady_clock::now();
+  MappedFile file = _OpenObj(p);
+  const char* begin = file.GetData();
+  const char* end = begin + file.GetSize();
 
   Mesh m;
-  m.attrib.vertices = std::move(pos);
-  m.attrib.texcoords = std::move(tex);
-  m.attrib.normals = std::move(nor);
-  m.face = std::move(fac);
+  if (desc.precount) {
+    auto chunks = _SplitObj(begin, end, desc.threadCount);
+    size_t faceCount;
+    _CountObjChunks(chunks, m.attrib, faceCount);
+    m.face.resize(faceCount);
+    _ForEachObjChunk(chunks, [&](_ObjChunk& c) {
+      _ObjWriter writer(m.attrib, c, m.face.data() + c.faceBase, nullptr);
+      _ScanObj(c.begin, c.end, writer);
+    });
+  } else {
+    _ObjAppender appender(m.attrib, nullptr);
+    _ScanObj(begin, end, appender);
+    appender.Finish();
+    appender.faces.shrink_to_fit();
+    m.face = std::move(appender.faces);
+  }
+  _RecordStats(desc, file.GetSize(), start);
   return m;
 }
 
-MultiMesh Mine::LoadObjWithChildFromFile(const std::filesystem::path& p) {
-  std::ifstream fs(p.generic_u8string() + ".obj", std::ios::in);
-  if (!fs.is_open()) {
-    throw "can't load obj";
+MultiMesh Mine::LoadObjWithChildFromFile(const std::filesystem::path& p, const ObjLoadDesc& desc) {
+  auto start = std::chrono::steady_clock::now();
+  MappedFile file = _OpenObj(p);
+  const char* begin = file.GetData();
+  const char* end = begin + file.GetSize();
+
+  MultiMesh m;
+  if (desc.precount) {
+    auto chunks = _SplitObj(begin, end, desc.threadCount);
+    size_t faceCount;
+    auto segments = _CountObjChunks(chunks, m.attrib, faceCount);
+    auto slices = _BuildObjGroups(segments, m.obj);
+    _ForEachObjChunk(chunks, [&](_ObjChunk& c) {
+      _ObjWriter writer(m.attrib, c, slices[c.segmentBase], slices.data() + c.segmentBase);
+      _ScanObj(c.begin, c.end, writer);
+    });
+  } else {
+    _ObjAppender appender(m.attrib, &m.obj);
+    _ScanObj(begin, end, appender);
+    appender.Finish();
+  }
+  _RecordStats(desc, file.GetSize(), start);
+  return m;
+}
+
+static inline VertexKey _MakeVertexKey(const Face& f, int i, bool hasNormal, bool hasTexcoord) {
+  return VertexKey{f.verticeIdx[i], hasTexcoord ? f.texcoordIdx[i] : -1, hasNormal ? f.normalIdx[i] : -1};
+}
+
+static inline bool _IsSameVertex(const VertexKey& a, const VertexKey& b) {
+  return a.verticeIdx == b.verticeIdx && a.texcoordIdx == b.texcoordIdx && a.normalIdx == b.normalIdx;
+}
+
+static inline uint64_t _HashVertexKey(const VertexKey& k) {
+  uint64_t h = (uint64_t)(uint32_t)k.verticeIdx * 0x9e3779b97f4a7c15ull;
+  h ^= (uint64_t)(uint32_t)k.texcoordIdx * 0xc2b2ae3d27d4eb4full;
+  h ^= (uint64_t)(uint32_t)k.normalIdx * 0x165667b19e3779f9ull;
+  return HashMix64(h);
+}
+
+struct _VertexKeyLess {
+  bool operator()(const VertexKey& a, const VertexKey& b) const {
+    return a.verticeIdx == b.verticeIdx
+               ? (a.texcoordIdx == b.texcoordIdx ? a.normalIdx < b.normalIdx : a.texcoordIdx < b.texcoordIdx)
+               : a.verticeIdx < b.verticeIdx;
   }
-  std::vector<Vector3> pos;
-  std::vector<Vector2> tex;
-  std::vector<Vector3> nor;
-  MultiMesh::ObjArray faces;
-
-  MultiMesh::FaceArray tempFace;
-  std::string tempName;
-
-  std::string linebuf;
-  while (fs.peek() != -1) {
-    std::getline(fs, linebuf);
-    const char* line = linebuf.c_str();
-    if (linebuf.empty()) {
-      continue;
-    }
-    _ParseObj(line, pos, tex, nor, tempFace);
-    if (strncmp(line, "usemtl ", 6) == 0) {
-      char name[256];
-      int cnt = sscanf(line, "usemtl %s", name);
-      assert(cnt == 1);
-      if (!tempFace.empty()) {
-        tempFace.shrink_to_fit();
-        faces.emplace_back(std::make_pair(std::move(tempName), std::move(tempFace)));
-        tempFace = MultiMesh::FaceArray();
+};
+
+constexpr unsigned int WELD_EMPTY_SLOT = 0xffffffffu;
+constexpr size_t WELD_BLOCK_SIZE = 1 << 16;
+
+//power of two, load factor at most 2/3 even if no corner is shared
+static size_t _WeldTableCapacity(size_t count) {
+  size_t c = 16;
+  while (c < count + count / 2) {
+    c <<= 1;
+  }
+  return c;
+}
+
+static size_t _CountCorners(const FaceArrayList& faces) {
+  size_t n = 0;
+  for (const auto* arr : faces) {
+    n += arr->size() * 3;
+  }
+  return n;
+}
+
+static void _WeldTree(const FaceArrayList& faces, bool hasNormal, bool hasTexcoord,
+                      std::vector<unsigned int>& indices, std::vector<VertexKey>& vertices) {
+  std::map<VertexKey, unsigned int, _VertexKeyLess> cull;
+  indices.reserve(_CountCorners(faces));
+  for (const auto* arr : faces) {
+    for (const Face& f : *arr) {
+      for (int i = 0; i < 3; i++) {
+        auto key = _MakeVertexKey(f, i, hasNormal, hasTexcoord);
+        auto [iter, isNew] = cull.emplace(key, (unsigned int)vertices.size());
+        if (isNew) {
+          vertices.emplace_back(key);
+        }
+        indices.emplace_back(iter->second);
       }
-      tempName = std::string(name);
     }
   }
+}
 
-  if (!tempFace.empty()) {
-    tempFace.shrink_to_fit();
-    faces.emplace_back(std::make_pair(std::move(tempName), std::move(tempFace)));
+static void _WeldHash(const FaceArrayList& faces, bool hasNormal, bool hasTexcoord,
+                      std::vector<unsigned int>& indices, std::vector<VertexKey>& vertices) {
+  size_t corners = _CountCorners(faces);
+  indices.resize(corners);
+  //slot stores vertex id, key is read back from vertices
+  std::vector<unsigned int> table(_WeldTableCapacity(corners), WELD_EMPTY_SLOT);
+  size_t mask = table.size() - 1;
+  size_t c = 0;
+  for (const auto* arr : faces) {
+    for (const Face& f : *arr) {
+      for (int i = 0; i < 3; i++) {
+        auto key = _MakeVertexKey(f, i, hasNormal, hasTexcoord);
+        size_t slot = _HashVertexKey(key) & mask;
+        unsigned int id;
+        while (true) {
+          id = table[slot];
+          if (id == WELD_EMPTY_SLOT) {
+            id = (unsigned int)vertices.size();
+            table[slot] = id;
+            vertices.emplace_back(key);
+            break;
+          }
+          if (_IsSameVertex(vertices[id], key)) {
+            break;
+          }
+          slot = (slot + 1) & mask;
+        }
+        indices[c++] = id;
+      }
+    }
   }
+}
 
-  pos.shrink_to_fit();
-  tex.shrink_to_fit();
-  nor.shrink_to_fit();
-  faces.shrink_to_fit();
-  MultiMesh m;
-  m.attrib.vertices = std::move(pos);
-  m.attrib.texcoords = std::move(tex);
-  m.attrib.normals = std::move(nor);
-  m.obj = std::move(faces);
-  return m;
-}
\ No newline at end of file
+/*
+ * 1.flatten corner keys and hashes
+ * 2.counting sort corners into partitions by high bits of hash, order inside a partition is kept
+ * 3.every partition owns a private table and finds first corner of each key
+ * 4.one linear pass gives ids in first use order, same as serial welding
+ */
+static void _WeldParallelHash(const FaceArrayList& faces, bool hasNormal, bool hasTexcoord,
+                              std::vector<unsigned int>& indices, std::vector<VertexKey>& vertices) {
+  auto& pool = ThreadPool::GetInstance();
+  size_t corners = _CountCorners(faces);
+  if (pool.GetThreadCount() == 1 || corners < WELD_BLOCK_SIZE * 2) {
+    _WeldHash(faces, hasNormal, hasTexcoord, indices, vertices);
+    return;
+  }
+
+  struct FaceBlock {
+    const Face* faces;
+    size_t count;
+    size_t cornerBase;
+  };
+  std::vector<FaceBlock> faceBlocks;
+  size_t base = 0;
+  for (const auto* arr : faces) {
+    for (size_t i = 0; i < arr->size(); i += WELD_BLOCK_SIZE) {
+      size_t count = std::min(WELD_BLOCK_SIZE, arr->size() - i);
+      faceBlocks.emplace_back(FaceBlock{arr->data() + i, count, base});
+      base += count * 3;
+    }
+  }
+  std::vector<VertexKey> keys(corners);
+  std::vector<uint64_t> hashes(corners);
+  pool.ParallelFor(faceBlocks.size(), [&](size_t b) {
+    const auto& block = faceBlocks[b];
+    for (size_t i = 0; i < block.count; i++) {
+      for (int j = 0; j < 3; j++) {
+        size_t c = block.cornerBase + i * 3 + j;
+        keys[c] = _MakeVertexKey(block.faces[i], j, hasNormal, hasTexcoord);
+        hashes[c] = _HashVertexKey(keys[c]);
+      }
+    }
+  });
+
+  int partBits = 0;
+  while (((size_t)1 << partBits) < pool.GetThreadCount() * 4 && partBits < 8) {
+    partBits++;
+  }
+  size_t partCount = (size_t)1 << partBits;
+  auto partOf = [partBits](uint64_t h) { return partBits == 0 ? (size_t)0 : (size_t)(h >> (64 - partBits)); };
+
+  size_t blockCount = (corners + WELD_BLOCK_SIZE - 1) / WELD_BLOCK_SIZE;
+  std::vector<size_t> offsets(blockCount * partCount, 0);
+  pool.ParallelFor(blockCount, [&](size_t b) {
+    size_t* hist = offsets.data() + b * partCount;
+    size_t end = std::min(corners, (b + 1) * WELD_BLOCK_SIZE);
+    for (size_t c = b * WELD_BLOCK_SIZE; c < end; c++) {
+      hist[partOf(hashes[c])]++;
+    }
+  });
+  std::vector<size_t> partStart(partCount + 1, 0);
+  size_t sum = 0;
+  for (size_t p = 0; p < partCount; p++) {
+    partStart[p] = sum;
+    for (size_t b = 0; b < blockCount; b++) {
+      size_t count = offsets[b * partCount + p];
+      offsets[b * partCount + p] = sum;
+      sum += count;
+    }
+  }
+  partStart[partCount] = sum;
+  std::vector<unsigned int> order(corners);
+  pool.ParallelFor(blockCount, [&](size_t b) {
+    size_t* cursor = offsets.data() + b * partCount;
+    size_t end = std::min(corners, (b + 1) * WELD_BLOCK_SIZE);
+    for (size_t c = b * WELD_BLOCK_SIZE; c < end; c++) {
+      order[cursor[partOf(hashes[c])]++] = (unsigned int)c;
+    }
+  });
+
+  //first corner with the same key
+  std::vector<unsigned int> first(corners);
+  pool.ParallelFor(partCount, [&](size_t p) {
+    size_t begin = partStart[p];
+    size_t end = partStart[p + 1];
+    std::vector<unsigned int> table(_WeldTableCapacity(end - begin), WELD_EMPTY_SLOT);
+    size_t mask = table.size() - 1;
+    for (size_t i = begin; i < end; i++) {
+      unsigned int c = order[i];
+      size_t slot = hashes[c] & mask;
+      while (true) {
+        unsigned int s = table[slot];
+        if (s == WELD_EMPTY_SLOT) {
+          table[slot] = c;
+          first[c] = c;
+          break;
+        }
+        if (_IsSameVertex(keys[s], keys[c])) {
+          first[c] = s;
+          break;
+        }
+        slot = (slot + 1) & mask;
+      }
+    }
+  });
+
+  indices.resize(corners);
+  for (size_t c = 0; c < corners; c++) {
+    if (first[c] == c) {
+      indices[c] = (unsigned int)vertices.size();
+      vertices.emplace_back(keys[c]);
+    } else {
+      indices[c] = indices[first[c]];
+    }
+  }
+}
+
+void Mine::WeldVertices(const FaceArrayList& faces,
+                        bool hasNormal,
+                        bool hasTexcoord,
+                        VertexWeldMode mode,
+                        std::vector<unsigned int>& indices,
+                        std::vector<VertexKey>& vertices) {
+  indices.clear();
+  vertices.clear();
+  switch (mode) {
+    case VertexWeldMode::Tree:
+      _WeldTree(faces, hasNormal, hasTexcoord, indices, vertices);
+      break;
+    case VertexWeldMode::Hash:
+      _WeldHash(faces, hasNormal, hasTexcoord, indices, vertices);
+      break;
+    case VertexWeldMode::ParallelHash:
+      _WeldParallelHash(faces, hasNormal, hasTexcoord, indices, vertices);
+      break;
+  }
+}
@@ -32,7 +32,56 @@ struct MultiMesh {
   ObjArray obj;
 };
 
-Mesh LoadObjFromFile(const std::filesystem::path& p);
-MultiMesh LoadObjWithChildFromFile(const std::filesystem::path& p);
+struct ObjLoadStats {
+  size_t fileSize;
+  double parseSeconds;
+  constexpr ObjLoadStats() : fileSize(0), parseSeconds(0) {}
+  double ThroughputMBps() const;
+};
+
+struct ObjLoadDesc {
+  /*
+   * scan the file twice.first pass only counts records,
+   * so every array is allocated once with exact size
+   */
+  bool precount;
+  /*
+   * split file at line boundary and parse chunks on ThreadPool (needs precount).
+   * 0 means one chunk per core, small file is always parsed by one thread.
+   * result is identical to single thread parsing
+   */
+  int threadCount;
+  ObjLoadStats* stats;
+  constexpr ObjLoadDesc() : precount(true), threadCount(0), stats(nullptr) {}
+};
+
+enum class VertexWeldMode {
+  Tree,          //std::map, reference only
+  Hash,          //flat open addressing table
+  ParallelHash,  //corners partitioned by hash across ThreadPool
+};
+
+struct VertexKey {
+  int verticeIdx;
+  int texcoordIdx;
+  int normalIdx;
+};
+
+using FaceArrayList = std::vector<const std::vector<Face>*>;
+
+/*
+ * merge corners referencing the same (position, texcoord, normal).
+ * indices has one entry per corner in face order, vertices are in first use order.
+ * every mode gives the same result
+ */
+void WeldVertices(const FaceArrayList& faces,
+                  bool hasNormal,
+                  bool hasTexcoord,
+                  VertexWeldMode mode,
+                  std::vector<unsigned int>& indices,
+                  std::vector<VertexKey>& vertices);
+
+Mesh LoadObjFromFile(const std::filesystem::path& p, const ObjLoadDesc& desc = ObjLoadDesc());
+MultiMesh LoadObjWithChildFromFile(const std::filesystem::path& p, const ObjLoadDesc& desc = ObjLoadDesc());
 
 }  // namespace Mine
@@ -0,0 +1,296 @@
+#include "MeshCache.h"
+
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+#include "Hash.h"
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+
+using namespace Mine;
+
+/*
+ * cooked mesh file layout:
+ * | header | attrib table | submesh table | lod table | names | vertex data | index data |
+ * vertex and index data are aligned, ready for glBufferData
+ */
+
+static const char __meshCacheMagic[8] = {'M', 'I', 'N', 'E', 'M', 'S', 'H', '\0'};
+constexpr uint32_t MESH_CACHE_VERSION = 5;
+constexpr uint64_t MESH_CACHE_ALIGN = 16;
+
+constexpr uint32_t MESH_CACHE_NORMAL = 1 << 0;
+constexpr uint32_t MESH_CACHE_TEXCOORD = 1 << 1;
+constexpr uint32_t MESH_CACHE_MULTI = 1 << 2;
+constexpr uint32_t MESH_CACHE_FORMAT_SHIFT = 8;
+
+struct _MeshCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t sourceSize;
+  int64_t sourceTime;
+  uint64_t sourceHash;
+  uint32_t attribCount;
+  uint32_t subMeshCount;
+  uint32_t indexType;
+  float positionDecode[4];
+  uint32_t lodCount;
+  uint64_t attribOffset;
+  uint64_t subMeshOffset;
+  uint64_t lodOffset;
+  uint64_t vertexOffset;
+  uint64_t vertexSize;
+  uint64_t indexOffset;
+  uint64_t indexSize;
+  uint64_t fileSize;
+};
+
+struct _MeshCacheAttrib {
+  uint32_t index;
+  int32_t size;
+  uint32_t type;
+  uint32_t normalized;
+  int32_t stride;
+  uint32_t padding;
+  uint64_t offset;
+};
+
+struct _MeshCacheSubMesh {
+  int32_t indexOffset;
+  int32_t indexCount;
+  uint32_t lodFirst;
+  uint32_t lodCount;
+  uint64_t nameOffset;
+  uint64_t nameLength;
+  BoundingBox bounds;
+  BoundingSphere sphere;
+  uint32_t padding[2];
+};
+
+struct _MeshCacheLod {
+  int32_t indexOffset;
+  int32_t indexCount;
+  float error;
+  uint32_t padding;
+};
+
+static constexpr uint64_t _AlignUp(uint64_t v) { return (v + MESH_CACHE_ALIGN - 1) / MESH_CACHE_ALIGN * MESH_CACHE_ALIGN; }
+
+static void _WriteBytes(std::ofstream& fs, uint64_t& pos, const void* data, uint64_t size) {
+  fs.write((const char*)data, (std::streamsize)size);
+  pos += size;
+}
+
+static void _WritePadding(std::ofstream& fs, uint64_t& pos, uint64_t target) {
+  static const char zero[MESH_CACHE_ALIGN] = {};
+  _WriteBytes(fs, pos, zero, target - pos);
+}
+
+MeshCacheKey Mine::CreateMeshCacheKey(const std::filesystem::path& source, uint32_t flags) {
+  MappedFile file(source);
+  if (!file.IsOpen()) {
+    throw "can't open mesh source";
+  }
+  MeshCacheKey key;
+  key.sourceSize = file.GetSize();
+  key.sourceTime = (int64_t)std::filesystem::last_write_time(source).time_since_epoch().count();
+  key.sourceHash = Hash64(file.GetData(), file.GetSize());
+  key.flags = flags;
+  return key;
+}
+
+bool Mine::WriteMeshCache(const std::filesystem::path& path, const MeshCacheKey& key, const GPUMeshDescOpenGL& desc) {
+  _MeshCacheHeader h;
+  memcpy(h.magic, __meshCacheMagic, sizeof(h.magic));
+  h.version = MESH_CACHE_VERSION;
+  h.flags = key.flags;
+  h.sourceSize = key.sourceSize;
+  h.sourceTime = key.sourceTime;
+  h.sourceHash = key.sourceHash;
+  h.attribCount = (uint32_t)desc.attribDesc.size();
+  h.subMeshCount = (uint32_t)desc.subMeshes.size();
+  h.indexType = desc.indexType;
+  memcpy(h.positionDecode, &desc.positionDecode, sizeof(h.positionDecode));
+  uint64_t offset = sizeof(_MeshCacheHeader);
+  h.attribOffset = offset;
+  offset += h.attribCount * sizeof(_MeshCacheAttrib);
+  h.subMeshOffset = offset;
+  offset += h.subMeshCount * sizeof(_MeshCacheSubMesh);
+  std::vector<_MeshCacheLod> lods;
+  for (const auto& s : desc.subMeshes) {
+    for (const auto& l : s.lods) {
+      lods.emplace_back(_MeshCacheLod{l.indexOffset, l.indexCount, l.error, 0});
+    }
+  }
+  h.lodCount = (uint32_t)lods.size();
+  h.lodOffset = offset;
+  offset += h.lodCount * sizeof(_MeshCacheLod);
+  std::vector<_MeshCacheSubMesh> subMeshes;
+  uint32_t lodFirst = 0;
+  for (const auto& s : desc.subMeshes) {
+    subMeshes.emplace_back(_MeshCacheSubMesh{s.indexOffset,
+                                             s.indexCount,
+                                             lodFirst,
+                                             (uint32_t)s.lods.size(),
+                                             offset,
+                                             s.name.size(),
+                                             s.bounds,
+                                             s.sphere,
+                                             {0, 0}});
+    lodFirst += (uint32_t)s.lods.size();
+    offset += s.name.size();
+  }
+  h.vertexOffset = _AlignUp(offset);
+  h.vertexSize = desc.data.size();
+  h.indexOffset = _AlignUp(h.vertexOffset + h.vertexSize);
+  auto indices = PackIndicesOpenGL(desc.indices, desc.indexType);
+  h.indexSize = indices.size();
+  h.fileSize = h.indexOffset + h.indexSize;
+
+  auto temp = path;
+  temp += ".tmp";
+  std::ofstream fs(temp, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!fs.is_open()) {
+    return false;
+  }
+  uint64_t pos = 0;
+  _WriteBytes(fs, pos, &h, sizeof(h));
+  for (const auto& a : desc.attribDesc) {
+    _MeshCacheAttrib attrib{a.index, a.size, a.type, a.normalized, a.stride, 0, a.offset};
+    _WriteBytes(fs, pos, &attrib, sizeof(attrib));
+  }
+  _WriteBytes(fs, pos, subMeshes.data(), subMeshes.size() * sizeof(_MeshCacheSubMesh));
+  _WriteBytes(fs, pos, lods.data(), lods.size() * sizeof(_MeshCacheLod));
+  for (const auto& s : desc.subMeshes) {
+    _WriteBytes(fs, pos, s.name.data(), s.name.size());
+  }
+  _WritePadding(fs, pos, h.vertexOffset);
+  _WriteBytes(fs, pos, desc.data.data(), h.vertexSize);
+  _WritePadding(fs, pos, h.indexOffset);
+  _WriteBytes(fs, pos, indices.data(), h.indexSize);
+  fs.close();
+
+  std::error_code ec;
+  if (!fs || pos != h.fileSize) {
+    std::filesystem::remove(temp, ec);
+    return false;
+  }
+  std::filesystem::rename(temp, path, ec);
+  if (ec) {
+    std::filesystem::remove(temp, ec);
+    return false;
+  }
+  return true;
+}
+
+std::shared_ptr<GPUMeshOpenGL> Mine::LoadMeshCacheOpenGL(const std::filesystem::path& path, const MeshCacheKey& key) {
+  MappedFile file(path);
+  if (!file.IsOpen() || file.GetSize() < sizeof(_MeshCacheHeader)) {
+    return nullptr;
+  }
+  const char* data = file.GetData();
+  _MeshCacheHeader h;
+  memcpy(&h, data, sizeof(h));
+  if (memcmp(h.magic, __meshCacheMagic, sizeof(h.magic)) != 0 ||
+      h.version != MESH_CACHE_VERSION ||
+      h.flags != key.flags ||
+      h.sourceSize != key.sourceSize ||
+      h.sourceTime != key.sourceTime ||
+      h.sourceHash != key.sourceHash ||
+      h.fileSize != file.GetSize() ||
+      (h.indexType != GL_UNSIGNED_SHORT && h.indexType != GL_UNSIGNED_INT)) {
+    return nullptr;
+  }
+  if (h.attribOffset + h.attribCount * sizeof(_MeshCacheAttrib) > h.fileSize ||
+      h.subMeshOffset + h.subMeshCount * sizeof(_MeshCacheSubMesh) > h.fileSize ||
+      h.lodOffset + h.lodCount * sizeof(_MeshCacheLod) > h.fileSize ||
+      h.vertexOffset + h.vertexSize > h.fileSize ||
+      h.indexOffset + h.indexSize > h.fileSize) {
+    return nullptr;
+  }
+
+  std::vector<VertexAttribDescOpenGL> attribs(h.attribCount);
+  for (uint32_t i = 0; i < h.attribCount; i++) {
+    _MeshCacheAttrib a;
+    memcpy(&a, data + h.attribOffset + i * sizeof(a), sizeof(a));
+    attribs[i] = VertexAttribDescOpenGL{a.index, a.size, a.type, (GLboolean)a.normalized, a.stride, (size_t)a.offset};
+  }
+  std::vector<SubMeshDescOpenGL> subMeshes(h.subMeshCount);
+  for (uint32_t i = 0; i < h.subMeshCount; i++) {
+    _MeshCacheSubMesh s;
+    memcpy(&s, data + h.subMeshOffset + i * sizeof(s), sizeof(s));
+    if (s.nameOffset + s.nameLength > h.fileSize || (uint64_t)s.lodFirst + s.lodCount > h.lodCount) {
+      return nullptr;
+    }
+    subMeshes[i] = SubMeshDescOpenGL{std::string(data + s.nameOffset, s.nameLength), s.indexOffset, s.indexCount};
+    subMeshes[i].bounds = s.bounds;
+    subMeshes[i].sphere = s.sphere;
+    for (uint32_t l = 0; l < s.lodCount; l++) {
+      _MeshCacheLod lod;
+      memcpy(&lod, data + h.lodOffset + (s.lodFirst + l) * sizeof(lod), sizeof(lod));
+      subMeshes[i].lods.emplace_back(MeshLodDescOpenGL{lod.indexOffset, lod.indexCount, lod.error});
+    }
+  }
+  return std::make_shared<GPUMeshOpenGL>(attribs,
+                                         data + h.vertexOffset,
+                                         (GLsizeiptr)h.vertexSize,
+                                         data + h.indexOffset,
+                                         (GLsizeiptr)h.indexSize,
+                                         (GLenum)h.indexType,
+                                         std::move(subMeshes),
+                                         Vector4(h.positionDecode[0], h.positionDecode[1], h.positionDecode[2], h.positionDecode[3]));
+}
+
+template <typename Func>
+static std::shared_ptr<GPUMeshOpenGL> _CreateCached(const std::filesystem::path& path,
+                                                    uint32_t flags,
+                                                    const VertexFormatDesc& format,
+                                                    Func&& cook) {
+  std::filesystem::path source = path;
+  source += ".obj";
+  std::filesystem::path cooked = path;
+  cooked += ".minemesh";
+  auto key = CreateMeshCacheKey(source, flags | format.Hash() << MESH_CACHE_FORMAT_SHIFT);
+  auto mesh = LoadMeshCacheOpenGL(cooked, key);
+  if (mesh != nullptr) {
+    return mesh;
+  }
+  GPUMeshDescOpenGL desc = cook();
+  MeshOptimizeStats stats;
+  OptimizeMeshDescOpenGL(desc, MeshOptimizeDesc(), &stats);
+  GenerateLodMeshDescOpenGL(desc);
+  std::cout << "cook " << cooked.generic_u8string() << ": ACMR " << stats.before.acmr << " -> " << stats.after.acmr
+            << ", ATVR " << stats.before.atvr << " -> " << stats.after.atvr << "\n";
+  QuantizeMeshDescOpenGL(desc, format);
+  if (!WriteMeshCache(cooked, key, desc)) {
+    std::cout << "can't write mesh cache:" << cooked.generic_u8string() << "\n";
+  }
+  return std::make_shared<GPUMeshOpenGL>(desc);
+}
+
+static uint32_t _MeshCacheFlags(bool hasNormal, bool hasTexcoord) {
+  return (hasNormal ? MESH_CACHE_NORMAL : 0) | (hasTexcoord ? MESH_CACHE_TEXCOORD : 0);
+}
+
+std::shared_ptr<GPUMeshOpenGL> Mine::CreateMeshBufferCachedOpenGL(const std::filesystem::path& path,
+                                                                  bool hasNormal,
+                                                                  bool hasTexcoord,
+                                                                  const ObjLoadDesc& objDesc,
+                                                                  const VertexFormatDesc& format) {
+  return _CreateCached(path, _MeshCacheFlags(hasNormal, hasTexcoord), format, [&]() {
+    return CreateMeshDescOpenGL(LoadObjFromFile(path, objDesc), hasNormal, hasTexcoord);
+  });
+}
+
+std::shared_ptr<GPUMeshOpenGL> Mine::CreateMultiMeshBufferCachedOpenGL(const std::filesystem::path& path,
+                                                                       bool hasNormal,
+                                                                       bool hasTexcoord,
+                                                                       const ObjLoadDesc& objDesc,
+                                                                       const VertexFormatDesc& format) {
+  return _CreateCached(path, _MeshCacheFlags(hasNormal, hasTexcoord) | MESH_CACHE_MULTI, format, [&]() {
+    return CreateMultiMeshDescOpenGL(LoadObjWithChildFromFile(path, objDesc), hasNormal, hasTexcoord);
+  });
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+#include "MeshQuantizer.h"
+#include "OpenGLContext.h"
+
+namespace Mine {
+
+/*
+ * identity of the source file and build options a cooked mesh was made from.
+ * any difference makes the cooked file stale
+ */
+struct MeshCacheKey {
+  uint64_t sourceSize;
+  int64_t sourceTime;
+  uint64_t sourceHash;
+  uint32_t flags;
+};
+
+MeshCacheKey CreateMeshCacheKey(const std::filesystem::path& source, uint32_t flags);
+bool WriteMeshCache(const std::filesystem::path& path, const MeshCacheKey& key, const GPUMeshDescOpenGL& desc);
+/*
+ * returns nullptr if file is missing, broken or stale.
+ * data goes from mapped file to glBufferData directly
+ */
+std::shared_ptr<GPUMeshOpenGL> LoadMeshCacheOpenGL(const std::filesystem::path& path, const MeshCacheKey& key);
+
+/*
+ * load path.obj through cooked file path.minemesh,
+ * cooked file is written when missing or stale,
+ * cooking runs OptimizeMeshDescOpenGL, GenerateLodMeshDescOpenGL, then QuantizeMeshDescOpenGL with format.
+ * objDesc is only used when .obj has to be parsed
+ */
+std::shared_ptr<GPUMeshOpenGL> CreateMeshBufferCachedOpenGL(const std::filesystem::path& path,
+                                                            bool hasNormal = true,
+                                                            bool hasTexcoord = true,
+                                                            const ObjLoadDesc& objDesc = ObjLoadDesc(),
+                                                            const VertexFormatDesc& format = VertexFormatDesc());
+std::shared_ptr<GPUMeshOpenGL> CreateMultiMeshBufferCachedOpenGL(const std::filesystem::path& path,
+                                                                 bool hasNormal = true,
+                                                                 bool hasTexcoord = true,
+                                                                 const ObjLoadDesc& objDesc = ObjLoadDesc(),
+                                                                 const VertexFormatDesc& format = VertexFormatDesc());
+
+}  // namespace Mine
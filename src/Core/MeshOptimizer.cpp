@@ -0,0 +1,312 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "MathExt.h"
+
+using namespace Mine;
+
+/*
+ * FIFO cache by timestamps: a vertex is cached if less than cacheSize misses happened since it was loaded
+ */
+struct _FifoCache {
+  std::vector<unsigned int> stamp;
+  unsigned int time;
+  unsigned int size;
+
+  _FifoCache(size_t vertexCount, unsigned int cacheSize) : stamp(vertexCount, 0), time(cacheSize + 1), size(cacheSize) {}
+
+  unsigned int Access(unsigned int v) {
+    if (time - stamp[v] > size) {
+      stamp[v] = time++;
+      return 1;
+    }
+    return 0;
+  }
+
+  void Flush() { time += size + 1; }
+};
+
+VertexCacheStats Mine::AnalyzeVertexCache(const unsigned int* indices,
+                                          size_t indexCount,
+                                          size_t vertexCount,
+                                          unsigned int cacheSize) {
+  VertexCacheStats stats{0, 0};
+  if (indexCount < 3) {
+    return stats;
+  }
+  _FifoCache cache(vertexCount, cacheSize);
+  std::vector<char> used(vertexCount, 0);
+  size_t misses = 0;
+  size_t unique = 0;
+  for (size_t i = 0; i < indexCount; i++) {
+    misses += cache.Access(indices[i]);
+    unique += used[indices[i]] == 0;
+    used[indices[i]] = 1;
+  }
+  stats.acmr = (float)misses / (float)(indexCount / 3);
+  stats.atvr = (float)misses / (float)unique;
+  return stats;
+}
+
+/*
+ * vertex -> triangles adjacency in CSR form
+ */
+struct _TriangleAdjacency {
+  std::vector<unsigned int> offsets;
+  std::vector<unsigned int> triangles;
+
+  _TriangleAdjacency(const unsigned int* indices, size_t indexCount, size_t vertexCount)
+      : offsets(vertexCount + 1, 0), triangles(indexCount) {
+    for (size_t i = 0; i < indexCount; i++) {
+      offsets[indices[i] + 1]++;
+    }
+    for (size_t v = 0; v < vertexCount; v++) {
+      offsets[v + 1] += offsets[v];
+    }
+    std::vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; i++) {
+      triangles[cursor[indices[i]]++] = (unsigned int)(i / 3);
+    }
+  }
+};
+
+void Mine::OptimizeVertexCache(unsigned int* dst,
+                               const unsigned int* indices,
+                               size_t indexCount,
+                               size_t vertexCount,
+                               unsigned int cacheSize) {
+  size_t triCount = indexCount / 3;
+  if (triCount == 0) {
+    return;
+  }
+  _TriangleAdjacency adj(indices, indexCount, vertexCount);
+  std::vector<unsigned int> live(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++) {
+    live[v] = adj.offsets[v + 1] - adj.offsets[v];
+  }
+  std::vector<unsigned int> stamp(vertexCount, 0);
+  std::vector<char> emitted(triCount, 0);
+  std::vector<unsigned int> deadEnd;
+  std::vector<unsigned int> candidates;
+  deadEnd.reserve(indexCount);
+  unsigned int time = cacheSize + 1;
+  size_t cursor = 0;
+  size_t out = 0;
+  long long fan = indices[0];
+
+  while (fan >= 0) {
+    candidates.clear();
+    for (unsigned int i = adj.offsets[fan]; i < adj.offsets[fan + 1]; i++) {
+      unsigned int t = adj.triangles[i];
+      if (emitted[t]) {
+        continue;
+      }
+      for (int k = 0; k < 3; k++) {
+        unsigned int v = indices[t * 3 + k];
+        dst[out++] = v;
+        deadEnd.emplace_back(v);
+        candidates.emplace_back(v);
+        live[v]--;
+        if (time - stamp[v] > cacheSize) {
+          stamp[v] = time++;
+        }
+      }
+      emitted[t] = 1;
+    }
+
+    //prefer the candidate that stays in cache while its remaining triangles are emitted
+    long long best = -1;
+    long long bestPriority = -1;
+    for (auto v : candidates) {
+      if (live[v] == 0) {
+        continue;
+      }
+      long long priority = 0;
+      if (time - stamp[v] + 2 * live[v] <= cacheSize) {
+        priority = time - stamp[v];
+      }
+      if (priority > bestPriority) {
+        best = v;
+        bestPriority = priority;
+      }
+    }
+    if (best < 0) {
+      while (!deadEnd.empty()) {
+        unsigned int v = deadEnd.back();
+        deadEnd.pop_back();
+        if (live[v] > 0) {
+          best = v;
+          break;
+        }
+      }
+    }
+    if (best < 0) {
+      for (; cursor < vertexCount; cursor++) {
+        if (live[cursor] > 0) {
+          best = (long long)cursor;
+          break;
+        }
+      }
+    }
+    fan = best;
+  }
+}
+
+void Mine::OptimizeOverdraw(unsigned int* dst,
+                            const unsigned int* indices,
+                            size_t indexCount,
+                            const float* positions,
+                            size_t positionStride,
+                            size_t vertexCount,
+                            float threshold,
+                            unsigned int cacheSize) {
+  size_t triCount = indexCount / 3;
+  if (triCount == 0) {
+    return;
+  }
+  _FifoCache cache(vertexCount, cacheSize);
+  std::vector<unsigned int> misses(triCount);
+  for (size_t t = 0; t < triCount; t++) {
+    misses[t] = cache.Access(indices[t * 3]) + cache.Access(indices[t * 3 + 1]) + cache.Access(indices[t * 3 + 2]);
+  }
+
+  //hard boundary where cache optimizer jumped to an unrelated place, soft boundaries inside
+  std::vector<size_t> clusters;
+  size_t hardStart = 0;
+  while (hardStart < triCount) {
+    size_t hardEnd = hardStart + 1;
+    size_t hardMisses = misses[hardStart];
+    while (hardEnd < triCount && misses[hardEnd] != 3) {
+      hardMisses += misses[hardEnd++];
+    }
+    float limit = threshold * (float)hardMisses / (float)(hardEnd - hardStart);
+    cache.Flush();
+    size_t start = hardStart;
+    size_t softMisses = 0;
+    clusters.emplace_back(start);
+    for (size_t t = hardStart; t < hardEnd; t++) {
+      softMisses += cache.Access(indices[t * 3]) + cache.Access(indices[t * 3 + 1]) + cache.Access(indices[t * 3 + 2]);
+      if (t + 1 < hardEnd && (float)softMisses <= limit * (float)(t + 1 - start)) {
+        start = t + 1;
+        softMisses = 0;
+        clusters.emplace_back(start);
+        cache.Flush();
+      }
+    }
+    hardStart = hardEnd;
+  }
+  clusters.emplace_back(triCount);
+
+  auto position = [&](unsigned int v) {
+    auto p = (const float*)((const char*)positions + v * positionStride);
+    return Vector3(p[0], p[1], p[2]);
+  };
+  size_t clusterCount = clusters.size() - 1;
+  std::vector<Vector3> centroids(clusterCount);
+  std::vector<Vector3> normals(clusterCount);
+  Vector3 meshCentroid(0, 0, 0);
+  float meshArea = 0;
+  for (size_t c = 0; c < clusterCount; c++) {
+    Vector3 centroid(0, 0, 0);
+    Vector3 normal(0, 0, 0);
+    float area = 0;
+    for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+      auto p0 = position(indices[t * 3]);
+      auto p1 = position(indices[t * 3 + 1]);
+      auto p2 = position(indices[t * 3 + 2]);
+      auto n = Cross(Sub(p1, p0), Sub(p2, p0));  //length is twice the area
+      float a = Length(n);
+      centroid = Add(centroid, Mul(Add(Add(p0, p1), p2), a / 3.0f));
+      normal = Add(normal, n);
+      area += a;
+    }
+    meshCentroid = Add(meshCentroid, centroid);
+    meshArea += area;
+    centroids[c] = area > 0 ? Div(centroid, area) : position(indices[clusters[c] * 3]);
+    float len = Length(normal);
+    normals[c] = len > 0 ? Div(normal, len) : normal;
+  }
+  if (meshArea > 0) {
+    meshCentroid = Div(meshCentroid, meshArea);
+  }
+
+  //clusters facing away from mesh center are likely to occlude the others, draw them first
+  std::vector<float> sortKeys(clusterCount);
+  std::vector<unsigned int> order(clusterCount);
+  for (size_t c = 0; c < clusterCount; c++) {
+    sortKeys[c] = Dot(Sub(centroids[c], meshCentroid), normals[c]);
+    order[c] = (unsigned int)c;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return sortKeys[a] > sortKeys[b]; });
+
+  size_t out = 0;
+  for (auto c : order) {
+    size_t begin = clusters[c] * 3;
+    size_t end = clusters[c + 1] * 3;
+    memcpy(dst + out, indices + begin, (end - begin) * sizeof(unsigned int));
+    out += end - begin;
+  }
+}
+
+size_t Mine::OptimizeVertexFetch(void* dstVertices,
+                                 unsigned int* indices,
+                                 size_t indexCount,
+                                 const void* vertices,
+                                 size_t vertexCount,
+                                 size_t vertexSize) {
+  constexpr unsigned int unused = 0xffffffff;
+  std::vector<unsigned int> remap(vertexCount, unused);
+  unsigned int next = 0;
+  for (size_t i = 0; i < indexCount; i++) {
+    unsigned int& r = remap[indices[i]];
+    if (r == unused) {
+      memcpy((char*)dstVertices + next * vertexSize, (const char*)vertices + indices[i] * vertexSize, vertexSize);
+      r = next++;
+    }
+    indices[i] = r;
+  }
+  return next;
+}
+
+void Mine::OptimizeMeshDescOpenGL(GPUMeshDescOpenGL& desc, const MeshOptimizeDesc& opt, MeshOptimizeStats* stats) {
+  if (desc.attribDesc.empty() || desc.indices.empty()) {
+    return;
+  }
+  size_t vertexSize = (size_t)desc.attribDesc[0].stride;
+  size_t vertexCount = desc.data.size() / vertexSize;
+  if (stats != nullptr) {
+    stats->before = AnalyzeVertexCache(desc.indices.data(), desc.indices.size(), vertexCount, opt.cacheSize);
+  }
+
+  std::vector<unsigned int> temp;
+  for (const auto& s : desc.subMeshes) {
+    unsigned int* range = desc.indices.data() + s.indexOffset;
+    size_t count = (size_t)s.indexCount;
+    if (count < 3) {
+      continue;
+    }
+    temp.resize(count);
+    if (opt.vertexCache) {
+      OptimizeVertexCache(temp.data(), range, count, vertexCount, opt.cacheSize);
+      memcpy(range, temp.data(), count * sizeof(unsigned int));
+    }
+    if (opt.overdraw) {
+      auto positions = (const float*)(desc.data.data() + desc.attribDesc[0].offset);
+      OptimizeOverdraw(temp.data(), range, count, positions, vertexSize, vertexCount, opt.overdrawThreshold, opt.cacheSize);
+      memcpy(range, temp.data(), count * sizeof(unsigned int));
+    }
+  }
+
+  if (opt.vertexFetch) {
+    std::vector<unsigned char> data(desc.data.size());
+    vertexCount = OptimizeVertexFetch(data.data(), desc.indices.data(), desc.indices.size(), desc.data.data(), vertexCount, vertexSize);
+    data.resize(vertexCount * vertexSize);
+    desc.data = std::move(data);
+  }
+  if (stats != nullptr) {
+    stats->after = AnalyzeVertexCache(desc.indices.data(), desc.indices.size(), vertexCount, opt.cacheSize);
+  }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+
+#include "OpenGLContext.h"
+
+namespace Mine {
+
+struct VertexCacheStats {
+  float acmr;  //average cache miss ratio, transformed vertices per triangle. 0.5 ~ 3
+  float atvr;  //average transformed vertex ratio, 1 is perfect
+};
+
+/*
+ * FIFO post-transform cache simulation
+ */
+VertexCacheStats AnalyzeVertexCache(const unsigned int* indices,
+                                    size_t indexCount,
+                                    size_t vertexCount,
+                                    unsigned int cacheSize = 16);
+
+/*
+ * Tipsify (Sander et al. 2007), linear time triangle reorder for vertex cache.
+ * dst may not alias indices
+ */
+void OptimizeVertexCache(unsigned int* dst,
+                         const unsigned int* indices,
+                         size_t indexCount,
+                         size_t vertexCount,
+                         unsigned int cacheSize = 16);
+
+/*
+ * split cache optimized triangles into clusters, then sort clusters outside-in.
+ * a cluster keeps growing until its ACMR is below threshold * ACMR of input,
+ * so cache efficiency loses at most (threshold - 1).
+ * positionStride is in bytes, dst may not alias indices
+ */
+void OptimizeOverdraw(unsigned int* dst,
+                      const unsigned int* indices,
+                      size_t indexCount,
+                      const float* positions,
+                      size_t positionStride,
+                      size_t vertexCount,
+                      float threshold = 1.05f,
+                      unsigned int cacheSize = 16);
+
+/*
+ * reorder vertices by first use and rewrite indices in place.
+ * unreferenced vertices are dropped, returns new vertex count
+ */
+size_t OptimizeVertexFetch(void* dstVertices,
+                           unsigned int* indices,
+                           size_t indexCount,
+                           const void* vertices,
+                           size_t vertexCount,
+                           size_t vertexSize);
+
+struct MeshOptimizeDesc {
+  bool vertexCache;
+  bool overdraw;
+  bool vertexFetch;
+  float overdrawThreshold;
+  unsigned int cacheSize;
+  constexpr MeshOptimizeDesc() : vertexCache(true),
+                                 overdraw(true),
+                                 vertexFetch(true),
+                                 overdrawThreshold(1.05f),
+                                 cacheSize(16) {}
+};
+
+struct MeshOptimizeStats {
+  VertexCacheStats before;
+  VertexCacheStats after;
+};
+
+/*
+ * triangles are only reordered inside each submesh, ranges stay valid.
+ * run before QuantizeMeshDescOpenGL, overdraw pass reads float positions
+ */
+void OptimizeMeshDescOpenGL(GPUMeshDescOpenGL& desc,
+                            const MeshOptimizeDesc& opt = MeshOptimizeDesc(),
+                            MeshOptimizeStats* stats = nullptr);
+
+}  // namespace Mine
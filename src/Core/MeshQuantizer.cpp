@@ -0,0 +1,242 @@
+#include "MeshQuantizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace Mine;
+
+uint16_t Mine::FloatToHalf(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  uint32_t sign = (x >> 16) & 0x8000;
+  uint32_t abs = x & 0x7fffffff;
+  if (abs >= 0x7f800000) {  //inf, nan
+    return (uint16_t)(sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0));
+  }
+  if (abs >= 0x477ff000) {  //rounds above 65504
+    return (uint16_t)(sign | 0x7c00);
+  }
+  uint32_t r;
+  uint32_t rem;
+  uint32_t half;
+  if (abs < 0x38800000) {  //half subnormal
+    if (abs < 0x33000000) {
+      return (uint16_t)sign;
+    }
+    uint32_t m = (abs & 0x7fffff) | 0x800000;
+    uint32_t shift = 126 - (abs >> 23);
+    r = m >> shift;
+    rem = m & ((1u << shift) - 1);
+    half = 1u << (shift - 1);
+  } else {
+    r = (abs - 0x38000000) >> 13;
+    rem = abs & 0x1fff;
+    half = 0x1000;
+  }
+  if (rem > half || (rem == half && (r & 1))) {
+    r++;
+  }
+  return (uint16_t)(sign | r);
+}
+
+static int16_t _ToSnorm16(float v) { return (int16_t)std::lround(Clamp(v, -1, 1) * 32767.0f); }
+
+static uint16_t _ToUnorm16(float v) { return (uint16_t)std::lround(Clamp(v, 0, 1) * 65535.0f); }
+
+static uint32_t _ToInt2101010(const float* n) {
+  uint32_t result = 0;
+  for (int i = 0; i < 3; i++) {
+    auto v = (int32_t)std::lround(Clamp(n[i], -1, 1) * 511.0f);
+    result |= ((uint32_t)v & 0x3ff) << (i * 10);
+  }
+  return result;
+}
+
+static void _ToOct16(const float* n, int16_t* dst) {
+  float l1 = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+  float u = l1 > 0 ? n[0] / l1 : 0;
+  float v = l1 > 0 ? n[1] / l1 : 0;
+  if (n[2] < 0) {
+    float fu = (1 - std::abs(v)) * (u >= 0 ? 1.0f : -1.0f);
+    float fv = (1 - std::abs(u)) * (v >= 0 ? 1.0f : -1.0f);
+    u = fu;
+    v = fv;
+  }
+  dst[0] = _ToSnorm16(u);
+  dst[1] = _ToSnorm16(v);
+}
+
+static const VertexAttribDescOpenGL* _FindAttrib(const GPUMeshDescOpenGL& desc, GLuint index) {
+  for (const auto& a : desc.attribDesc) {
+    if (a.index == index) {
+      return &a;
+    }
+  }
+  return nullptr;
+}
+
+void Mine::QuantizeMeshDescOpenGL(GPUMeshDescOpenGL& desc, const VertexFormatDesc& format) {
+  if (desc.attribDesc.empty()) {
+    return;
+  }
+  auto pos = _FindAttrib(desc, 0);
+  auto tex = _FindAttrib(desc, 1);
+  auto nor = _FindAttrib(desc, 2);
+  if (pos == nullptr || pos->type != GL_FLOAT ||
+      (tex != nullptr && tex->type != GL_FLOAT) ||
+      (nor != nullptr && nor->type != GL_FLOAT)) {
+    throw "QuantizeMeshDescOpenGL needs float vertex data";
+  }
+  size_t srcStride = (size_t)pos->stride;
+  size_t vertexCount = desc.data.size() / srcStride;
+  auto source = [&](size_t v, const VertexAttribDescOpenGL* a) {
+    return (const float*)(desc.data.data() + v * srcStride + a->offset);
+  };
+
+  auto texFormat = format.texcoord;
+  if (tex != nullptr && texFormat == VertexTexcoordFormat::Unorm16) {
+    for (size_t v = 0; v < vertexCount; v++) {
+      auto t = source(v, tex);
+      if (t[0] < 0 || t[0] > 1 || t[1] < 0 || t[1] > 1) {
+        texFormat = VertexTexcoordFormat::Half;  //tiled uv
+        break;
+      }
+    }
+  }
+  Vector3 center(0, 0, 0);
+  float scale = 1;
+  if (format.position == VertexPositionFormat::Snorm16 && vertexCount > 0) {
+    Vector3 lo(source(0, pos)[0], source(0, pos)[1], source(0, pos)[2]);
+    Vector3 hi = lo;
+    for (size_t v = 1; v < vertexCount; v++) {
+      auto p = source(v, pos);
+      lo = Vector3(std::min(lo.x, p[0]), std::min(lo.y, p[1]), std::min(lo.z, p[2]));
+      hi = Vector3(std::max(hi.x, p[0]), std::max(hi.y, p[1]), std::max(hi.z, p[2]));
+    }
+    center = Mul(Add(lo, hi), 0.5f);
+    //uniform scale keeps normals valid under the decode matrix
+    scale = std::max(std::max(hi.x - lo.x, hi.y - lo.y), hi.z - lo.z) * 0.5f;
+    if (scale <= 0) {
+      scale = 1;
+    }
+  }
+
+  std::vector<VertexAttribDescOpenGL> attribs;
+  size_t stride = 0;
+  size_t posOffset = stride;
+  switch (format.position) {
+    case VertexPositionFormat::Float:
+      attribs.emplace_back(VertexAttribDescOpenGL{0, 3, GL_FLOAT, GL_FALSE, 0, stride});
+      stride += 12;
+      break;
+    case VertexPositionFormat::Half:
+      attribs.emplace_back(VertexAttribDescOpenGL{0, 3, GL_HALF_FLOAT, GL_FALSE, 0, stride});
+      stride += 8;
+      break;
+    case VertexPositionFormat::Snorm16:
+      attribs.emplace_back(VertexAttribDescOpenGL{0, 3, GL_SHORT, GL_TRUE, 0, stride});
+      stride += 8;
+      break;
+  }
+  size_t texOffset = stride;
+  if (tex != nullptr) {
+    switch (texFormat) {
+      case VertexTexcoordFormat::Float:
+        attribs.emplace_back(VertexAttribDescOpenGL{1, 2, GL_FLOAT, GL_FALSE, 0, stride});
+        stride += 8;
+        break;
+      case VertexTexcoordFormat::Half:
+        attribs.emplace_back(VertexAttribDescOpenGL{1, 2, GL_HALF_FLOAT, GL_FALSE, 0, stride});
+        stride += 4;
+        break;
+      case VertexTexcoordFormat::Unorm16:
+        attribs.emplace_back(VertexAttribDescOpenGL{1, 2, GL_UNSIGNED_SHORT, GL_TRUE, 0, stride});
+        stride += 4;
+        break;
+    }
+  }
+  size_t norOffset = stride;
+  if (nor != nullptr) {
+    switch (format.normal) {
+      case VertexNormalFormat::Float:
+        attribs.emplace_back(VertexAttribDescOpenGL{2, 3, GL_FLOAT, GL_FALSE, 0, stride});
+        stride += 12;
+        break;
+      case VertexNormalFormat::Int2101010:
+        attribs.emplace_back(VertexAttribDescOpenGL{2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 0, stride});
+        stride += 4;
+        break;
+      case VertexNormalFormat::Oct16:
+        attribs.emplace_back(VertexAttribDescOpenGL{VERTEX_NORMAL_OCT_LOCATION, 2, GL_SHORT, GL_TRUE, 0, stride});
+        stride += 4;
+        break;
+    }
+  }
+  for (auto& a : attribs) {
+    a.stride = (GLsizei)stride;
+  }
+
+  std::vector<unsigned char> data(vertexCount * stride, 0);
+  for (size_t v = 0; v < vertexCount; v++) {
+    unsigned char* dst = data.data() + v * stride;
+    auto p = source(v, pos);
+    switch (format.position) {
+      case VertexPositionFormat::Float:
+        memcpy(dst + posOffset, p, 12);
+        break;
+      case VertexPositionFormat::Half: {
+        uint16_t h[3] = {FloatToHalf(p[0]), FloatToHalf(p[1]), FloatToHalf(p[2])};
+        memcpy(dst + posOffset, h, sizeof(h));
+        break;
+      }
+      case VertexPositionFormat::Snorm16: {
+        int16_t s[3] = {_ToSnorm16((p[0] - center.x) / scale),
+                        _ToSnorm16((p[1] - center.y) / scale),
+                        _ToSnorm16((p[2] - center.z) / scale)};
+        memcpy(dst + posOffset, s, sizeof(s));
+        break;
+      }
+    }
+    if (tex != nullptr) {
+      auto t = source(v, tex);
+      switch (texFormat) {
+        case VertexTexcoordFormat::Float:
+          memcpy(dst + texOffset, t, 8);
+          break;
+        case VertexTexcoordFormat::Half: {
+          uint16_t h[2] = {FloatToHalf(t[0]), FloatToHalf(t[1])};
+          memcpy(dst + texOffset, h, sizeof(h));
+          break;
+        }
+        case VertexTexcoordFormat::Unorm16: {
+          uint16_t u[2] = {_ToUnorm16(t[0]), _ToUnorm16(t[1])};
+          memcpy(dst + texOffset, u, sizeof(u));
+          break;
+        }
+      }
+    }
+    if (nor != nullptr) {
+      auto n = source(v, nor);
+      switch (format.normal) {
+        case VertexNormalFormat::Float:
+          memcpy(dst + norOffset, n, 12);
+          break;
+        case VertexNormalFormat::Int2101010: {
+          uint32_t packed = _ToInt2101010(n);
+          memcpy(dst + norOffset, &packed, sizeof(packed));
+          break;
+        }
+        case VertexNormalFormat::Oct16: {
+          int16_t o[2];
+          _ToOct16(n, o);
+          memcpy(dst + norOffset, o, sizeof(o));
+          break;
+        }
+      }
+    }
+  }
+  desc.attribDesc = std::move(attribs);
+  desc.data = std::move(data);
+  desc.positionDecode = Vector4(center.x, center.y, center.z, scale);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+#include "OpenGLContext.h"
+
+namespace Mine {
+
+/*
+ * location of octahedral normals, a_Normal(2) stays unbound. shaders read them with NORMAL_OCT 1
+ */
+constexpr GLuint VERTEX_NORMAL_OCT_LOCATION = 3;
+
+enum class VertexPositionFormat {
+  Float,    //12 bytes
+  Half,     //8 bytes, one half of padding
+  Snorm16,  //8 bytes, bounds are in GPUMeshDescOpenGL::positionDecode
+};
+
+enum class VertexTexcoordFormat {
+  Float,    //8 bytes
+  Half,     //4 bytes
+  Unorm16,  //4 bytes, falls back to Half if any uv is outside [0, 1]
+};
+
+enum class VertexNormalFormat {
+  Float,       //12 bytes
+  Int2101010,  //4 bytes
+  Oct16,       //4 bytes, octahedral snorm16x2 at VERTEX_NORMAL_OCT_LOCATION, decoded in shader
+};
+
+struct VertexFormatDesc {
+  VertexPositionFormat position;
+  VertexTexcoordFormat texcoord;
+  VertexNormalFormat normal;
+  constexpr VertexFormatDesc() : VertexFormatDesc(VertexPositionFormat::Float,
+                                                  VertexTexcoordFormat::Float,
+                                                  VertexNormalFormat::Float) {}
+  constexpr VertexFormatDesc(VertexPositionFormat position, VertexTexcoordFormat texcoord, VertexNormalFormat normal)
+      : position(position), texcoord(texcoord), normal(normal) {}
+  /*
+   * half of float size, no model matrix change needed
+   */
+  static constexpr VertexFormatDesc Compact() {
+    return VertexFormatDesc(VertexPositionFormat::Half, VertexTexcoordFormat::Unorm16, VertexNormalFormat::Oct16);
+  }
+  constexpr uint32_t Hash() const { return (uint32_t)position | (uint32_t)texcoord << 2 | (uint32_t)normal << 4; }
+};
+
+/*
+ * round to nearest even, overflow becomes inf
+ */
+uint16_t FloatToHalf(float f);
+
+/*
+ * re-encode a float desc (as made by CreateMeshDescOpenGL) into format.
+ * attribute locations are kept except for Oct16 normals
+ */
+void QuantizeMeshDescOpenGL(GPUMeshDescOpenGL& desc, const VertexFormatDesc& format);
+
+}  // namespace Mine
@@ -0,0 +1,337 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
+
+#include "MeshOptimizer.h"
+
+using namespace Mine;
+
+/*
+ * symmetric 4x4 quadric, accumulated with area weight
+ */
+struct _Quadric {
+  double a00, a11, a22, a01, a02, a12;
+  double b0, b1, b2;
+  double c;
+  double w;
+
+  void Add(const _Quadric& q) {
+    a00 += q.a00;
+    a11 += q.a11;
+    a22 += q.a22;
+    a01 += q.a01;
+    a02 += q.a02;
+    a12 += q.a12;
+    b0 += q.b0;
+    b1 += q.b1;
+    b2 += q.b2;
+    c += q.c;
+    w += q.w;
+  }
+
+  double Error(const double* p) const {
+    double x = p[0];
+    double y = p[1];
+    double z = p[2];
+    double e = a00 * x * x + a11 * y * y + a22 * z * z +
+               2 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+               2 * (b0 * x + b1 * y + b2 * z) + c;
+    return w > 0 ? std::abs(e) / w : 0;
+  }
+
+  static _Quadric FromPlane(double nx, double ny, double nz, double d, double w) {
+    return _Quadric{w * nx * nx, w * ny * ny, w * nz * nz,
+                    w * nx * ny, w * nx * nz, w * ny * nz,
+                    w * nx * d, w * ny * d, w * nz * d,
+                    w * d * d, w};
+  }
+};
+
+struct _Collapse {
+  unsigned int from;
+  unsigned int to;
+  double error;
+};
+
+static void _Normal(const double* p0, const double* p1, const double* p2, double* n) {
+  double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+  double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+  n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+  n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+  n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+/*
+ * vertices sharing a position with another referenced vertex (attribute seam),
+ * or sitting on an edge used by one triangle only (border)
+ */
+static std::vector<char> _FindLockedVertices(const unsigned int* indices,
+                                             size_t indexCount,
+                                             const std::vector<double>& pos,
+                                             size_t vertexCount) {
+  std::vector<unsigned int> used;
+  std::vector<char> referenced(vertexCount, 0);
+  for (size_t i = 0; i < indexCount; i++) {
+    if (!referenced[indices[i]]) {
+      referenced[indices[i]] = 1;
+      used.emplace_back(indices[i]);
+    }
+  }
+  auto less = [&](unsigned int a, unsigned int b) {
+    return std::lexicographical_compare(&pos[a * 3], &pos[a * 3 + 3], &pos[b * 3], &pos[b * 3 + 3]);
+  };
+  std::sort(used.begin(), used.end(), less);
+  std::vector<unsigned int> canonical(vertexCount);
+  std::vector<char> locked(vertexCount, 0);
+  for (size_t i = 0; i < used.size();) {
+    size_t j = i + 1;
+    while (j < used.size() && !less(used[i], used[j])) {
+      j++;
+    }
+    for (size_t k = i; k < j; k++) {
+      canonical[used[k]] = used[i];
+      locked[used[k]] = j - i > 1;
+    }
+    i = j;
+  }
+
+  std::unordered_set<uint64_t> edges;
+  edges.reserve(indexCount);
+  for (size_t i = 0; i < indexCount; i += 3) {
+    for (int k = 0; k < 3; k++) {
+      uint64_t a = canonical[indices[i + k]];
+      uint64_t b = canonical[indices[i + (k + 1) % 3]];
+      edges.insert(a << 32 | b);
+    }
+  }
+  for (size_t i = 0; i < indexCount; i += 3) {
+    for (int k = 0; k < 3; k++) {
+      unsigned int a = indices[i + k];
+      unsigned int b = indices[i + (k + 1) % 3];
+      if (edges.count((uint64_t)canonical[b] << 32 | canonical[a]) == 0) {
+        locked[a] = 1;
+        locked[b] = 1;
+      }
+    }
+  }
+  return locked;
+}
+
+size_t Mine::SimplifyMesh(unsigned int* dst,
+                          const unsigned int* indices,
+                          size_t indexCount,
+                          const float* positions,
+                          size_t positionStride,
+                          size_t vertexCount,
+                          size_t targetIndexCount,
+                          float targetError,
+                          float* resultError) {
+  std::vector<double> pos(vertexCount * 3);
+  for (size_t v = 0; v < vertexCount; v++) {
+    auto p = (const float*)((const char*)positions + v * positionStride);
+    pos[v * 3] = p[0];
+    pos[v * 3 + 1] = p[1];
+    pos[v * 3 + 2] = p[2];
+  }
+  auto locked = _FindLockedVertices(indices, indexCount, pos, vertexCount);
+
+  std::vector<_Quadric> quadrics(vertexCount, _Quadric{});
+  for (size_t i = 0; i < indexCount; i += 3) {
+    const double* p0 = &pos[indices[i] * 3];
+    double n[3];
+    _Normal(p0, &pos[indices[i + 1] * 3], &pos[indices[i + 2] * 3], n);
+    double len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (len == 0) {
+      continue;
+    }
+    n[0] /= len;
+    n[1] /= len;
+    n[2] /= len;
+    auto q = _Quadric::FromPlane(n[0], n[1], n[2], -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]), len * 0.5);
+    for (int k = 0; k < 3; k++) {
+      quadrics[indices[i + k]].Add(q);
+    }
+  }
+
+  std::vector<unsigned int> current(indices, indices + indexCount);
+  std::vector<unsigned int> remap(vertexCount);
+  std::vector<char> touched(vertexCount);
+  std::vector<unsigned int> adjOffsets(vertexCount + 1);
+  std::vector<unsigned int> adjTriangles;
+  std::vector<_Collapse> collapses;
+  double maxError = 0;
+  double errorLimit = (double)targetError * targetError;
+
+  while (current.size() > targetIndexCount) {
+    //vertex -> triangles of this pass
+    std::fill(adjOffsets.begin(), adjOffsets.end(), 0);
+    for (auto v : current) {
+      adjOffsets[v + 1]++;
+    }
+    for (size_t v = 0; v < vertexCount; v++) {
+      adjOffsets[v + 1] += adjOffsets[v];
+    }
+    adjTriangles.resize(current.size());
+    {
+      std::vector<unsigned int> cursor(adjOffsets.begin(), adjOffsets.end() - 1);
+      for (size_t i = 0; i < current.size(); i++) {
+        adjTriangles[cursor[current[i]]++] = (unsigned int)(i / 3);
+      }
+    }
+
+    collapses.clear();
+    for (size_t i = 0; i < current.size(); i += 3) {
+      for (int k = 0; k < 3; k++) {
+        unsigned int from = current[i + k];
+        unsigned int to = current[i + (k + 1) % 3];
+        for (int dir = 0; dir < 2; dir++) {
+          if (!locked[from]) {
+            _Quadric q = quadrics[from];
+            q.Add(quadrics[to]);
+            double e = q.Error(&pos[to * 3]);
+            if (e <= errorLimit) {
+              collapses.emplace_back(_Collapse{from, to, e});
+            }
+          }
+          std::swap(from, to);
+        }
+      }
+    }
+    if (collapses.empty()) {
+      break;
+    }
+    std::sort(collapses.begin(), collapses.end(), [](const _Collapse& a, const _Collapse& b) {
+      return a.error < b.error;
+    });
+
+    for (size_t v = 0; v < vertexCount; v++) {
+      remap[v] = (unsigned int)v;
+    }
+    std::fill(touched.begin(), touched.end(), 0);
+    size_t triangles = current.size() / 3;
+    size_t target = targetIndexCount / 3;
+    size_t applied = 0;
+    for (const auto& c : collapses) {
+      if (triangles <= target) {
+        break;
+      }
+      if (touched[c.from] || touched[c.to]) {
+        continue;
+      }
+      //reject collapses that flip a remaining triangle, count the ones that disappear
+      bool flip = false;
+      size_t removed = 0;
+      for (unsigned int a = adjOffsets[c.from]; a < adjOffsets[c.from + 1] && !flip; a++) {
+        const unsigned int* tri = &current[adjTriangles[a] * 3];
+        if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+          removed++;
+          continue;
+        }
+        const double* p[3];
+        const double* q[3];
+        for (int k = 0; k < 3; k++) {
+          p[k] = &pos[tri[k] * 3];
+          q[k] = tri[k] == c.from ? &pos[c.to * 3] : p[k];
+        }
+        double n0[3];
+        double n1[3];
+        _Normal(p[0], p[1], p[2], n0);
+        _Normal(q[0], q[1], q[2], n1);
+        flip = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0;
+      }
+      if (flip) {
+        continue;
+      }
+      remap[c.from] = c.to;
+      quadrics[c.to].Add(quadrics[c.from]);
+      maxError = std::max(maxError, c.error);
+      triangles -= removed;
+      applied++;
+      //neighbourhood changed, its costs and flip tests are stale until next pass
+      for (unsigned int a = adjOffsets[c.from]; a < adjOffsets[c.from + 1]; a++) {
+        const unsigned int* tri = &current[adjTriangles[a] * 3];
+        touched[tri[0]] = 1;
+        touched[tri[1]] = 1;
+        touched[tri[2]] = 1;
+      }
+    }
+    if (applied == 0) {
+      break;
+    }
+
+    size_t out = 0;
+    for (size_t i = 0; i < current.size(); i += 3) {
+      unsigned int a = remap[current[i]];
+      unsigned int b = remap[current[i + 1]];
+      unsigned int c = remap[current[i + 2]];
+      if (a != b && b != c && c != a) {
+        current[out++] = a;
+        current[out++] = b;
+        current[out++] = c;
+      }
+    }
+    current.resize(out);
+  }
+
+  memcpy(dst, current.data(), current.size() * sizeof(unsigned int));
+  if (resultError != nullptr) {
+    *resultError = (float)std::sqrt(maxError);
+  }
+  return current.size();
+}
+
+void Mine::GenerateLodMeshDescOpenGL(GPUMeshDescOpenGL& desc, const MeshLodDesc& lod) {
+  if (desc.attribDesc.empty() || desc.indices.empty()) {
+    return;
+  }
+  size_t stride = (size_t)desc.attribDesc[0].stride;
+  size_t vertexCount = desc.data.size() / stride;
+  auto positions = (const float*)(desc.data.data() + desc.attribDesc[0].offset);
+  float lo[3] = {positions[0], positions[1], positions[2]};
+  float hi[3] = {lo[0], lo[1], lo[2]};
+  for (size_t v = 0; v < vertexCount; v++) {
+    auto p = (const float*)((const char*)positions + v * stride);
+    for (int k = 0; k < 3; k++) {
+      lo[k] = std::min(lo[k], p[k]);
+      hi[k] = std::max(hi[k], p[k]);
+    }
+  }
+  float extent = std::max(std::max(hi[0] - lo[0], hi[1] - lo[1]), hi[2] - lo[2]);
+
+  std::vector<unsigned int> lodIndices;
+  std::vector<unsigned int> cached;
+  for (auto& s : desc.subMeshes) {
+    s.lods.clear();
+    std::vector<unsigned int> source(desc.indices.begin() + s.indexOffset,
+                                     desc.indices.begin() + s.indexOffset + s.indexCount);
+    for (int level = 0; level < lod.levelCount; level++) {
+      size_t target = (size_t)(source.size() / 3 * lod.reduction) * 3;
+      lodIndices.resize(source.size());
+      float error = 0;
+      size_t count = SimplifyMesh(lodIndices.data(),
+                                  source.data(),
+                                  source.size(),
+                                  positions,
+                                  stride,
+                                  vertexCount,
+                                  target,
+                                  lod.maxError * extent,
+                                  &error);
+      //not worth another draw range
+      if (count == 0 || count > source.size() * 4 / 5) {
+        break;
+      }
+      cached.resize(count);
+      OptimizeVertexCache(cached.data(), lodIndices.data(), count, vertexCount);
+      //each level is simplified from the previous one, errors add up
+      float previous = s.lods.empty() ? 0 : s.lods.back().error;
+      s.lods.emplace_back(MeshLodDescOpenGL{(GLsizei)desc.indices.size(), (GLsizei)count, previous + error});
+      desc.indices.insert(desc.indices.end(), cached.begin(), cached.end());
+      source.assign(cached.begin(), cached.end());
+    }
+  }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+
+#include "OpenGLContext.h"
+
+namespace Mine {
+
+/*
+ * quadric error metric edge collapse (Garland & Heckbert 1997).
+ * vertices only collapse onto existing vertices, so the result indexes the same vertex buffer.
+ * uv/normal seams and open borders are locked.
+ * stops at targetIndexCount or when the next collapse costs more than targetError,
+ * returns index count written to dst, error is distance in position units
+ */
+size_t SimplifyMesh(unsigned int* dst,
+                    const unsigned int* indices,
+                    size_t indexCount,
+                    const float* positions,
+                    size_t positionStride,
+                    size_t vertexCount,
+                    size_t targetIndexCount,
+                    float targetError,
+                    float* resultError = nullptr);
+
+struct MeshLodDesc {
+  int levelCount;   //coarser levels after the source mesh
+  float reduction;  //triangle ratio between levels
+  float maxError;   //relative to mesh extent
+  constexpr MeshLodDesc() : levelCount(3), reduction(0.5f), maxError(0.05f) {}
+};
+
+/*
+ * append lod index ranges of every submesh to desc.indices.
+ * run after OptimizeMeshDescOpenGL and before QuantizeMeshDescOpenGL
+ */
+void GenerateLodMeshDescOpenGL(GPUMeshDescOpenGL& desc, const MeshLodDesc& lod = MeshLodDesc());
+
+}  // namespace Mine
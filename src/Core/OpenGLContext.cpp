@@ -1,10 +1,13 @@
 #include "OpenGLContext.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <streambuf>
 #include <cassert>
+#include <type_traits>
 
 using namespace Mine;
 
@@ -90,6 +93,299 @@ static void _DefaultGLError(GLenum source,
   std::cout << "][" << id << "]:" << message << "\n";
 }
 
+static FrameStatsOpenGL _frameStats;
+static FrameStatsOpenGL _lastFrameStats;
+
+static void _EndFrameStats() {
+  _lastFrameStats = _frameStats;
+  _frameStats = FrameStatsOpenGL();
+}
+
+const FrameStatsOpenGL& Mine::GetFrameStatsOpenGL() { return _lastFrameStats; }
+
+static constexpr GLuint _UNKNOWN_HANDLE = ~0u;
+static constexpr int _MAX_CACHED_TEXTURE_UNITS = 32;
+static constexpr int _MAX_CACHED_BUFFER_BASES = 16;
+
+struct _BufferBinding {
+  GLenum target;
+  GLuint buffer;
+  GLuint bases[_MAX_CACHED_BUFFER_BASES];
+};
+
+struct _CapState {
+  GLenum cap;
+  int enabled;  //-1 unknown
+};
+
+struct _StateCache {
+  GLuint program;
+  GLuint vao;
+  GLuint drawFrameBuffer;
+  GLuint readFrameBuffer;
+  GLuint activeUnit;
+  GLuint textures[_MAX_CACHED_TEXTURE_UNITS];  //GL_TEXTURE_2D per unit
+  GLuint samplers[_MAX_CACHED_TEXTURE_UNITS];
+  _BufferBinding buffers[5] = {{GL_ARRAY_BUFFER},
+                               {GL_UNIFORM_BUFFER},
+                               {GL_SHADER_STORAGE_BUFFER},
+                               {GL_DRAW_INDIRECT_BUFFER},
+                               {GL_PIXEL_UNPACK_BUFFER}};
+  _CapState caps[5] = {{GL_DEPTH_TEST}, {GL_CULL_FACE}, {GL_BLEND}, {GL_SCISSOR_TEST}, {GL_POLYGON_OFFSET_FILL}};
+  GLint viewport[4];
+  float clearColor[4];
+  bool clearColorValid;
+  GLuint emptyVao;  //owned by the context, core profile draws need a vao even without attributes
+};
+
+static _StateCache _state;
+
+static bool _StateMatches(bool same) {
+  if (same) {
+    _frameStats.stateSkipped++;
+  } else {
+    _frameStats.stateCalls++;
+  }
+  return same;
+}
+
+static _BufferBinding* _FindBufferBinding(GLenum target) {
+  for (auto& b : _state.buffers) {
+    if (b.target == target) {
+      return &b;
+    }
+  }
+  return nullptr;
+}
+
+void Mine::InvalidateStateCacheOpenGL() {
+  _state.program = _UNKNOWN_HANDLE;
+  _state.vao = _UNKNOWN_HANDLE;
+  _state.drawFrameBuffer = _UNKNOWN_HANDLE;
+  _state.readFrameBuffer = _UNKNOWN_HANDLE;
+  _state.activeUnit = _UNKNOWN_HANDLE;
+  for (auto& t : _state.textures) {
+    t = _UNKNOWN_HANDLE;
+  }
+  for (auto& t : _state.samplers) {
+    t = _UNKNOWN_HANDLE;
+  }
+  for (auto& b : _state.buffers) {
+    b.buffer = _UNKNOWN_HANDLE;
+    for (auto& base : b.bases) {
+      base = _UNKNOWN_HANDLE;
+    }
+  }
+  for (auto& c : _state.caps) {
+    c.enabled = -1;
+  }
+  for (auto& v : _state.viewport) {
+    v = -1;
+  }
+  _state.clearColorValid = false;
+}
+
+//gl unbinds deleted objects, and their names may come back from glGen*
+static void _ForgetHandle(GLuint& cached, GLuint handle) {
+  if (cached == handle) {
+    cached = _UNKNOWN_HANDLE;
+  }
+}
+
+static void _ForgetBuffer(GLuint handle) {
+  for (auto& b : _state.buffers) {
+    _ForgetHandle(b.buffer, handle);
+    for (auto& base : b.bases) {
+      _ForgetHandle(base, handle);
+    }
+  }
+}
+
+static void _ForgetTexture(GLuint handle) {
+  for (auto& t : _state.textures) {
+    _ForgetHandle(t, handle);
+  }
+}
+
+static void _ForgetSampler(GLuint handle) {
+  for (auto& t : _state.samplers) {
+    _ForgetHandle(t, handle);
+  }
+}
+
+void Mine::UseProgramOpenGL(GLuint program) {
+  if (_StateMatches(_state.program == program)) {
+    return;
+  }
+  MineGLFuncCall(glUseProgram(program));
+  _state.program = program;
+}
+
+void Mine::BindVertexArrayOpenGL(GLuint vao) {
+  if (_StateMatches(_state.vao == vao)) {
+    return;
+  }
+  MineGLFuncCall(glBindVertexArray(vao));
+  _state.vao = vao;
+}
+
+void Mine::BindBufferOpenGL(GLenum target, GLuint buffer) {
+  auto binding = _FindBufferBinding(target);
+  if (binding != nullptr && _StateMatches(binding->buffer == buffer)) {
+    return;
+  }
+  if (binding == nullptr) {
+    _frameStats.stateCalls++;
+  }
+  MineGLFuncCall(glBindBuffer(target, buffer));
+  if (binding != nullptr) {
+    binding->buffer = buffer;
+  }
+}
+
+void Mine::BindBufferBaseOpenGL(GLenum target, GLuint index, GLuint buffer) {
+  auto binding = _FindBufferBinding(target);
+  bool cached = binding != nullptr && index < _MAX_CACHED_BUFFER_BASES;
+  if (cached && _StateMatches(binding->bases[index] == buffer && binding->buffer == buffer)) {
+    return;
+  }
+  if (!cached) {
+    _frameStats.stateCalls++;
+  }
+  MineGLFuncCall(glBindBufferBase(target, index, buffer));
+  if (binding != nullptr) {
+    binding->buffer = buffer;  //also binds the generic point
+    if (cached) {
+      binding->bases[index] = buffer;
+    }
+  }
+}
+
+void Mine::BindBufferRangeOpenGL(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+  _frameStats.stateCalls++;
+  MineGLFuncCall(glBindBufferRange(target, index, buffer, offset, size));
+  auto binding = _FindBufferBinding(target);
+  if (binding != nullptr) {
+    binding->buffer = buffer;
+    if (index < _MAX_CACHED_BUFFER_BASES) {
+      binding->bases[index] = _UNKNOWN_HANDLE;  //a later base bind of the same buffer must go through
+    }
+  }
+}
+
+GLsizeiptr Mine::GetBufferOffsetAlignmentOpenGL(GLenum target) {
+  GLint alignment = 4;
+  if (target == GL_UNIFORM_BUFFER) {
+    MineGLFuncCall(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment));
+  } else if (target == GL_SHADER_STORAGE_BUFFER) {
+    MineGLFuncCall(glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment));
+  }
+  return alignment;
+}
+
+void Mine::BindTextureOpenGL(GLuint unit, GLenum target, GLuint texture) {
+  bool cached = target == GL_TEXTURE_2D && unit < _MAX_CACHED_TEXTURE_UNITS;
+  if (cached && _StateMatches(_state.textures[unit] == texture)) {
+    return;
+  }
+  if (!cached) {
+    _frameStats.stateCalls++;
+  }
+  if (_state.activeUnit != unit) {
+    MineGLFuncCall(glActiveTexture(GL_TEXTURE0 + unit));
+    _state.activeUnit = unit;
+  }
+  MineGLFuncCall(glBindTexture(target, texture));
+  if (cached) {
+    _state.textures[unit] = texture;
+  }
+}
+
+void Mine::DrawFullScreenTriangleOpenGL() {
+  if (_state.emptyVao == 0) {
+    MineGLFuncCall(glGenVertexArrays(1, &_state.emptyVao));
+  }
+  BindVertexArrayOpenGL(_state.emptyVao);
+  MineGLFuncCall(glDrawArrays(GL_TRIANGLES, 0, 3));
+}
+
+void Mine::BindSamplerOpenGL(GLuint unit, GLuint sampler) {
+  bool cached = unit < _MAX_CACHED_TEXTURE_UNITS;
+  if (cached && _StateMatches(_state.samplers[unit] == sampler)) {
+    return;
+  }
+  if (!cached) {
+    _frameStats.stateCalls++;
+  }
+  MineGLFuncCall(glBindSampler(unit, sampler));
+  if (cached) {
+    _state.samplers[unit] = sampler;
+  }
+}
+
+void Mine::BindFrameBufferOpenGL(GLenum target, GLuint frameBuffer) {
+  bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+  bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+  if (_StateMatches((!draw || _state.drawFrameBuffer == frameBuffer) && (!read || _state.readFrameBuffer == frameBuffer))) {
+    return;
+  }
+  MineGLFuncCall(glBindFramebuffer(target, frameBuffer));
+  if (draw) {
+    _state.drawFrameBuffer = frameBuffer;
+  }
+  if (read) {
+    _state.readFrameBuffer = frameBuffer;
+  }
+}
+
+void Mine::SetViewportOpenGL(GLint x, GLint y, GLsizei width, GLsizei height) {
+  auto& v = _state.viewport;
+  if (_StateMatches(v[0] == x && v[1] == y && v[2] == width && v[3] == height)) {
+    return;
+  }
+  MineGLFuncCall(glViewport(x, y, width, height));
+  v[0] = x;
+  v[1] = y;
+  v[2] = width;
+  v[3] = height;
+}
+
+void Mine::SetEnableOpenGL(GLenum cap, bool enable) {
+  _CapState* state = nullptr;
+  for (auto& c : _state.caps) {
+    if (c.cap == cap) {
+      state = &c;
+    }
+  }
+  if (state != nullptr && _StateMatches(state->enabled == (int)enable)) {
+    return;
+  }
+  if (state == nullptr) {
+    _frameStats.stateCalls++;
+  }
+  if (enable) {
+    MineGLFuncCall(glEnable(cap));
+  } else {
+    MineGLFuncCall(glDisable(cap));
+  }
+  if (state != nullptr) {
+    state->enabled = enable;
+  }
+}
+
+void Mine::SetClearColorOpenGL(float r, float g, float b, float a) {
+  auto& c = _state.clearColor;
+  if (_StateMatches(_state.clearColorValid && c[0] == r && c[1] == g && c[2] == b && c[3] == a)) {
+    return;
+  }
+  MineGLFuncCall(glClearColor(r, g, b, a));
+  c[0] = r;
+  c[1] = g;
+  c[2] = b;
+  c[3] = a;
+  _state.clearColorValid = true;
+}
+
 #ifdef MINE_PLATFORM_WIN32
 #include <GLFW/glfw3.h>
 
@@ -131,14 +427,22 @@ void Mine::InitOpenGL(int width, int height, const char* title) {
   MineGLFuncCall(glDebugMessageCallback(_DefaultGLError, nullptr));
 #endif
   glfwSetFramebufferSizeCallback(_window, _OnFrameBufferResize);
+  InvalidateStateCacheOpenGL();
+  _state.emptyVao = 0;  //names of an earlier context are gone
 }
 
 void Mine::TerminateOpenGL() {
+  if (_window != nullptr && _state.emptyVao != 0) {
+    MineGLFuncCall(glDeleteVertexArrays(1, &_state.emptyVao));
+    _ForgetHandle(_state.vao, _state.emptyVao);
+  }
+  _state.emptyVao = 0;
   glfwTerminate();
   _window = nullptr;
 }
 
 bool Mine::ShouldTerminateOpenGL() {
+  _EndFrameStats();
   glfwSwapBuffers(_window);
   glfwPollEvents();
   return glfwWindowShouldClose(_window);
@@ -164,7 +468,7 @@ GPUBufferOpenGL::GPUBufferOpenGL() : _handle(0), _size(0), _target(0), _usage(0)
 
 GPUBufferOpenGL::GPUBufferOpenGL(GLenum target, GLenum usage, const void* data, GLsizeiptr size) {
   MineGLFuncCall(glGenBuffers(1, &_handle));
-  MineGLFuncCall(glBindBuffer(target, _handle));
+  BindBufferOpenGL(target, _handle);
   MineGLFuncCall(glBufferData(target, size, data, usage));
   _size = size;
   _target = target;
@@ -193,12 +497,23 @@ GPUBufferOpenGL& GPUBufferOpenGL::operator=(GPUBufferOpenGL&& o) noexcept {
 }
 
 void GPUBufferOpenGL::Bind() const {
-  MineGLFuncCall(glBindBuffer(_target, _handle));
+  BindBufferOpenGL(_target, _handle);
+}
+
+void GPUBufferOpenGL::BindBase(GLuint index) const {
+  BindBufferBaseOpenGL(_target, index, _handle);
+}
+
+void GPUBufferOpenGL::SetSubData(GLintptr offset, const void* data, GLsizeiptr size) const {
+  assert(offset + size <= _size);
+  Bind();
+  MineGLFuncCall(glBufferSubData(_target, offset, size, data));
 }
 
 void GPUBufferOpenGL::Delete() {
   if (_handle != 0) {
     MineGLFuncCall(glDeleteBuffers(1, &_handle));
+    _ForgetBuffer(_handle);
   }
   _handle = 0;
 }
@@ -227,19 +542,114 @@ void Mine::LogGLFuncCall(const char* filename, int lineNum) {
   }
 }
 
-GPUMeshOpenGL::GPUMeshOpenGL() : _vao(0), _vbo(), _ebo() {}
+GLenum Mine::SelectIndexTypeOpenGL(size_t vertexCount) {
+  return vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+size_t Mine::IndexSizeOpenGL(GLenum indexType) {
+  return indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+}
+
+std::vector<unsigned char> Mine::PackIndicesOpenGL(const std::vector<unsigned int>& indices, GLenum indexType) {
+  std::vector<unsigned char> result(indices.size() * IndexSizeOpenGL(indexType));
+  if (indexType == GL_UNSIGNED_SHORT) {
+    auto dst = (unsigned short*)result.data();
+    for (size_t i = 0; i < indices.size(); i++) {
+      dst[i] = (unsigned short)indices[i];
+    }
+  } else {
+    memcpy(result.data(), indices.data(), result.size());
+  }
+  return result;
+}
 
-GPUMeshOpenGL::GPUMeshOpenGL(const GPUMeshDescOpenGL& desc) {
-  _vbo = GPUBufferOpenGL(GL_ARRAY_BUFFER, GL_STATIC_DRAW, desc.data.data(), desc.data.size() * sizeof(float));
+void Mine::ComputeSubMeshBoundsOpenGL(GPUMeshDescOpenGL& desc) {
+  if (desc.attribDesc.empty()) {
+    return;
+  }
+  size_t stride = (size_t)desc.attribDesc[0].stride;
+  const unsigned char* positions = desc.data.data() + desc.attribDesc[0].offset;
+  auto position = [&](unsigned int v) {
+    auto p = (const float*)(positions + v * stride);
+    return Vector3(p[0], p[1], p[2]);
+  };
+  for (auto& s : desc.subMeshes) {
+    if (s.indexCount == 0) {
+      continue;
+    }
+    const unsigned int* indices = desc.indices.data() + s.indexOffset;
+    auto first = position(indices[0]);
+    BoundingBox box(first, first);
+    for (GLsizei i = 1; i < s.indexCount; i++) {
+      auto p = position(indices[i]);
+      box = Merge(box, BoundingBox(p, p));
+    }
+    BoundingSphere sphere(box.Center(), 0);
+    for (GLsizei i = 0; i < s.indexCount; i++) {
+      sphere.radius = std::max(sphere.radius, Length(Sub(position(indices[i]), sphere.center)));
+    }
+    s.bounds = box;
+    s.sphere = sphere;
+  }
+}
+
+GPUMeshOpenGL::GPUMeshOpenGL() : _vao(0), _vbo(), _ebo(), _indexType(GL_UNSIGNED_INT), _indexCount(0), _positionDecode(0, 0, 0, 1) {}
+
+GPUMeshOpenGL::GPUMeshOpenGL(const GPUMeshDescOpenGL& desc) : GPUMeshOpenGL() {
+  auto indices = PackIndicesOpenGL(desc.indices, desc.indexType);
+  *this = GPUMeshOpenGL(desc.attribDesc,
+                        desc.data.data(),
+                        desc.data.size(),
+                        indices.data(),
+                        indices.size(),
+                        desc.indexType,
+                        desc.subMeshes,
+                        desc.positionDecode);
+}
+
+GPUMeshOpenGL::GPUMeshOpenGL(const std::vector<VertexAttribDescOpenGL>& attribDesc,
+                             const void* vertexData,
+                             GLsizeiptr vertexSize,
+                             const void* indexData,
+                             GLsizeiptr indexSize,
+                             GLenum indexType,
+                             std::vector<SubMeshDescOpenGL> subMeshes,
+                             const Vector4& positionDecode) {
+  _vbo = GPUBufferOpenGL(GL_ARRAY_BUFFER, GL_STATIC_DRAW, vertexData, vertexSize);
   _vbo.Bind();
+  _attribDesc = attribDesc;
   MineGLFuncCall(glGenVertexArrays(1, &_vao));
-  MineGLFuncCall(glBindVertexArray(_vao));
-  for (const auto& d : desc.attribDesc) {
-    MineGLFuncCall(glVertexAttribPointer(d.index, d.size, d.type, GL_FALSE, d.stride, (void*)(d.offset)));
+  BindVertexArrayOpenGL(_vao);
+  for (const auto& d : attribDesc) {
+    MineGLFuncCall(glVertexAttribPointer(d.index, d.size, d.type, d.normalized, d.stride, (void*)(d.offset)));
     MineGLFuncCall(glEnableVertexAttribArray(d.index));
   }
-  MineGLFuncCall(glBindVertexArray(0));
-  _ebo = GPUBufferOpenGL(GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW, desc.indices.data(), desc.indices.size() * sizeof(unsigned int));
+  //created while the vao is bound, so the vao keeps the index buffer
+  _ebo = GPUBufferOpenGL(GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW, indexData, indexSize);
+  BindVertexArrayOpenGL(0);
+  _indexType = indexType;
+  //lod ranges follow the submeshes, whole mesh draw stops before them
+  _indexCount = (GLsizei)(indexSize / IndexSizeOpenGL(indexType));
+  for (const auto& s : subMeshes) {
+    if (!s.lods.empty()) {
+      _indexCount = std::min(_indexCount, s.lods.front().indexOffset);
+    }
+  }
+  _subMeshes = std::move(subMeshes);
+  _positionDecode = positionDecode;
+  _bounds = BoundingBox();
+  _sphere = BoundingSphere();
+  if (!_subMeshes.empty()) {
+    _bounds = _subMeshes[0].bounds;
+    for (const auto& s : _subMeshes) {
+      _bounds = Merge(_bounds, s.bounds);
+    }
+    //enclose submesh spheres around box center
+    _sphere.center = _bounds.Center();
+    for (const auto& s : _subMeshes) {
+      _sphere.radius = std::max(_sphere.radius, Length(Sub(s.sphere.center, _sphere.center)) + s.sphere.radius);
+    }
+  }
 }
 
 GPUMeshOpenGL::GPUMeshOpenGL(GPUMeshOpenGL&& o) noexcept {
@@ -247,6 +657,13 @@ GPUMeshOpenGL::GPUMeshOpenGL(GPUMeshOpenGL&& o) noexcept {
   o._vao = 0;
   _vbo = std::move(o._vbo);
   _ebo = std::move(o._ebo);
+  _attribDesc = std::move(o._attribDesc);
+  _indexType = o._indexType;
+  _indexCount = o._indexCount;
+  _subMeshes = std::move(o._subMeshes);
+  _positionDecode = o._positionDecode;
+  _bounds = o._bounds;
+  _sphere = o._sphere;
 }
 
 GPUMeshOpenGL::~GPUMeshOpenGL() {
@@ -258,17 +675,23 @@ GPUMeshOpenGL& GPUMeshOpenGL::operator=(GPUMeshOpenGL&& o) noexcept {
   o._vao = 0;
   _vbo = std::move(o._vbo);
   _ebo = std::move(o._ebo);
+  _attribDesc = std::move(o._attribDesc);
+  _indexType = o._indexType;
+  _indexCount = o._indexCount;
+  _subMeshes = std::move(o._subMeshes);
+  _positionDecode = o._positionDecode;
+  _bounds = o._bounds;
+  _sphere = o._sphere;
   return *this;
 }
 void GPUMeshOpenGL::Bind() const {
-  _vbo.Bind();
-  MineGLFuncCall(glBindVertexArray(_vao));
-  _ebo.Bind();
+  BindVertexArrayOpenGL(_vao);
 }
 
 void GPUMeshOpenGL::Delete() {
   if (_vao != 0) {
     MineGLFuncCall(glDeleteVertexArrays(1, &_vao));
+    _ForgetHandle(_state.vao, _vao);
   }
   _vao = 0;
   _vbo.Delete();
@@ -276,72 +699,300 @@ void GPUMeshOpenGL::Delete() {
 }
 
 GLsizei GPUMeshOpenGL::GetIndexCount() const {
-  return (GLsizei)(_ebo.GetSize() / sizeof(unsigned int));
+  return _indexCount;
 }
 
-struct _Temp {
-  int v, t, n;
-};
-bool operator<(const _Temp& a, const _Temp& b) { return a.v == b.v ? (a.t == b.t ? a.n < b.n : a.t < b.t) : a.v < b.v; }
+GLenum GPUMeshOpenGL::GetIndexType() const { return _indexType; }
+
+std::pair<GLsizei, GLsizei> GPUMeshOpenGL::GetIndexRange(int subMesh, int lod) const {
+  if (subMesh < 0) {
+    return std::make_pair(0, _indexCount);
+  }
+  const auto& sub = _subMeshes[subMesh];
+  if (lod > 0 && lod <= (int)sub.lods.size()) {
+    return std::make_pair(sub.lods[lod - 1].indexOffset, sub.lods[lod - 1].indexCount);
+  }
+  return std::make_pair(sub.indexOffset, sub.indexCount);
+}
+
+const std::vector<VertexAttribDescOpenGL>& GPUMeshOpenGL::GetAttribDesc() const { return _attribDesc; }
+
+const GPUBufferOpenGL& GPUMeshOpenGL::GetVertexBuffer() const { return _vbo; }
+
+const GPUBufferOpenGL& GPUMeshOpenGL::GetIndexBuffer() const { return _ebo; }
+
+void GPUMeshOpenGL::BindInstanceBuffer(GLuint buffer, GLintptr offset) const {
+  BindVertexArrayOpenGL(_vao);
+  BindBufferOpenGL(GL_ARRAY_BUFFER, buffer);
+  for (GLuint i = 0; i < 4; i++) {
+    GLuint index = INSTANCE_MODEL_ATTRIB_LOCATION + i;
+    MineGLFuncCall(glVertexAttribPointer(index, 4, GL_FLOAT, GL_FALSE, sizeof(Matrix4x4), (void*)(offset + i * sizeof(Vector4))));
+    MineGLFuncCall(glVertexAttribDivisor(index, 1));
+    MineGLFuncCall(glEnableVertexAttribArray(index));
+  }
+}
+
+static bool _SameAttribDesc(const std::vector<VertexAttribDescOpenGL>& a, const std::vector<VertexAttribDescOpenGL>& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].index != b[i].index || a[i].size != b[i].size || a[i].type != b[i].type ||
+        a[i].normalized != b[i].normalized || a[i].stride != b[i].stride || a[i].offset != b[i].offset) {
+      return false;
+    }
+  }
+  return true;
+}
+
+//replace buffer by one of at least required bytes that keeps the used part
+static void _GrowBuffer(GPUBufferOpenGL& buffer, GLenum target, GLsizeiptr used, GLsizeiptr required) {
+  GLsizeiptr size = std::max<GLsizeiptr>(buffer.GetSize(), 1 << 16);
+  while (size < required) {
+    size *= 2;
+  }
+  GPUBufferOpenGL result(target, GL_STATIC_DRAW, nullptr, size);
+  if (used > 0) {
+    BindBufferOpenGL(GL_COPY_READ_BUFFER, buffer.GetHandle());
+    BindBufferOpenGL(GL_COPY_WRITE_BUFFER, result.GetHandle());
+    MineGLFuncCall(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used));
+  }
+  buffer.Delete();
+  buffer = std::move(result);
+}
+
+MeshPoolOpenGL::MeshPoolOpenGL() : _vao(0), _indexType(GL_UNSIGNED_INT), _vertexUsed(0), _indexUsed(0), _drawIdCount(0) {}
+
+MeshPoolOpenGL::MeshPoolOpenGL(const std::vector<VertexAttribDescOpenGL>& attribDesc, GLenum indexType) : MeshPoolOpenGL() {
+  _attribDesc = attribDesc;
+  _indexType = indexType;
+  MineGLFuncCall(glGenVertexArrays(1, &_vao));
+  BindVertexArrayOpenGL(_vao);  //index buffer binds land in our own vao
+  _GrowBuffer(_vbo, GL_ARRAY_BUFFER, 0, 0);
+  _GrowBuffer(_ebo, GL_ELEMENT_ARRAY_BUFFER, 0, 0);
+  ReserveDraws(256);
+}
+
+MeshPoolOpenGL::MeshPoolOpenGL(MeshPoolOpenGL&& o) noexcept : MeshPoolOpenGL() {
+  *this = std::move(o);
+}
+
+MeshPoolOpenGL::~MeshPoolOpenGL() {
+  Delete();
+}
+
+MeshPoolOpenGL& MeshPoolOpenGL::operator=(MeshPoolOpenGL&& o) noexcept {
+  if (this == &o) {
+    return *this;
+  }
+  Delete();
+  _vao = o._vao;
+  o._vao = 0;
+  _vbo = std::move(o._vbo);
+  _ebo = std::move(o._ebo);
+  _drawIds = std::move(o._drawIds);
+  _attribDesc = std::move(o._attribDesc);
+  _indexType = o._indexType;
+  _vertexUsed = o._vertexUsed;
+  _indexUsed = o._indexUsed;
+  _drawIdCount = o._drawIdCount;
+  return *this;
+}
+
+void MeshPoolOpenGL::SetupVertexArray() {
+  BindVertexArrayOpenGL(_vao);
+  _vbo.Bind();
+  for (const auto& d : _attribDesc) {
+    MineGLFuncCall(glVertexAttribPointer(d.index, d.size, d.type, d.normalized, d.stride, (void*)(d.offset)));
+    MineGLFuncCall(glEnableVertexAttribArray(d.index));
+  }
+  _drawIds.Bind();
+  MineGLFuncCall(glVertexAttribIPointer(DRAW_ID_ATTRIB_LOCATION, 1, GL_UNSIGNED_INT, 0, nullptr));
+  MineGLFuncCall(glVertexAttribDivisor(DRAW_ID_ATTRIB_LOCATION, 1));
+  MineGLFuncCall(glEnableVertexAttribArray(DRAW_ID_ATTRIB_LOCATION));
+  _ebo.Bind();
+  BindVertexArrayOpenGL(0);
+}
+
+bool MeshPoolOpenGL::IsCompatible(const GPUMeshOpenGL& mesh) const {
+  return mesh.GetIndexType() == _indexType && _SameAttribDesc(mesh.GetAttribDesc(), _attribDesc);
+}
+
+const std::vector<VertexAttribDescOpenGL>& MeshPoolOpenGL::GetAttribDesc() const { return _attribDesc; }
+
+MeshPoolRangeOpenGL MeshPoolOpenGL::Add(const GPUMeshOpenGL& mesh) {
+  assert(IsCompatible(mesh));
+  const auto& vbo = mesh.GetVertexBuffer();
+  const auto& ebo = mesh.GetIndexBuffer();
+  bool grown = false;
+  BindVertexArrayOpenGL(_vao);
+  if (_vertexUsed + vbo.GetSize() > _vbo.GetSize()) {
+    _GrowBuffer(_vbo, GL_ARRAY_BUFFER, _vertexUsed, _vertexUsed + vbo.GetSize());
+    grown = true;
+  }
+  if (_indexUsed + ebo.GetSize() > _ebo.GetSize()) {
+    _GrowBuffer(_ebo, GL_ELEMENT_ARRAY_BUFFER, _indexUsed, _indexUsed + ebo.GetSize());
+    grown = true;
+  }
+  if (grown) {
+    SetupVertexArray();
+  }
+  BindBufferOpenGL(GL_COPY_READ_BUFFER, vbo.GetHandle());
+  BindBufferOpenGL(GL_COPY_WRITE_BUFFER, _vbo.GetHandle());
+  MineGLFuncCall(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, _vertexUsed, vbo.GetSize()));
+  BindBufferOpenGL(GL_COPY_READ_BUFFER, ebo.GetHandle());
+  BindBufferOpenGL(GL_COPY_WRITE_BUFFER, _ebo.GetHandle());
+  MineGLFuncCall(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, _indexUsed, ebo.GetSize()));
+  MeshPoolRangeOpenGL range;
+  range.baseVertex = (GLint)(_vertexUsed / _attribDesc[0].stride);
+  range.firstIndex = (GLuint)(_indexUsed / IndexSizeOpenGL(_indexType));
+  //next mesh starts on a whole vertex
+  GLsizeiptr stride = _attribDesc[0].stride;
+  _vertexUsed = (_vertexUsed + vbo.GetSize() + stride - 1) / stride * stride;
+  _indexUsed += ebo.GetSize();
+  return range;
+}
+
+void MeshPoolOpenGL::ReserveDraws(GLuint count) {
+  if (count <= _drawIdCount) {
+    return;
+  }
+  GLuint n = std::max<GLuint>(_drawIdCount * 2, count);
+  std::vector<GLuint> ids(n);
+  for (GLuint i = 0; i < n; i++) {
+    ids[i] = i;
+  }
+  _drawIds.Delete();
+  _drawIds = GPUBufferOpenGL(GL_ARRAY_BUFFER, GL_STATIC_DRAW, ids.data(), n * sizeof(GLuint));
+  _drawIdCount = n;
+  SetupVertexArray();
+}
+
+void MeshPoolOpenGL::Bind() const {
+  BindVertexArrayOpenGL(_vao);
+}
+
+void MeshPoolOpenGL::Delete() {
+  if (_vao != 0) {
+    MineGLFuncCall(glDeleteVertexArrays(1, &_vao));
+    _ForgetHandle(_state.vao, _vao);
+  }
+  _vao = 0;
+  _vbo.Delete();
+  _ebo.Delete();
+  _drawIds.Delete();
+}
+
+Matrix4x4 GPUMeshOpenGL::GetPositionDecodeMatrix() const {
+  auto s = _positionDecode.w;
+  return Scale(Translation(Vector3(_positionDecode.x, _positionDecode.y, _positionDecode.z)), Vector3(s, s, s));
+}
 
-std::shared_ptr<GPUMeshOpenGL> Mine::CreateMeshBufferOpenGL(const Mesh& mesh, bool hasNormal, bool hasTexcoord) {
-  std::vector<float> buffer;
+const std::vector<SubMeshDescOpenGL>& GPUMeshOpenGL::GetSubMeshes() const { return _subMeshes; }
+
+int GPUMeshOpenGL::FindSubMesh(std::string_view name) const {
+  for (size_t i = 0; i < _subMeshes.size(); i++) {
+    if (_subMeshes[i].name == name) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+const BoundingBox& GPUMeshOpenGL::GetBounds(int subMesh) const {
+  return subMesh < 0 ? _bounds : _subMeshes[subMesh].bounds;
+}
+
+const BoundingSphere& GPUMeshOpenGL::GetBoundingSphere(int subMesh) const {
+  return subMesh < 0 ? _sphere : _subMeshes[subMesh].sphere;
+}
+
+int GPUMeshOpenGL::SelectLod(int subMesh, float maxError) const {
+  if (subMesh < 0) {
+    return 0;
+  }
+  const auto& lods = _subMeshes[subMesh].lods;
+  int lod = 0;
+  while (lod < (int)lods.size() && lods[lod].error <= maxError) {
+    lod++;
+  }
+  return lod;
+}
+
+static GPUMeshDescOpenGL _CreateMeshDesc(const VertexAttrib& attrib,
+                                         const FaceArrayList& faces,
+                                         bool hasNormal,
+                                         bool hasTexcoord,
+                                         VertexWeldMode weld) {
   std::vector<unsigned int> indice;
-  std::map<_Temp, unsigned int> cull;
-  unsigned int id = 0;
-  for (const Face& f : mesh.face) {
-    for (int i = 0; i < 3; i++) {
-      _Temp t{f.verticeIdx[i], f.texcoordIdx[i], f.normalIdx[i]};
-      auto iter = cull.find(t);
-      if (iter == cull.end()) {
-        const auto& p = mesh.attrib.vertices[f.verticeIdx[i]];
-        const auto& t = mesh.attrib.texcoords[f.texcoordIdx[i]];
-        const auto& n = mesh.attrib.normals[f.normalIdx[i]];
-        buffer.emplace_back(p.x);
-        buffer.emplace_back(p.y);
-        buffer.emplace_back(p.z);
-        if (hasTexcoord) {
-          buffer.emplace_back(t.x);
-          buffer.emplace_back(t.y);
-        }
-        if (hasNormal) {
-          buffer.emplace_back(n.x);
-          buffer.emplace_back(n.y);
-          buffer.emplace_back(n.z);
-        }
-        if (hasTexcoord && hasNormal) {
-          cull.emplace(_Temp{f.verticeIdx[i], f.texcoordIdx[i], f.normalIdx[i]}, id);
-        }
-        if (!hasTexcoord && hasNormal) {
-          cull.emplace(_Temp{f.verticeIdx[i], -1, f.normalIdx[i]}, id);
-        }
-        if (hasTexcoord && !hasNormal) {
-          cull.emplace(_Temp{f.verticeIdx[i], f.texcoordIdx[i], -1}, id);
-        }
-        if (!hasTexcoord && !hasNormal) {
-          cull.emplace(_Temp{f.verticeIdx[i], -1, -1}, id);
-        }
-        indice.emplace_back(id);
-        id++;
-      } else {
-        indice.emplace_back(iter->second);
-      }
+  std::vector<VertexKey> vertices;
+  WeldVertices(faces, hasNormal, hasTexcoord, weld, indice, vertices);
+  size_t floatCount = 3 + (hasTexcoord ? 2 : 0) + (hasNormal ? 3 : 0);
+  std::vector<unsigned char> buffer(vertices.size() * floatCount * sizeof(float));
+  auto dst = (float*)buffer.data();
+  for (const auto& v : vertices) {
+    const auto& p = attrib.vertices[v.verticeIdx];
+    *dst++ = p.x;
+    *dst++ = p.y;
+    *dst++ = p.z;
+    if (hasTexcoord) {
+      const auto& t = attrib.texcoords[v.texcoordIdx];
+      *dst++ = t.x;
+      *dst++ = t.y;
+    }
+    if (hasNormal) {
+      const auto& n = attrib.normals[v.normalIdx];
+      *dst++ = n.x;
+      *dst++ = n.y;
+      *dst++ = n.z;
     }
   }
   GPUMeshDescOpenGL desc;
   desc.data = std::move(buffer);
   desc.indices = std::move(indice);
+  desc.indexType = SelectIndexTypeOpenGL(vertices.size());
   GLsizei stride = (GLsizei)(sizeof(Vector3) + (hasTexcoord ? sizeof(Vector2) : 0) + (hasNormal ? sizeof(Vector3) : 0));
-  auto posOffset = sizeof(Vector3);
-  auto texOffset = sizeof(Vector3) + sizeof(Vector2);
-  desc.attribDesc.emplace_back(VertexAttribDescOpenGL{0, 3, GL_FLOAT, stride, 0});  //pos
+  auto texOffset = sizeof(Vector3);
+  auto norOffset = sizeof(Vector3) + (hasTexcoord ? sizeof(Vector2) : 0);
+  desc.attribDesc.emplace_back(VertexAttribDescOpenGL{0, 3, GL_FLOAT, GL_FALSE, stride, 0});  //pos
   if (hasTexcoord) {
-    desc.attribDesc.emplace_back(VertexAttribDescOpenGL{1, 2, GL_FLOAT, stride, posOffset});  //texcoord
+    desc.attribDesc.emplace_back(VertexAttribDescOpenGL{1, 2, GL_FLOAT, GL_FALSE, stride, texOffset});  //texcoord
   }
   if (hasNormal) {
-    desc.attribDesc.emplace_back(VertexAttribDescOpenGL{2, 3, GL_FLOAT, stride, texOffset});  //normal
+    desc.attribDesc.emplace_back(VertexAttribDescOpenGL{2, 3, GL_FLOAT, GL_FALSE, stride, norOffset});  //normal
+  }
+  return desc;
+}
+
+GPUMeshDescOpenGL Mine::CreateMeshDescOpenGL(const Mesh& mesh, bool hasNormal, bool hasTexcoord, VertexWeldMode weld) {
+  auto desc = _CreateMeshDesc(mesh.attrib, FaceArrayList{&mesh.face}, hasNormal, hasTexcoord, weld);
+  desc.subMeshes.emplace_back(SubMeshDescOpenGL{std::string(), 0, (GLsizei)desc.indices.size()});
+  ComputeSubMeshBoundsOpenGL(desc);
+  return desc;
+}
+
+std::shared_ptr<GPUMeshOpenGL> Mine::CreateMeshBufferOpenGL(const Mesh& mesh, bool hasNormal, bool hasTexcoord, VertexWeldMode weld) {
+  return std::make_shared<GPUMeshOpenGL>(CreateMeshDescOpenGL(mesh, hasNormal, hasTexcoord, weld));
+}
+
+GPUMeshDescOpenGL Mine::CreateMultiMeshDescOpenGL(const MultiMesh& mesh, bool hasNormal, bool hasTexcoord, VertexWeldMode weld) {
+  FaceArrayList faces;
+  for (const auto& obj : mesh.obj) {
+    faces.emplace_back(&obj.second);
+  }
+  auto desc = _CreateMeshDesc(mesh.attrib, faces, hasNormal, hasTexcoord, weld);
+  GLsizei offset = 0;
+  for (const auto& obj : mesh.obj) {
+    auto count = (GLsizei)(obj.second.size() * 3);
+    desc.subMeshes.emplace_back(SubMeshDescOpenGL{obj.first, offset, count});
+    offset += count;
   }
-  return std::make_shared<GPUMeshOpenGL>(desc);
+  ComputeSubMeshBoundsOpenGL(desc);
+  return desc;
+}
+
+std::shared_ptr<GPUMeshOpenGL> Mine::CreateMultiMeshBufferOpenGL(const MultiMesh& mesh, bool hasNormal, bool hasTexcoord, VertexWeldMode weld) {
+  return std::make_shared<GPUMeshOpenGL>(CreateMultiMeshDescOpenGL(mesh, hasNormal, hasTexcoord, weld));
 }
 
 static GLuint _ComplierShader(GLenum type, std::string_view src) {
@@ -380,6 +1031,12 @@ static UniformDescMapOpenGL _GetShaderUniformDesc(GLuint program) {
     GLint count;
     GLenum type;
     MineGLFuncCall(glGetActiveUniform(program, i, bufferSize, &nameSize, &count, &type, nameBuffer));
+    GLuint index = i;
+    GLint blockIndex;
+    MineGLFuncCall(glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_BLOCK_INDEX, &blockIndex));
+    if (blockIndex != -1) {
+      continue;  //backed by a buffer, no location
+    }
     std::string name(nameBuffer);
     if (count > 1) {
       auto pos = name.find("[0]", 0);
@@ -395,12 +1052,33 @@ static UniformDescMapOpenGL _GetShaderUniformDesc(GLuint program) {
   return map;
 }
 
+static UniformBlockDescMapOpenGL _GetShaderUniformBlockDesc(GLuint program) {
+  UniformBlockDescMapOpenGL map;
+  GLint activeBlockLength;
+  MineGLFuncCall(glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &activeBlockLength));
+  for (auto i = 0; i < activeBlockLength; i++) {
+    const int bufferSize = 512;
+    char nameBuffer[bufferSize];
+    GLsizei nameSize;
+    MineGLFuncCall(glGetActiveUniformBlockName(program, i, bufferSize, &nameSize, nameBuffer));
+    ShaderUniformBlockDescOpenGL desc;
+    desc.name = nameBuffer;
+    desc.index = i;
+    MineGLFuncCall(glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_BINDING, &desc.binding));
+    MineGLFuncCall(glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &desc.size));
+    map.emplace(desc.name, desc);
+  }
+  return map;
+}
+
 ShaderProgramOpenGL::ShaderProgramOpenGL(std::string_view vs, std::string_view fs) {
   auto vss = _ComplierShader(GL_VERTEX_SHADER, vs);
   auto fss = _ComplierShader(GL_FRAGMENT_SHADER, fs);
   _handle = MineGLFuncCall(glCreateProgram());
   MineGLFuncCall(glAttachShader(_handle, vss));
   MineGLFuncCall(glAttachShader(_handle, fss));
+  //lets the program binary cache read it back
+  MineGLFuncCall(glProgramParameteri(_handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
   MineGLFuncCall(glLinkProgram(_handle));
   GLint success;
   MineGLFuncCall(glGetProgramiv(_handle, GL_LINK_STATUS, &success));
@@ -417,13 +1095,31 @@ ShaderProgramOpenGL::ShaderProgramOpenGL(std::string_view vs, std::string_view f
     MineGLFuncCall(glDeleteProgram(_handle));
     _handle = 0;
   }
+  Reflect();
+}
+
+ShaderProgramOpenGL::ShaderProgramOpenGL(GLuint linkedProgram) : _handle(linkedProgram) {
+  Reflect();
+}
+
+void ShaderProgramOpenGL::Reflect() {
   _uniformDesc = _GetShaderUniformDesc(_handle);
+  _uniformBlockDesc = _GetShaderUniformBlockDesc(_handle);
+  for (const auto& desc : _uniformDesc) {
+    _uniformSlots.emplace_back(&desc.second);
+    _uploaded.emplace_back(ShaderUniformOpenGL::CreateUniformObject(desc.second.type, desc.second.count));
+  }
+  _uploadedValid.assign(_uniformSlots.size(), 0);
 }
 
 ShaderProgramOpenGL::ShaderProgramOpenGL(ShaderProgramOpenGL&& o) noexcept {
   _handle = o._handle;
   o._handle = 0;
   _uniformDesc = std::move(o._uniformDesc);
+  _uniformBlockDesc = std::move(o._uniformBlockDesc);
+  _uniformSlots = std::move(o._uniformSlots);
+  _uploaded = std::move(o._uploaded);
+  _uploadedValid = std::move(o._uploadedValid);
 }
 
 ShaderProgramOpenGL::~ShaderProgramOpenGL() {
@@ -434,49 +1130,79 @@ ShaderProgramOpenGL& ShaderProgramOpenGL::operator=(ShaderProgramOpenGL&& o) noe
   _handle = o._handle;
   o._handle = 0;
   _uniformDesc = std::move(o._uniformDesc);
+  _uniformBlockDesc = std::move(o._uniformBlockDesc);
+  _uniformSlots = std::move(o._uniformSlots);
+  _uploaded = std::move(o._uploaded);
+  _uploadedValid = std::move(o._uploadedValid);
   return *this;
 }
 
-void ShaderProgramOpenGL::Bind() const { MineGLFuncCall(glUseProgram(_handle)); }
+void ShaderProgramOpenGL::Bind() const { UseProgramOpenGL(_handle); }
 
 void ShaderProgramOpenGL::Delete() {
   if (_handle != 0) {
     MineGLFuncCall(glDeleteProgram(_handle));
+    _ForgetHandle(_state.program, _handle);
   }
   _handle = 0;
 }
 
 const UniformDescMapOpenGL& ShaderProgramOpenGL::GetUniformDesc() const { return _uniformDesc; }
 
-void ShaderProgramOpenGL::SetPass(const UniformMapOpenGL& uniform) const {
+const UniformBlockDescMapOpenGL& ShaderProgramOpenGL::GetUniformBlockDesc() const { return _uniformBlockDesc; }
+
+static bool _SameUniformValue(const UniformObjectOpenGL& a, const UniformObjectOpenGL& b) {
+  if (a.index() != b.index()) {
+    return false;
+  }
+  return std::visit(
+      [&b](const auto& x) -> bool {
+        using T = std::decay_t<decltype(x)>;
+        const auto& y = std::get<T>(b);
+        if constexpr (std::is_same_v<T, UniformArrayObjectOpenGL<Matrix4x4>> || std::is_same_v<T, UniformArrayObjectOpenGL<int>>) {
+          return x.size() == y.size() && memcmp(x.data(), y.data(), x.size() * sizeof(typename T::value_type)) == 0;
+        } else {
+          return memcmp(&x, &y, sizeof(T)) == 0;
+        }
+      },
+      a);
+}
+
+void ShaderProgramOpenGL::SetPass(const UniformSlotsOpenGL& uniform) const {
   Bind();
-  auto localIter = _uniformDesc.begin();
-  auto uniformIter = uniform.begin();
-  for (; localIter != _uniformDesc.end() && uniformIter != uniform.end(); localIter++, uniformIter++) {
-    assert(localIter->first == uniformIter->first);
-    const auto& desc = localIter->second;
+  assert(uniform.size() == _uniformSlots.size());
+  for (size_t slot = 0; slot < _uniformSlots.size(); slot++) {
+    const auto& desc = *_uniformSlots[slot];
+    const auto& uniObj = uniform[slot];
+    //uniforms are program state, so the last value survives other programs and materials
+    if (_uploadedValid[slot] && _SameUniformValue(_uploaded[slot], uniObj)) {
+      _frameStats.uniformSkipped++;
+      continue;
+    }
+    _uploaded[slot] = uniObj;
+    _uploadedValid[slot] = 1;
+    _frameStats.uniformCalls++;
     if (desc.count == 1) {
       switch (desc.type) {
         case GL_FLOAT:
-          MineGLFuncCall(glUniform1f(desc.location, std::get<float>(uniformIter->second)));
+          MineGLFuncCall(glUniform1f(desc.location, std::get<float>(uniObj)));
           break;
         case GL_INT:
-          MineGLFuncCall(glUniform1i(desc.location, std::get<int>(uniformIter->second)));
+          MineGLFuncCall(glUniform1i(desc.location, std::get<int>(uniObj)));
           break;
         case GL_FLOAT_VEC3:
-          MineGLFuncCall(glUniform3fv(desc.location, desc.count, &std::get<Vector3>(uniformIter->second).x));
+          MineGLFuncCall(glUniform3fv(desc.location, desc.count, &std::get<Vector3>(uniObj).x));
           break;
         case GL_FLOAT_MAT4:
-          MineGLFuncCall(glUniformMatrix4fv(desc.location, desc.count, GL_FALSE, &std::get<Matrix4x4>(uniformIter->second).m11));
+          MineGLFuncCall(glUniformMatrix4fv(desc.location, desc.count, GL_FALSE, &std::get<Matrix4x4>(uniObj).m11));
           break;
         case GL_SAMPLER_2D:
-          MineGLFuncCall(glUniform1i(desc.location, std::get<int>(uniformIter->second)));
+          MineGLFuncCall(glUniform1i(desc.location, std::get<int>(uniObj)));
           break;
         default:
           throw "unsupported type";
       }
     } else {
-      const auto& uniObj = uniformIter->second;
       switch (desc.type) {
         case GL_FLOAT_MAT4:
           MineGLFuncCall(glUniformMatrix4fv(desc.location,
@@ -486,6 +1212,7 @@ void ShaderProgramOpenGL::SetPass(const UniformMapOpenGL& uniform) const {
           break;
         case GL_SAMPLER_2D:
           MineGLFuncCall(glUniform1iv(desc.location, desc.count, std::get<UniformArrayObjectOpenGL<int>>(uniObj).data()));
+          break;
         default:
           throw "unsupported type";
       }
@@ -494,15 +1221,45 @@ void ShaderProgramOpenGL::SetPass(const UniformMapOpenGL& uniform) const {
 }
 
 std::shared_ptr<ShaderProgramOpenGL> Mine::CreateShaderProgramOpenGL(const std::filesystem::path& path) {
-  auto vsPath = path.generic_u8string() + ".vert";
-  auto fsPath = path.generic_u8string() + ".frag";
+  return CreateShaderProgramOpenGL(path.generic_u8string() + ".vert", path.generic_u8string() + ".frag");
+}
+
+std::shared_ptr<ShaderProgramOpenGL> Mine::CreateShaderProgramOpenGL(const std::filesystem::path& vsPath, const std::filesystem::path& fsPath) {
+  return CreateShaderProgramOpenGL(vsPath, fsPath, ShaderDefinesOpenGL());
+}
+
+std::shared_ptr<ShaderProgramOpenGL> Mine::CreateShaderProgramOpenGL(const std::filesystem::path& vsPath,
+                                                                     const std::filesystem::path& fsPath,
+                                                                     const ShaderDefinesOpenGL& defines) {
   std::ifstream vsif(vsPath, std::ios::in);
   std::string vsSrc = std::string(std::istreambuf_iterator<char>(vsif), std::istreambuf_iterator<char>());
   vsif.close();
   std::ifstream fsif(fsPath, std::ios::in);
   std::string fsSrc = std::string(std::istreambuf_iterator<char>(fsif), std::istreambuf_iterator<char>());
   fsif.close();
-  return std::make_shared<ShaderProgramOpenGL>(vsSrc, fsSrc);
+  return std::make_shared<ShaderProgramOpenGL>(InjectShaderDefinesOpenGL(vsSrc, defines), InjectShaderDefinesOpenGL(fsSrc, defines));
+}
+
+std::string Mine::InjectShaderDefinesOpenGL(std::string_view source, const ShaderDefinesOpenGL& defines) {
+  if (defines.empty()) {
+    return std::string(source);
+  }
+  //#version must stay the first directive, #extension may follow defines
+  size_t pos = 0;
+  auto version = source.find("#version");
+  if (version != std::string_view::npos) {
+    pos = source.find('\n', version);
+    pos = pos == std::string_view::npos ? source.size() : pos + 1;
+  }
+  std::string result(source.substr(0, pos));
+  if (!result.empty() && result.back() != '\n') {
+    result += '\n';
+  }
+  for (const auto& [name, value] : defines) {
+    result += "#define " + name + " " + value + "\n";
+  }
+  result += source.substr(pos);
+  return result;
 }
 
 ShaderUniformOpenGL::ShaderUniformOpenGL() = default;
@@ -536,49 +1293,192 @@ UniformObjectOpenGL ShaderUniformOpenGL::CreateUniformObject(GLenum type, int ar
 }
 
 ShaderUniformOpenGL::ShaderUniformOpenGL(const ShaderUniformOpenGL& o) {
-  _objectMap = o._objectMap;
+  _slotMap = o._slotMap;
+  _objects = o._objects;
 }
 
 ShaderUniformOpenGL::ShaderUniformOpenGL(ShaderUniformOpenGL&& o) {
-  _objectMap = std::move(o._objectMap);
+  _slotMap = std::move(o._slotMap);
+  _objects = std::move(o._objects);
 }
 
 ShaderUniformOpenGL::~ShaderUniformOpenGL() = default;
 
 ShaderUniformOpenGL& ShaderUniformOpenGL::operator=(const ShaderUniformOpenGL& o) {
-  _objectMap = o._objectMap;
+  _slotMap = o._slotMap;
+  _objects = o._objects;
   return *this;
 }
 
 ShaderUniformOpenGL& ShaderUniformOpenGL::operator=(ShaderUniformOpenGL&& o) {
-  _objectMap = std::move(o._objectMap);
+  _slotMap = std::move(o._slotMap);
+  _objects = std::move(o._objects);
   return *this;
 }
 
 ShaderUniformOpenGL::ShaderUniformOpenGL(const UniformDescMapOpenGL& map) {
+  _objects.reserve(map.size());
   for (const auto& desc : map) {
-    _objectMap.emplace(std::string_view(desc.first), CreateUniformObject(desc.second.type, desc.second.count));
+    _slotMap.emplace(std::string_view(desc.first), (UniformHandleOpenGL)_objects.size());
+    _objects.emplace_back(CreateUniformObject(desc.second.type, desc.second.count));
   }
 }
 
-const UniformMapOpenGL& ShaderUniformOpenGL::GetUniformObjects() const { return _objectMap; }
+UniformHandleOpenGL ShaderUniformOpenGL::GetHandle(std::string_view name) const {
+  auto iter = _slotMap.find(name);
+  return iter == _slotMap.end() ? INVALID_UNIFORM_HANDLE_OPENGL : iter->second;
+}
+
+const UniformSlotsOpenGL& ShaderUniformOpenGL::GetUniformObjects() const { return _objects; }
 
 std::shared_ptr<ShaderUniformOpenGL> Mine::CreateShaderUniformOpenGL(const ShaderProgramOpenGL& shader) {
   return std::make_shared<ShaderUniformOpenGL>(shader.GetUniformDesc());
 }
 
-MeshRendererOpenGL::MeshRendererOpenGL() = default;
+UniformBlockOpenGL::UniformBlockOpenGL() : _binding(0) {}
+
+UniformBlockOpenGL::UniformBlockOpenGL(GLuint binding, GLsizeiptr size)
+    : _buffer(GL_UNIFORM_BUFFER, GL_DYNAMIC_DRAW, nullptr, size), _binding(binding) {}
+
+UniformBlockOpenGL::UniformBlockOpenGL(UniformBlockOpenGL&& o) noexcept {
+  _buffer = std::move(o._buffer);
+  _binding = o._binding;
+}
+
+UniformBlockOpenGL::~UniformBlockOpenGL() = default;
+
+UniformBlockOpenGL& UniformBlockOpenGL::operator=(UniformBlockOpenGL&& o) noexcept {
+  _buffer = std::move(o._buffer);
+  _binding = o._binding;
+  return *this;
+}
+
+void UniformBlockOpenGL::Upload(const void* data, GLsizeiptr size) const {
+  _buffer.SetSubData(0, data, size);
+  Bind();
+}
+
+void UniformBlockOpenGL::Bind() const { _buffer.BindBase(_binding); }
+
+void UniformBlockOpenGL::Delete() { _buffer.Delete(); }
+
+std::shared_ptr<UniformBlockOpenGL> Mine::CreateUniformBlockOpenGL(GLuint binding, GLsizeiptr size) {
+  return std::make_shared<UniformBlockOpenGL>(binding, size);
+}
+
+RingBufferOpenGL::RingBufferOpenGL() : _handle(0), _ptr(nullptr), _frameSize(0), _frameCount(0), _frame(0), _head(0) {}
+
+RingBufferOpenGL::RingBufferOpenGL(GLsizeiptr frameSize, int frameCount) : RingBufferOpenGL() {
+  constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  _frameSize = frameSize;
+  _frameCount = frameCount;
+  _fences.resize(frameCount, nullptr);
+  MineGLFuncCall(glGenBuffers(1, &_handle));
+  //copy write is not vao or cache state, the target only matters for creation
+  BindBufferOpenGL(GL_COPY_WRITE_BUFFER, _handle);
+  MineGLFuncCall(glBufferStorage(GL_COPY_WRITE_BUFFER, frameSize * frameCount, nullptr, flags));
+  MineGLFuncCall(_ptr = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frameSize * frameCount, flags));
+  if (_ptr == nullptr) {
+    throw "RingBufferOpenGL map failed";
+  }
+}
+
+RingBufferOpenGL::RingBufferOpenGL(RingBufferOpenGL&& o) noexcept : RingBufferOpenGL() {
+  *this = std::move(o);
+}
+
+RingBufferOpenGL::~RingBufferOpenGL() {
+  Delete();
+}
+
+RingBufferOpenGL& RingBufferOpenGL::operator=(RingBufferOpenGL&& o) noexcept {
+  if (this == &o) {
+    return *this;
+  }
+  Delete();
+  _handle = o._handle;
+  _ptr = o._ptr;
+  _frameSize = o._frameSize;
+  _frameCount = o._frameCount;
+  _frame = o._frame;
+  _head = o._head.load();
+  _fences = std::move(o._fences);
+  o._handle = 0;
+  o._ptr = nullptr;
+  return *this;
+}
+
+void RingBufferOpenGL::BeginFrame() {
+  _frame = (_frame + 1) % _frameCount;
+  auto& fence = _fences[_frame];
+  if (fence != nullptr) {
+    GLenum result = GL_TIMEOUT_EXPIRED;
+    while (result == GL_TIMEOUT_EXPIRED) {
+      MineGLFuncCall(result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000));
+    }
+    MineGLFuncCall(glDeleteSync(fence));
+    fence = nullptr;
+  }
+  _head = 0;
+}
+
+void RingBufferOpenGL::EndFrame() {
+  MineGLFuncCall(_fences[_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+}
+
+RingAllocationOpenGL RingBufferOpenGL::Allocate(GLsizeiptr size, GLsizeiptr alignment) {
+  GLsizeiptr head = _head.load(std::memory_order_relaxed);
+  GLsizeiptr begin;
+  do {
+    begin = (head + alignment - 1) / alignment * alignment;
+    assert(begin + size <= _frameSize);
+  } while (!_head.compare_exchange_weak(head, begin + size, std::memory_order_relaxed));
+  GLintptr offset = _frame * _frameSize + begin;
+  return RingAllocationOpenGL{_ptr + offset, offset, size};
+}
+
+void RingBufferOpenGL::BindRange(GLenum target, GLuint index, const RingAllocationOpenGL& allocation) const {
+  BindBufferRangeOpenGL(target, index, _handle, allocation.offset, allocation.size);
+}
+
+void RingBufferOpenGL::Delete() {
+  for (auto& fence : _fences) {
+    if (fence != nullptr) {
+      MineGLFuncCall(glDeleteSync(fence));
+      fence = nullptr;
+    }
+  }
+  if (_handle != 0) {
+    //deleting a mapped buffer unmaps it
+    MineGLFuncCall(glDeleteBuffers(1, &_handle));
+    _ForgetBuffer(_handle);
+  }
+  _handle = 0;
+  _ptr = nullptr;
+}
+
+std::shared_ptr<RingBufferOpenGL> Mine::CreateRingBufferOpenGL(GLsizeiptr frameSize, int frameCount) {
+  return std::make_shared<RingBufferOpenGL>(frameSize, frameCount);
+}
+
+MeshRendererOpenGL::MeshRendererOpenGL() : subMesh(-1), lod(0), instanceCount(1) {}
 
 MeshRendererOpenGL::MeshRendererOpenGL(const MeshRendererOpenGL& o) {
   shader = o.shader;
   material = o.material;
   mesh = o.mesh;
+  subMesh = o.subMesh;
+  lod = o.lod;
+  instanceCount = o.instanceCount;
 }
 
 MeshRendererOpenGL::MeshRendererOpenGL(MeshRendererOpenGL&& o) {
   shader = std::move(o.shader);
   material = std::move(o.material);
   mesh = std::move(o.mesh);
+  subMesh = o.subMesh;
+  lod = o.lod;
+  instanceCount = o.instanceCount;
 }
 
 MeshRendererOpenGL::~MeshRendererOpenGL() = default;
@@ -587,6 +1487,9 @@ MeshRendererOpenGL& MeshRendererOpenGL::operator=(const MeshRendererOpenGL& o) {
   shader = o.shader;
   material = o.material;
   mesh = o.mesh;
+  subMesh = o.subMesh;
+  lod = o.lod;
+  instanceCount = o.instanceCount;
   return *this;
 }
 
@@ -594,6 +1497,9 @@ MeshRendererOpenGL& MeshRendererOpenGL::operator=(MeshRendererOpenGL&& o) {
   shader = std::move(o.shader);
   material = std::move(o.material);
   mesh = std::move(o.mesh);
+  subMesh = o.subMesh;
+  lod = o.lod;
+  instanceCount = o.instanceCount;
   return *this;
 }
 
@@ -608,15 +1514,21 @@ void MeshRendererOpenGL::Render() const {
   }
   auto e = mesh.lock();
   e->Bind();
-  MineGLFuncCall(glDrawElements(GL_TRIANGLES, e->GetIndexCount(), GL_UNSIGNED_INT, (void*)nullptr));
-  MineGLFuncCall(glBindTexture(GL_TEXTURE_2D, 0));
+  auto [offset, count] = e->GetIndexRange(subMesh, lod);
+  auto indices = (void*)(offset * IndexSizeOpenGL(e->GetIndexType()));
+  if (instanceCount > 1) {
+    MineGLFuncCall(glDrawElementsInstanced(GL_TRIANGLES, count, e->GetIndexType(), indices, instanceCount));
+  } else {
+    MineGLFuncCall(glDrawElements(GL_TRIANGLES, count, e->GetIndexType(), indices));
+  }
 }
 
 GPUTexture2DOpenGL::GPUTexture2DOpenGL() : _handle(0), _width(0), _height(0) {}
 
 GPUTexture2DOpenGL::GPUTexture2DOpenGL(const GPUTexture2DDescOpenGL& desc) {
   MineGLFuncCall(glGenTextures(1, &_handle));
-  MineGLFuncCall(glBindTexture(GL_TEXTURE_2D, _handle));
+  //a fresh name is never cached, so this bind also makes unit 0 active
+  BindTextureOpenGL(0, GL_TEXTURE_2D, _handle);
   MineGLFuncCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, desc.wrapS));
   MineGLFuncCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, desc.wrapT));
   if (desc.wrapS == GL_CLAMP_TO_BORDER || desc.wrapT == GL_CLAMP_TO_BORDER) {
@@ -648,13 +1560,17 @@ GPUTexture2DOpenGL& GPUTexture2DOpenGL::operator=(GPUTexture2DOpenGL&& o) {
 }
 
 void GPUTexture2DOpenGL::Bind(GLenum id) const {
-  MineGLFuncCall(glActiveTexture(id));
-  MineGLFuncCall(glBindTexture(GL_TEXTURE_2D, _handle));
+  BindTextureOpenGL(id - GL_TEXTURE0, GL_TEXTURE_2D, _handle);
+}
+
+void GPUTexture2DOpenGL::GenerateMipmap() const {
+  MineGLFuncCall(glGenerateTextureMipmap(_handle));
 }
 
 void GPUTexture2DOpenGL::Delete() {
   if (_handle != 0) {
     MineGLFuncCall(glDeleteTextures(1, &_handle));
+    _ForgetTexture(_handle);
   }
   _handle = 0;
 }
@@ -663,6 +1579,51 @@ std::shared_ptr<GPUTexture2DOpenGL> Mine::CreateTexture2DOpenGL(const GPUTexture
   return std::make_shared<GPUTexture2DOpenGL>(desc);
 }
 
+SamplerOpenGL::SamplerOpenGL() : _handle(0) {}
+
+SamplerOpenGL::SamplerOpenGL(const SamplerDescOpenGL& desc) {
+  MineGLFuncCall(glGenSamplers(1, &_handle));
+  MineGLFuncCall(glSamplerParameteri(_handle, GL_TEXTURE_WRAP_S, desc.wrapS));
+  MineGLFuncCall(glSamplerParameteri(_handle, GL_TEXTURE_WRAP_T, desc.wrapT));
+  MineGLFuncCall(glSamplerParameteri(_handle, GL_TEXTURE_MIN_FILTER, desc.minFliter));
+  MineGLFuncCall(glSamplerParameteri(_handle, GL_TEXTURE_MAG_FILTER, desc.magFliter));
+  if (desc.compareFunc != GL_NONE) {
+    MineGLFuncCall(glSamplerParameteri(_handle, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE));
+    MineGLFuncCall(glSamplerParameteri(_handle, GL_TEXTURE_COMPARE_FUNC, desc.compareFunc));
+  }
+}
+
+SamplerOpenGL::SamplerOpenGL(SamplerOpenGL&& o) {
+  _handle = o._handle;
+  o._handle = 0;
+}
+
+SamplerOpenGL::~SamplerOpenGL() {
+  Delete();
+}
+
+SamplerOpenGL& SamplerOpenGL::operator=(SamplerOpenGL&& o) {
+  _handle = o._handle;
+  o._handle = 0;
+  return *this;
+}
+
+void SamplerOpenGL::Bind(GLuint unit) const {
+  BindSamplerOpenGL(unit, _handle);
+}
+
+void SamplerOpenGL::Delete() {
+  if (_handle != 0) {
+    MineGLFuncCall(glDeleteSamplers(1, &_handle));
+    _ForgetSampler(_handle);
+  }
+  _handle = 0;
+}
+
+std::shared_ptr<SamplerOpenGL> Mine::CreateSamplerOpenGL(const SamplerDescOpenGL& desc) {
+  return std::make_shared<SamplerOpenGL>(desc);
+}
+
 std::shared_ptr<GPUTexture2DOpenGL> Mine::CreateTexture2DOpenGL(const Texture2D& tex2d) {
   GPUTexture2DDescOpenGL desc;
   desc.wrapS = GL_REPEAT;
@@ -705,11 +1666,11 @@ FrameBufferOpenGL::~FrameBufferOpenGL() {
 }
 
 void FrameBufferOpenGL::Bind() const {
-  MineGLFuncCall(glBindFramebuffer(GL_FRAMEBUFFER, _handle));
+  BindFrameBufferOpenGL(GL_FRAMEBUFFER, _handle);
 }
 
 void FrameBufferOpenGL::Unbind() const {
-  MineGLFuncCall(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+  BindFrameBufferOpenGL(GL_FRAMEBUFFER, 0);
 }
 
 bool FrameBufferOpenGL::BindTexture(const FrameBufferTextureDescOpenGL& desc) const {
@@ -721,6 +1682,8 @@ bool FrameBufferOpenGL::BindTexture(const FrameBufferTextureDescOpenGL& desc) co
 void FrameBufferOpenGL::Delete() {
   if (_handle != 0) {
     MineGLFuncCall(glDeleteFramebuffers(1, &_handle));
+    _ForgetHandle(_state.drawFrameBuffer, _handle);
+    _ForgetHandle(_state.readFrameBuffer, _handle);
   }
   _handle = 0;
 }
@@ -733,7 +1696,41 @@ std::shared_ptr<FrameBufferOpenGL> Mine::CreateFrameBufferOpenGL() {
 
 ShadowMap2DOpenGL::ShadowMap2DOpenGL() = default;
 
-ShadowMap2DOpenGL::ShadowMap2DOpenGL(int width, int height) {
+static void _CheckFrameBuffer() {
+  GLenum result = MineGLFuncCall(glCheckFramebufferStatus(GL_FRAMEBUFFER));
+  if (result != GL_FRAMEBUFFER_COMPLETE) {
+    throw "cant init frame buffer";
+  }
+}
+
+static std::shared_ptr<GPUTexture2DOpenGL> _CreateMomentTexture(int width, int height, bool mipmap) {
+  GPUTexture2DDescOpenGL desc;
+  desc.wrapS = GL_CLAMP_TO_EDGE;
+  desc.wrapT = GL_CLAMP_TO_EDGE;
+  desc.borderColor = Vector4(1, 1, 1, 1);
+  desc.minFliter = mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+  desc.magFliter = GL_LINEAR;
+  desc.mipmapLevel = mipmap ? 1 : 0;  //allocates the chain
+  desc.format = GL_RG32F;
+  desc.width = width;
+  desc.height = height;
+  desc.dataFormat = GL_RG;
+  desc.dataType = GL_FLOAT;
+  desc.dataPtr = nullptr;
+  return CreateTexture2DOpenGL(desc);
+}
+
+//color only target of the blur passes
+static std::shared_ptr<FrameBufferOpenGL> _CreateColorFrameBuffer(const GPUTexture2DOpenGL& texture) {
+  auto frameBuffer = CreateFrameBufferOpenGL();
+  frameBuffer->Bind();
+  MineGLFuncCall(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture.GetHandle(), 0));
+  _CheckFrameBuffer();
+  frameBuffer->Unbind();
+  return frameBuffer;
+}
+
+ShadowMap2DOpenGL::ShadowMap2DOpenGL(int width, int height, bool moments, bool filtered) {
   assert(width > 0 && height > 0);
 
   _frameBuffer = CreateFrameBufferOpenGL();
@@ -755,18 +1752,26 @@ ShadowMap2DOpenGL::ShadowMap2DOpenGL(int width, int height) {
 
   _frameBuffer->Bind();
   MineGLFuncCall(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, _depthMap->GetHandle(), 0));
-  GLenum result = MineGLFuncCall(glCheckFramebufferStatus(GL_FRAMEBUFFER));
-  if (result != GL_FRAMEBUFFER_COMPLETE) {
-    throw "cant init frame buffer";
+  if (moments) {
+    _momentMap = _CreateMomentTexture(width, height, filtered);
+    MineGLFuncCall(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _momentMap->GetHandle(), 0));
+    _CheckFrameBuffer();
+  } else {
+    _CheckFrameBuffer();
+    MineGLFuncCall(glDrawBuffer(GL_NONE));
+    MineGLFuncCall(glReadBuffer(GL_NONE));
   }
-  MineGLFuncCall(glDrawBuffer(GL_NONE));
-  MineGLFuncCall(glReadBuffer(GL_NONE));
   _frameBuffer->Unbind();
+
+  if (moments && filtered) {
+    _blurMap = _CreateMomentTexture(width, height, false);
+    _blurFrameBuffer = _CreateColorFrameBuffer(*_blurMap);
+    _momentFrameBuffer = _CreateColorFrameBuffer(*_momentMap);
+  }
 }
 
 ShadowMap2DOpenGL::ShadowMap2DOpenGL(ShadowMap2DOpenGL&& o) {
-  _frameBuffer = std::move(o._frameBuffer);
-  _depthMap = std::move(o._depthMap);
+  *this = std::move(o);
 }
 
 ShadowMap2DOpenGL::~ShadowMap2DOpenGL() {
@@ -776,6 +1781,10 @@ ShadowMap2DOpenGL::~ShadowMap2DOpenGL() {
 ShadowMap2DOpenGL& ShadowMap2DOpenGL::operator=(ShadowMap2DOpenGL&& o) {
   _frameBuffer = std::move(o._frameBuffer);
   _depthMap = std::move(o._depthMap);
+  _momentMap = std::move(o._momentMap);
+  _blurMap = std::move(o._blurMap);
+  _momentFrameBuffer = std::move(o._momentFrameBuffer);
+  _blurFrameBuffer = std::move(o._blurFrameBuffer);
   return *this;
 }
 
@@ -794,19 +1803,64 @@ void ShadowMap2DOpenGL::Delete() {
   if (_depthMap != nullptr) {
     _depthMap->Delete();
   }
+  if (_momentMap != nullptr) {
+    _momentMap->Delete();
+  }
+  if (_blurMap != nullptr) {
+    _blurMap->Delete();
+    _momentFrameBuffer->Delete();
+    _blurFrameBuffer->Delete();
+  }
+}
+
+void ShadowMap2DOpenGL::CopyRegion(const ShadowMap2DOpenGL& src, int x, int y, int width, int height) const {
+  MineGLFuncCall(glCopyImageSubData(src._depthMap->GetHandle(), GL_TEXTURE_2D, 0, x, y, 0,
+                                    _depthMap->GetHandle(), GL_TEXTURE_2D, 0, x, y, 0, width, height, 1));
+  if (_momentMap != nullptr && src._momentMap != nullptr) {
+    MineGLFuncCall(glCopyImageSubData(src._momentMap->GetHandle(), GL_TEXTURE_2D, 0, x, y, 0,
+                                      _momentMap->GetHandle(), GL_TEXTURE_2D, 0, x, y, 0, width, height, 1));
+  }
 }
 
 const GPUTexture2DOpenGL& ShadowMap2DOpenGL::GetDepthMap() const {
   return *_depthMap;
 }
 
-static std::string __head("light[");
-static std::string __intensityTail("].intensity");
-static std::string __posTail("].pos");
-static std::string __colorTail("].color");
+bool ShadowMap2DOpenGL::HasMoments() const {
+  return _momentMap != nullptr;
+}
+
+const GPUTexture2DOpenGL& ShadowMap2DOpenGL::GetMomentMap() const {
+  return *_momentMap;
+}
+
+const GPUTexture2DOpenGL& ShadowMap2DOpenGL::GetBlurMap() const {
+  return *_blurMap;
+}
+
+void ShadowMap2DOpenGL::BindBlurTarget() const {
+  _blurFrameBuffer->Bind();
+}
+
+void ShadowMap2DOpenGL::BindMomentTarget() const {
+  _momentFrameBuffer->Bind();
+}
+
+PointLightUniformHandleOpenGL Mine::GetPointLightHandlesOpenGL(const ShaderUniformOpenGL& uniform, int index) {
+  auto head = "light[" + std::to_string(index) + "].";
+  PointLightUniformHandleOpenGL handle;
+  handle.intensity = uniform.GetHandle(head + "intensity");
+  handle.pos = uniform.GetHandle(head + "pos");
+  handle.color = uniform.GetHandle(head + "color");
+  return handle;
+}
+
+void Mine::SetPointLightValues(const PointLight& light, const PointLightUniformHandleOpenGL& handle, ShaderUniformOpenGL& uniform) {
+  uniform.SetValue(handle.intensity, light.intensity);
+  uniform.SetValue(handle.pos, light.pos);
+  uniform.SetValue(handle.color, light.color);
+}
 
 void Mine::SetPointLightValues(const PointLight& light, int index, ShaderUniformOpenGL& uniform) {
-  uniform.SetValue(__head + std::to_string(index) + __intensityTail, light.intensity);
-  uniform.SetValue(__head + std::to_string(index) + __posTail, light.pos);
-  uniform.SetValue(__head + std::to_string(index) + __colorTail, light.color);
+  SetPointLightValues(light, GetPointLightHandlesOpenGL(uniform, index), uniform);
 }
\ No newline at end of file
@@ -1,11 +1,15 @@
 #pragma once
 
 #include <glad/glad.h>
+#include <atomic>
 #include <filesystem>
 #include <map>
 #include <variant>
 #include <memory>
 #include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "Define.h"
 #include "Mesh.h"
@@ -28,16 +32,46 @@ struct VertexAttribDescOpenGL {
   GLuint index;
   GLint size;
   GLenum type;
+  GLboolean normalized;
   GLsizei stride;
   size_t offset;
 };
 
+struct MeshLodDescOpenGL {
+  GLsizei indexOffset;
+  GLsizei indexCount;
+  float error;  //max distance to the full mesh in object space
+};
+
+struct SubMeshDescOpenGL {
+  std::string name;
+  GLsizei indexOffset;
+  GLsizei indexCount;
+  std::vector<MeshLodDescOpenGL> lods;  //coarser levels, index ranges after all submeshes
+  BoundingBox bounds;                   //object space
+  BoundingSphere sphere;
+};
+
 struct GPUMeshDescOpenGL {
   std::vector<VertexAttribDescOpenGL> attribDesc;
-  std::vector<float> data;
-  std::vector<unsigned int> indices;
+  std::vector<unsigned char> data;
+  std::vector<unsigned int> indices;   //always 32 bit here, packed to indexType on upload
+  GLenum indexType = GL_UNSIGNED_INT;  //or GL_UNSIGNED_SHORT
+  std::vector<SubMeshDescOpenGL> subMeshes;
+  Vector4 positionDecode = Vector4(0, 0, 0, 1);  //object position = xyz + stored position * w, for normalized positions
 };
 
+/*
+ * GL_UNSIGNED_SHORT if every index fits
+ */
+GLenum SelectIndexTypeOpenGL(size_t vertexCount);
+size_t IndexSizeOpenGL(GLenum indexType);
+std::vector<unsigned char> PackIndicesOpenGL(const std::vector<unsigned int>& indices, GLenum indexType);
+/*
+ * fill bounds and sphere of every submesh, desc positions must be float
+ */
+void ComputeSubMeshBoundsOpenGL(GPUMeshDescOpenGL& desc);
+
 class GPUBufferOpenGL {
  private:
   GLuint _handle;
@@ -56,7 +90,13 @@ class GPUBufferOpenGL {
   constexpr GLenum GetTarget() const { return _target; }
   constexpr GLenum GetUsage() const { return _usage; }
   constexpr GLsizeiptr GetSize() const { return _size; }
+  constexpr GLuint GetHandle() const { return _handle; }
   void Bind() const;
+  /*
+   * indexed targets only (GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER)
+   */
+  void BindBase(GLuint index) const;
+  void SetSubData(GLintptr offset, const void* data, GLsizeiptr size) const;
   void Delete();
 };
 
@@ -65,10 +105,28 @@ class GPUMeshOpenGL {
   GLuint _vao;
   GPUBufferOpenGL _vbo;
   GPUBufferOpenGL _ebo;
+  std::vector<VertexAttribDescOpenGL> _attribDesc;
+  GLenum _indexType;
+  GLsizei _indexCount;
+  std::vector<SubMeshDescOpenGL> _subMeshes;
+  BoundingBox _bounds;
+  BoundingSphere _sphere;
+  Vector4 _positionDecode;
 
  public:
   GPUMeshOpenGL();
   GPUMeshOpenGL(const GPUMeshDescOpenGL& desc);
+  /*
+   * upload raw memory as is (e.g. mapped cache file)
+   */
+  GPUMeshOpenGL(const std::vector<VertexAttribDescOpenGL>& attribDesc,
+                const void* vertexData,
+                GLsizeiptr vertexSize,
+                const void* indexData,
+                GLsizeiptr indexSize,
+                GLenum indexType,
+                std::vector<SubMeshDescOpenGL> subMeshes,
+                const Vector4& positionDecode = Vector4(0, 0, 0, 1));
   GPUMeshOpenGL(const GPUMeshOpenGL&) = delete;
   GPUMeshOpenGL(GPUMeshOpenGL&& o) noexcept;
   ~GPUMeshOpenGL();
@@ -77,6 +135,104 @@ class GPUMeshOpenGL {
   void Bind() const;
   void Delete();
   GLsizei GetIndexCount() const;
+  GLenum GetIndexType() const;
+  /*
+   * first index and index count of a submesh lod, subMesh -1 is whole mesh
+   */
+  std::pair<GLsizei, GLsizei> GetIndexRange(int subMesh, int lod) const;
+  const std::vector<VertexAttribDescOpenGL>& GetAttribDesc() const;
+  const GPUBufferOpenGL& GetVertexBuffer() const;
+  const GPUBufferOpenGL& GetIndexBuffer() const;
+  /*
+   * point the per instance mat4 at INSTANCE_MODEL_ATTRIB_LOCATION (4 slots) to buffer + offset,
+   * shaders that do not read it are unaffected
+   */
+  void BindInstanceBuffer(GLuint buffer, GLintptr offset) const;
+  /*
+   * multiply into model matrix, identity unless positions are normalized integers
+   */
+  Matrix4x4 GetPositionDecodeMatrix() const;
+  const std::vector<SubMeshDescOpenGL>& GetSubMeshes() const;
+  /*
+   * -1 if not found
+   */
+  int FindSubMesh(std::string_view name) const;
+  /*
+   * coarsest lod whose error is below maxError, 0 is the full mesh
+   */
+  int SelectLod(int subMesh, float maxError) const;
+  /*
+   * object space, subMesh -1 is whole mesh
+   */
+  const BoundingBox& GetBounds(int subMesh = -1) const;
+  const BoundingSphere& GetBoundingSphere(int subMesh = -1) const;
+};
+
+constexpr GLuint INSTANCE_MODEL_ATTRIB_LOCATION = 5;  //after MeshPoolOpenGL::DRAW_ID_ATTRIB_LOCATION
+
+/*
+ * layout of one glMultiDrawElementsIndirect command
+ */
+struct DrawElementsIndirectCommandOpenGL {
+  GLuint count;
+  GLuint instanceCount;
+  GLuint firstIndex;
+  GLint baseVertex;
+  GLuint baseInstance;
+};
+
+/*
+ * where a mesh landed in a MeshPoolOpenGL, add to the mesh's own index range
+ */
+struct MeshPoolRangeOpenGL {
+  GLint baseVertex;
+  GLuint firstIndex;
+};
+
+/*
+ * shared vertex and index buffers for meshes with identical vertex layout and index type,
+ * so one multi draw can cover all of them. meshes are copied on the gpu.
+ * attribute DRAW_ID_ATTRIB_LOCATION is 0, 1, 2... per instance, draws that set
+ * baseInstance to their draw index can read it where gl_DrawIDARB is missing
+ */
+class MeshPoolOpenGL {
+ public:
+  static constexpr GLuint DRAW_ID_ATTRIB_LOCATION = 4;
+
+ private:
+  GLuint _vao;
+  GPUBufferOpenGL _vbo;
+  GPUBufferOpenGL _ebo;
+  GPUBufferOpenGL _drawIds;
+  std::vector<VertexAttribDescOpenGL> _attribDesc;
+  GLenum _indexType;
+  GLsizeiptr _vertexUsed;
+  GLsizeiptr _indexUsed;
+  GLuint _drawIdCount;
+
+  void SetupVertexArray();
+
+ public:
+  MeshPoolOpenGL();
+  MeshPoolOpenGL(const std::vector<VertexAttribDescOpenGL>& attribDesc, GLenum indexType);
+  MeshPoolOpenGL(const MeshPoolOpenGL&) = delete;
+  MeshPoolOpenGL(MeshPoolOpenGL&& o) noexcept;
+  ~MeshPoolOpenGL();
+  MeshPoolOpenGL& operator=(const MeshPoolOpenGL&) = delete;
+  MeshPoolOpenGL& operator=(MeshPoolOpenGL&& o) noexcept;
+  bool IsCompatible(const GPUMeshOpenGL& mesh) const;
+  /*
+   * buffers grow by doubling, the mesh must be compatible
+   */
+  MeshPoolRangeOpenGL Add(const GPUMeshOpenGL& mesh);
+  /*
+   * make the draw id attribute cover count draws
+   */
+  void ReserveDraws(GLuint count);
+  const std::vector<VertexAttribDescOpenGL>& GetAttribDesc() const;
+  constexpr GLenum GetIndexType() const { return _indexType; }
+  void Bind() const;
+  void Delete();
 };
 
 struct ShaderUniformDescOpenGL {
@@ -87,6 +243,15 @@ struct ShaderUniformDescOpenGL {
 };
 
 using UniformDescMapOpenGL = std::map<std::string, ShaderUniformDescOpenGL>;
+
+struct ShaderUniformBlockDescOpenGL {
+  std::string name;
+  GLuint index;
+  GLint binding;  //from layout(binding = n)
+  GLint size;     //std140 data size in bytes
+};
+
+using UniformBlockDescMapOpenGL = std::map<std::string, ShaderUniformBlockDescOpenGL>;
 template <typename T>
 using UniformArrayObjectOpenGL = std::vector<T>;
 using UniformObjectOpenGL = std::variant<int,
@@ -95,25 +260,129 @@ using UniformObjectOpenGL = std::variant<int,
                                          Matrix4x4,
                                          UniformArrayObjectOpenGL<Matrix4x4>,
                                          UniformArrayObjectOpenGL<int>>;
-using UniformMapOpenGL = std::map<std::string_view, UniformObjectOpenGL>;
+/*
+ * slot of a uniform in ShaderUniformOpenGL, -1 if the program has no such active uniform.
+ * slots follow the name order of UniformDescMapOpenGL, so they are valid for every material of one program
+ */
+using UniformHandleOpenGL = int;
+constexpr UniformHandleOpenGL INVALID_UNIFORM_HANDLE_OPENGL = -1;
+using UniformSlotMapOpenGL = std::map<std::string_view, UniformHandleOpenGL>;
+using UniformSlotsOpenGL = std::vector<UniformObjectOpenGL>;
+
+/*
+ * name, value pairs, become #define lines right after #version in every stage
+ */
+using ShaderDefinesOpenGL = std::vector<std::pair<std::string, std::string>>;
+
+std::string InjectShaderDefinesOpenGL(std::string_view source, const ShaderDefinesOpenGL& defines);
 
 class ShaderProgramOpenGL {
  private:
   GLuint _handle;
-  UniformDescMapOpenGL _uniformDesc;
+  UniformDescMapOpenGL _uniformDesc;  //default block only, block members are in _uniformBlockDesc
+  UniformBlockDescMapOpenGL _uniformBlockDesc;
+  std::vector<const ShaderUniformDescOpenGL*> _uniformSlots;
+  //values the program object holds, SetPass skips slots that did not change
+  mutable UniformSlotsOpenGL _uploaded;
+  mutable std::vector<unsigned char> _uploadedValid;
+
+  void Reflect();
 
  public:
   ShaderProgramOpenGL();
   ShaderProgramOpenGL(std::string_view vs, std::string_view fs);
+  /*
+   * takes ownership of a linked program, glProgramBinary for example
+   */
+  explicit ShaderProgramOpenGL(GLuint linkedProgram);
   ShaderProgramOpenGL(const ShaderProgramOpenGL&) = delete;
   ShaderProgramOpenGL(ShaderProgramOpenGL&& o) noexcept;
   ~ShaderProgramOpenGL();
   ShaderProgramOpenGL& operator=(const ShaderProgramOpenGL&) = delete;
   ShaderProgramOpenGL& operator=(ShaderProgramOpenGL&& o) noexcept;
+  constexpr GLuint GetHandle() const { return _handle; }
   void Bind() const;
   void Delete();
   const UniformDescMapOpenGL& GetUniformDesc() const;
-  void SetPass(const UniformMapOpenGL& uniform) const;
+  const UniformBlockDescMapOpenGL& GetUniformBlockDesc() const;
+  void SetPass(const UniformSlotsOpenGL& uniform) const;
+};
+
+/*
+ * std140 uniform block shared by every program that declares it at the same binding.
+ * Upload once per frame, the layout struct on the CPU side must match the glsl block
+ */
+class UniformBlockOpenGL {
+ private:
+  GPUBufferOpenGL _buffer;
+  GLuint _binding;
+
+ public:
+  UniformBlockOpenGL();
+  UniformBlockOpenGL(GLuint binding, GLsizeiptr size);
+  UniformBlockOpenGL(const UniformBlockOpenGL&) = delete;
+  UniformBlockOpenGL(UniformBlockOpenGL&& o) noexcept;
+  ~UniformBlockOpenGL();
+  UniformBlockOpenGL& operator=(const UniformBlockOpenGL&) = delete;
+  UniformBlockOpenGL& operator=(UniformBlockOpenGL&& o) noexcept;
+  constexpr GLuint GetBinding() const { return _binding; }
+  constexpr GLsizeiptr GetSize() const { return _buffer.GetSize(); }
+  /*
+   * writes size bytes from the start of the block and binds it to its binding point
+   */
+  void Upload(const void* data, GLsizeiptr size) const;
+  void Bind() const;
+  void Delete();
+};
+
+/*
+ * piece of a RingBufferOpenGL frame region, ptr is write only and valid until the region comes back
+ */
+struct RingAllocationOpenGL {
+  void* ptr;
+  GLintptr offset;
+  GLsizeiptr size;
+};
+
+/*
+ * glBufferStorage buffer mapped once with GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT,
+ * one region per frame in flight. BeginFrame waits for the fence of the region it reuses,
+ * EndFrame fences the current one. Allocate is lock free, so worker threads may allocate
+ * and write, binding and drawing stay on the gl thread
+ */
+class RingBufferOpenGL {
+ private:
+  GLuint _handle;
+  unsigned char* _ptr;
+  GLsizeiptr _frameSize;
+  int _frameCount;
+  int _frame;
+  std::atomic<GLsizeiptr> _head;
+  std::vector<GLsync> _fences;
+
+ public:
+  RingBufferOpenGL();
+  /*
+   * frameSize must be a multiple of every alignment passed to Allocate,
+   * otherwise regions after the first start misaligned
+   */
+  RingBufferOpenGL(GLsizeiptr frameSize, int frameCount);
+  RingBufferOpenGL(const RingBufferOpenGL&) = delete;
+  RingBufferOpenGL(RingBufferOpenGL&& o) noexcept;
+  ~RingBufferOpenGL();
+  RingBufferOpenGL& operator=(const RingBufferOpenGL&) = delete;
+  RingBufferOpenGL& operator=(RingBufferOpenGL&& o) noexcept;
+  constexpr GLuint GetHandle() const { return _handle; }
+  constexpr GLsizeiptr GetFrameSize() const { return _frameSize; }
+  constexpr int GetFrameCount() const { return _frameCount; }
+  void BeginFrame();
+  void EndFrame();
+  /*
+   * the frame region must have room for size, the caller sizes the ring up front
+   */
+  RingAllocationOpenGL Allocate(GLsizeiptr size, GLsizeiptr alignment);
+  void BindRange(GLenum target, GLuint index, const RingAllocationOpenGL& allocation) const;
+  void Delete();
 };
 
 class ShaderUniformOpenGL {
@@ -121,7 +390,8 @@ class ShaderUniformOpenGL {
   static UniformObjectOpenGL CreateUniformObject(GLenum type, int arrayCount);
 
  private:
-  UniformMapOpenGL _objectMap;
+  UniformSlotMapOpenGL _slotMap;
+  UniformSlotsOpenGL _objects;
 
  public:
   ShaderUniformOpenGL();
@@ -131,24 +401,36 @@ class ShaderUniformOpenGL {
   ~ShaderUniformOpenGL();
   ShaderUniformOpenGL& operator=(const ShaderUniformOpenGL& o);
   ShaderUniformOpenGL& operator=(ShaderUniformOpenGL&& o);
+  /*
+   * name is the full GL name, "light[2].pos" for struct array members, "lightMVP" for plain arrays.
+   * resolve once when the material is created, not per frame
+   */
+  UniformHandleOpenGL GetHandle(std::string_view name) const;
   template <typename T>
-  void SetValue(std::string_view name, T value) {
-    auto iter = _objectMap.find(name);
-    if (iter == _objectMap.end()) {
+  void SetValue(UniformHandleOpenGL handle, T value) {
+    if (handle < 0) {
       return;
     }
-    iter->second.emplace<T>(value);
+    _objects[handle].emplace<T>(value);
   }
   template <typename T>
-  void SetArray(std::string_view name, int index, T value) {
-    auto iter = _objectMap.find(name);
-    if (iter == _objectMap.end()) {
+  void SetArray(UniformHandleOpenGL handle, int index, T value) {
+    if (handle < 0) {
       return;
     }
-    auto& array = std::get<UniformArrayObjectOpenGL<T>>(iter->second);
+    auto& array = std::get<UniformArrayObjectOpenGL<T>>(_objects[handle]);
     array[index] = value;
   }
-  const UniformMapOpenGL& GetUniformObjects() const;
+  //slow path, one map lookup per call
+  template <typename T>
+  void SetValue(std::string_view name, T value) {
+    SetValue(GetHandle(name), value);
+  }
+  template <typename T>
+  void SetArray(std::string_view name, int index, T value) {
+    SetArray(GetHandle(name), index, value);
+  }
+  const UniformSlotsOpenGL& GetUniformObjects() const;
 };
 
 struct GPUTexture2DDescOpenGL {
@@ -191,17 +473,56 @@ class GPUTexture2DOpenGL {
   GPUTexture2DOpenGL& operator=(const GPUTexture2DOpenGL&) = delete;
   GPUTexture2DOpenGL& operator=(GPUTexture2DOpenGL&& o);
   void Bind(GLenum id) const;
+  /*
+   * rebuilds every level from level 0, the chain must be allocated (mipmapLevel > 0)
+   */
+  void GenerateMipmap() const;
   void Delete();
   constexpr GLuint GetHandle() const { return _handle; }
   constexpr int GetWidth() const { return _width; }
   constexpr int GetHeight() const { return _height; }
 };
 
+struct SamplerDescOpenGL {
+  GLint wrapS;
+  GLint wrapT;
+  GLint minFliter;
+  GLint magFliter;
+  /*
+   * GL_NONE returns texels
+   * GL_LEQUAL and the other depth funcs compare against the reference, for sampler2DShadow
+   */
+  GLint compareFunc;
+};
+
+/*
+ * overrides the sampling state of any texture on the units it is bound to
+ */
+class SamplerOpenGL {
+ private:
+  GLuint _handle;
+
+ public:
+  SamplerOpenGL();
+  SamplerOpenGL(const SamplerDescOpenGL& desc);
+  SamplerOpenGL(const SamplerOpenGL&) = delete;
+  SamplerOpenGL(SamplerOpenGL&& o);
+  ~SamplerOpenGL();
+  SamplerOpenGL& operator=(const SamplerOpenGL&) = delete;
+  SamplerOpenGL& operator=(SamplerOpenGL&& o);
+  void Bind(GLuint unit) const;
+  void Delete();
+  constexpr GLuint GetHandle() const { return _handle; }
+};
+
 class MeshRendererOpenGL {
  public:
   std::weak_ptr<ShaderProgramOpenGL> shader;
   std::weak_ptr<ShaderUniformOpenGL> material;
   std::weak_ptr<GPUMeshOpenGL> mesh;
+  int subMesh;  //index of GPUMeshOpenGL::GetSubMeshes, -1 draws whole mesh
+  int lod;      //0 is full detail, ignored when drawing whole mesh
+  GLsizei instanceCount;  //above 1 draws instanced, see GPUMeshOpenGL::BindInstanceBuffer
 
  public:
   MeshRendererOpenGL();
@@ -257,10 +578,19 @@ class ShadowMap2DOpenGL {
   //emm...why shared ptr?
   std::shared_ptr<FrameBufferOpenGL> _frameBuffer;
   std::shared_ptr<GPUTexture2DOpenGL> _depthMap;
+  //filterable maps only
+  std::shared_ptr<GPUTexture2DOpenGL> _momentMap;  //RG32F depth and depth^2, color target of _frameBuffer, mipmapped if filtered
+  std::shared_ptr<GPUTexture2DOpenGL> _blurMap;    //RG32F, result of the first blur direction, filtered maps only
+  std::shared_ptr<FrameBufferOpenGL> _momentFrameBuffer;
+  std::shared_ptr<FrameBufferOpenGL> _blurFrameBuffer;
 
  public:
   ShadowMap2DOpenGL();
-  ShadowMap2DOpenGL(int width, int height);
+  /*
+   * moments adds a color target for variance shadow maps.
+   * filtered adds its mips and the blur targets, a map that is only copied from needs neither
+   */
+  ShadowMap2DOpenGL(int width, int height, bool moments = false, bool filtered = true);
   ShadowMap2DOpenGL(const ShadowMap2DOpenGL&) = delete;
   ShadowMap2DOpenGL(ShadowMap2DOpenGL&& o);
   ~ShadowMap2DOpenGL();
@@ -272,8 +602,74 @@ class ShadowMap2DOpenGL {
   void Delete();
 
   const GPUTexture2DOpenGL& GetDepthMap() const;
+  bool HasMoments() const;
+  const GPUTexture2DOpenGL& GetMomentMap() const;
+  const GPUTexture2DOpenGL& GetBlurMap() const;
+  /*
+   * separable blur, moments to blur map then back without the depth attachment
+   */
+  void BindBlurTarget() const;
+  void BindMomentTarget() const;
+  /*
+   * depth and level 0 of moments inside the rect, src must have the same size and maps
+   */
+  void CopyRegion(const ShadowMap2DOpenGL& src, int x, int y, int width, int height) const;
+};
+
+/*
+ * gl call counters, ShouldTerminateOpenGL closes a frame
+ */
+struct FrameStatsOpenGL {
+  size_t uniformCalls;    //glUniform* issued by SetPass
+  size_t uniformSkipped;  //slot already held the same value
+  size_t stateCalls;      //binds and state changes issued through the state cache
+  size_t stateSkipped;    //redundant ones the cache dropped
 };
 
+/*
+ * counters of the last finished frame
+ */
+const FrameStatsOpenGL& GetFrameStatsOpenGL();
+
+/*
+ * context state cache, every wrapper binds through these.
+ * a call that matches the cached value is dropped.
+ * raw gl calls that change the same state must be followed by InvalidateStateCacheOpenGL
+ */
+void UseProgramOpenGL(GLuint program);
+void BindVertexArrayOpenGL(GLuint vao);
+/*
+ * GL_ELEMENT_ARRAY_BUFFER is vao state and always passes through
+ */
+void BindBufferOpenGL(GLenum target, GLuint buffer);
+void BindBufferBaseOpenGL(GLenum target, GLuint index, GLuint buffer);
+/*
+ * never dropped, ranges change every draw
+ */
+void BindBufferRangeOpenGL(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+/*
+ * guarantees the binding only. a cached hit skips glActiveTexture, so the active unit may be any other one.
+ * edit textures through their handle (glTexture*) rather than through the unit
+ */
+void BindTextureOpenGL(GLuint unit, GLenum target, GLuint texture);
+/*
+ * 0 restores the sampling state of the texture itself
+ */
+void BindSamplerOpenGL(GLuint unit, GLuint sampler);
+/*
+ * 3 vertices without attributes, the vertex shader builds them from gl_VertexID
+ */
+void DrawFullScreenTriangleOpenGL();
+void BindFrameBufferOpenGL(GLenum target, GLuint frameBuffer);
+void SetViewportOpenGL(GLint x, GLint y, GLsizei width, GLsizei height);
+void SetEnableOpenGL(GLenum cap, bool enable);
+void SetClearColorOpenGL(float r, float g, float b, float a);
+void InvalidateStateCacheOpenGL();
+/*
+ * GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT or GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, 4 for other targets
+ */
+GLsizeiptr GetBufferOffsetAlignmentOpenGL(GLenum target);
+
 void InitOpenGL(int width, int height, const char* title);
 void TerminateOpenGL();
 bool ShouldTerminateOpenGL();
@@ -281,13 +677,47 @@ void* GetNativeWindowOpenGL();
 void SetFrameBufferResizeCallbackOpenGL(std::function<void(int, int)> callback);
 std::pair<int, int> GetFrameBufferSizeOpenGL();
 
-std::shared_ptr<GPUMeshOpenGL> CreateMeshBufferOpenGL(const Mesh& mesh, bool hasNormal = true, bool hasTexcoord = true);
+GPUMeshDescOpenGL CreateMeshDescOpenGL(const Mesh& mesh,
+                                       bool hasNormal = true,
+                                       bool hasTexcoord = true,
+                                       VertexWeldMode weld = VertexWeldMode::Hash);
+std::shared_ptr<GPUMeshOpenGL> CreateMeshBufferOpenGL(const Mesh& mesh,
+                                                      bool hasNormal = true,
+                                                      bool hasTexcoord = true,
+                                                      VertexWeldMode weld = VertexWeldMode::Hash);
+/*
+ * one vertex buffer and one index buffer for all usemtl groups,
+ * each group becomes a named submesh range
+ */
+GPUMeshDescOpenGL CreateMultiMeshDescOpenGL(const MultiMesh& mesh,
+                                            bool hasNormal = true,
+                                            bool hasTexcoord = true,
+                                            VertexWeldMode weld = VertexWeldMode::Hash);
+std::shared_ptr<GPUMeshOpenGL> CreateMultiMeshBufferOpenGL(const MultiMesh& mesh,
+                                                           bool hasNormal = true,
+                                                           bool hasTexcoord = true,
+                                                           VertexWeldMode weld = VertexWeldMode::Hash);
 std::shared_ptr<ShaderProgramOpenGL> CreateShaderProgramOpenGL(const std::filesystem::path& path);
+std::shared_ptr<ShaderProgramOpenGL> CreateShaderProgramOpenGL(const std::filesystem::path& vsPath, const std::filesystem::path& fsPath);
+std::shared_ptr<ShaderProgramOpenGL> CreateShaderProgramOpenGL(const std::filesystem::path& vsPath,
+                                                               const std::filesystem::path& fsPath,
+                                                               const ShaderDefinesOpenGL& defines);
 std::shared_ptr<ShaderUniformOpenGL> CreateShaderUniformOpenGL(const ShaderProgramOpenGL& shader);
+std::shared_ptr<UniformBlockOpenGL> CreateUniformBlockOpenGL(GLuint binding, GLsizeiptr size);
+std::shared_ptr<RingBufferOpenGL> CreateRingBufferOpenGL(GLsizeiptr frameSize, int frameCount = 3);
 std::shared_ptr<GPUTexture2DOpenGL> CreateTexture2DOpenGL(const GPUTexture2DDescOpenGL& desc);
+std::shared_ptr<SamplerOpenGL> CreateSamplerOpenGL(const SamplerDescOpenGL& desc);
 std::shared_ptr<GPUTexture2DOpenGL> CreateTexture2DOpenGL(const Texture2D& tex2d);
 std::shared_ptr<FrameBufferOpenGL> CreateFrameBufferOpenGL();
 
+struct PointLightUniformHandleOpenGL {
+  UniformHandleOpenGL intensity;
+  UniformHandleOpenGL pos;
+  UniformHandleOpenGL color;
+};
+
+PointLightUniformHandleOpenGL GetPointLightHandlesOpenGL(const ShaderUniformOpenGL& uniform, int index);
+void SetPointLightValues(const PointLight& light, const PointLightUniformHandleOpenGL& handle, ShaderUniformOpenGL& uniform);
 void SetPointLightValues(const PointLight& light, int index, ShaderUniformOpenGL& uniform);
 
 }  // namespace Mine
\ No newline at end of file
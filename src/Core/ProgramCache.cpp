@@ -0,0 +1,197 @@
+#include "ProgramCache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "Hash.h"
+#include "MappedFile.h"
+
+using namespace Mine;
+
+/*
+ * program binary file layout:
+ * | header | binary |
+ */
+
+static const char __programCacheMagic[8] = {'M', 'I', 'N', 'E', 'P', 'R', 'G', '\0'};
+constexpr uint32_t PROGRAM_CACHE_VERSION = 1;
+
+struct _ProgramCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t binaryFormat;
+  uint64_t key;
+  uint64_t binarySize;
+};
+
+static ProgramCacheStats _stats;
+
+const ProgramCacheStats& Mine::GetProgramCacheStats() { return _stats; }
+
+static std::string _ReadText(const std::filesystem::path& path) {
+  std::ifstream fs(path, std::ios::in);
+  return std::string(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>());
+}
+
+uint64_t Mine::CreateProgramCacheKey(std::string_view vs, std::string_view fs) {
+  uint64_t key = Hash64(vs.data(), vs.size());
+  key = Hash64(fs.data(), fs.size(), key);
+  for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+    const char* str;
+    MineGLFuncCall(str = (const char*)glGetString(name));
+    if (str != nullptr) {
+      key = Hash64(str, strlen(str), key);
+    }
+  }
+  return key;
+}
+
+bool Mine::WriteProgramCache(const std::filesystem::path& path, uint64_t key, const ShaderProgramOpenGL& program) {
+  GLint length = 0;
+  MineGLFuncCall(glGetProgramiv(program.GetHandle(), GL_PROGRAM_BINARY_LENGTH, &length));
+  if (length <= 0) {
+    return false;
+  }
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  MineGLFuncCall(glGetProgramBinary(program.GetHandle(), length, &length, &format, binary.data()));
+
+  _ProgramCacheHeader h;
+  memcpy(h.magic, __programCacheMagic, sizeof(h.magic));
+  h.version = PROGRAM_CACHE_VERSION;
+  h.binaryFormat = format;
+  h.key = key;
+  h.binarySize = (uint64_t)length;
+
+  auto temp = path;
+  temp += ".tmp";
+  std::ofstream fs(temp, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!fs.is_open()) {
+    return false;
+  }
+  fs.write((const char*)&h, sizeof(h));
+  fs.write(binary.data(), length);
+  fs.close();
+
+  std::error_code ec;
+  if (!fs) {
+    std::filesystem::remove(temp, ec);
+    return false;
+  }
+  std::filesystem::rename(temp, path, ec);
+  if (ec) {
+    std::filesystem::remove(temp, ec);
+    return false;
+  }
+  return true;
+}
+
+std::shared_ptr<ShaderProgramOpenGL> Mine::LoadProgramCacheOpenGL(const std::filesystem::path& path, uint64_t key) {
+  MappedFile file(path);
+  if (!file.IsOpen() || file.GetSize() < sizeof(_ProgramCacheHeader)) {
+    return nullptr;
+  }
+  const char* data = file.GetData();
+  _ProgramCacheHeader h;
+  memcpy(&h, data, sizeof(h));
+  if (memcmp(h.magic, __programCacheMagic, sizeof(h.magic)) != 0 ||
+      h.version != PROGRAM_CACHE_VERSION ||
+      h.key != key ||
+      sizeof(h) + h.binarySize != file.GetSize()) {
+    return nullptr;
+  }
+  GLuint program;
+  MineGLFuncCall(program = glCreateProgram());
+  MineGLFuncCall(glProgramBinary(program, h.binaryFormat, data + sizeof(h), (GLsizei)h.binarySize));
+  GLint success;
+  MineGLFuncCall(glGetProgramiv(program, GL_LINK_STATUS, &success));
+  if (success != GL_TRUE) {
+    //drivers may refuse binaries of another build even when the version string matches
+    MineGLFuncCall(glDeleteProgram(program));
+    _stats.rejected++;
+    return nullptr;
+  }
+  return std::make_shared<ShaderProgramOpenGL>(program);
+}
+
+static std::string _CacheFileName(const std::filesystem::path& vsPath,
+                                  const std::filesystem::path& fsPath,
+                                  const ShaderDefinesOpenGL& defines) {
+  std::string name = vsPath.stem().generic_u8string() + "_" + fsPath.stem().generic_u8string();
+  if (!defines.empty()) {
+    uint64_t hash = 0;
+    for (const auto& [k, v] : defines) {
+      hash = Hash64(k.data(), k.size(), hash);
+      hash = Hash64(v.data(), v.size(), hash);
+    }
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+    name += "_";
+    name += hex;
+  }
+  return name + ".mineprog";
+}
+
+std::shared_ptr<ShaderProgramOpenGL> Mine::CreateShaderProgramCachedOpenGL(const std::filesystem::path& vsPath,
+                                                                          const std::filesystem::path& fsPath,
+                                                                          const ShaderDefinesOpenGL& defines) {
+  auto start = std::chrono::steady_clock::now();
+  auto vsSrc = InjectShaderDefinesOpenGL(_ReadText(vsPath), defines);
+  auto fsSrc = InjectShaderDefinesOpenGL(_ReadText(fsPath), defines);
+  auto cached = vsPath.parent_path() / _CacheFileName(vsPath, fsPath, defines);
+  auto key = CreateProgramCacheKey(vsSrc, fsSrc);
+  auto program = LoadProgramCacheOpenGL(cached, key);
+  if (program != nullptr) {
+    _stats.loaded++;
+  } else {
+    program = std::make_shared<ShaderProgramOpenGL>(vsSrc, fsSrc);
+    _stats.compiled++;
+    GLint formatCount = 0;
+    MineGLFuncCall(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount));
+    if (program->GetHandle() != 0 && formatCount > 0 && !WriteProgramCache(cached, key, *program)) {
+      std::cout << "can't write program cache:" << cached.generic_u8string() << "\n";
+    }
+  }
+  _stats.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return program;
+}
+
+std::shared_ptr<ShaderProgramOpenGL> Mine::CreateShaderProgramCachedOpenGL(const std::filesystem::path& path) {
+  return CreateShaderProgramCachedOpenGL(path.generic_u8string() + ".vert", path.generic_u8string() + ".frag");
+}
+
+ShaderVariantsOpenGL::ShaderVariantsOpenGL(const std::filesystem::path& vsPath, const std::filesystem::path& fsPath)
+    : _vsPath(vsPath), _fsPath(fsPath) {}
+
+const std::shared_ptr<ShaderProgramOpenGL>& ShaderVariantsOpenGL::Get(const ShaderDefinesOpenGL& defines) {
+  auto iter = _programs.find(defines);
+  if (iter != _programs.end()) {
+    return iter->second;
+  }
+  auto program = CreateShaderProgramCachedOpenGL(_vsPath, _fsPath, defines);
+  return _programs.emplace(defines, std::move(program)).first->second;
+}
+
+size_t ShaderVariantsOpenGL::GetCount() const { return _programs.size(); }
+
+const std::filesystem::path& ShaderVariantsOpenGL::GetFragmentPath() const { return _fsPath; }
+
+void ShaderVariantsOpenGL::Delete() {
+  for (auto& [defines, program] : _programs) {
+    program->Delete();
+  }
+  _programs.clear();
+}
+
+std::shared_ptr<ShaderVariantsOpenGL> Mine::CreateShaderVariantsOpenGL(const std::filesystem::path& vsPath,
+                                                                       const std::filesystem::path& fsPath) {
+  return std::make_shared<ShaderVariantsOpenGL>(vsPath, fsPath);
+}
+
+std::shared_ptr<ShaderVariantsOpenGL> Mine::CreateShaderVariantsOpenGL(const std::filesystem::path& path) {
+  return CreateShaderVariantsOpenGL(path.generic_u8string() + ".vert", path.generic_u8string() + ".frag");
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string_view>
+
+#include "OpenGLContext.h"
+
+namespace Mine {
+
+/*
+ * hash of both sources plus GL_VENDOR, GL_RENDERER and GL_VERSION.
+ * a driver update or a shader edit makes the binary stale
+ */
+uint64_t CreateProgramCacheKey(std::string_view vs, std::string_view fs);
+bool WriteProgramCache(const std::filesystem::path& path, uint64_t key, const ShaderProgramOpenGL& program);
+/*
+ * returns nullptr if file is missing, broken, stale or rejected by the driver
+ */
+std::shared_ptr<ShaderProgramOpenGL> LoadProgramCacheOpenGL(const std::filesystem::path& path, uint64_t key);
+
+/*
+ * counters since launch, cold start compiles everything, warm start loads everything
+ */
+struct ProgramCacheStats {
+  int loaded;           //from binary
+  int compiled;         //from source, binary missing or stale
+  int rejected;         //binary refused by the driver, compiled after
+  double milliseconds;  //spent in CreateShaderProgramCachedOpenGL
+};
+
+const ProgramCacheStats& GetProgramCacheStats();
+
+/*
+ * program of vsPath and fsPath through binary file <vs stem>_<fs stem>.mineprog next to vsPath,
+ * the binary is written when missing or stale.
+ * with defines the file is <vs stem>_<fs stem>_<defines hash>.mineprog, one per permutation
+ */
+std::shared_ptr<ShaderProgramOpenGL> CreateShaderProgramCachedOpenGL(const std::filesystem::path& vsPath,
+                                                                     const std::filesystem::path& fsPath,
+                                                                     const ShaderDefinesOpenGL& defines = {});
+std::shared_ptr<ShaderProgramOpenGL> CreateShaderProgramCachedOpenGL(const std::filesystem::path& path);
+
+/*
+ * permutations of one vs/fs pair, each compiled on first Get and kept until Delete
+ */
+class ShaderVariantsOpenGL {
+ private:
+  std::filesystem::path _vsPath;
+  std::filesystem::path _fsPath;
+  std::map<ShaderDefinesOpenGL, std::shared_ptr<ShaderProgramOpenGL>> _programs;
+
+ public:
+  ShaderVariantsOpenGL(const std::filesystem::path& vsPath, const std::filesystem::path& fsPath);
+  ShaderVariantsOpenGL(const ShaderVariantsOpenGL&) = delete;
+
+  const std::shared_ptr<ShaderProgramOpenGL>& Get(const ShaderDefinesOpenGL& defines);
+  size_t GetCount() const;
+  const std::filesystem::path& GetFragmentPath() const;
+  void Delete();
+};
+
+std::shared_ptr<ShaderVariantsOpenGL> CreateShaderVariantsOpenGL(const std::filesystem::path& vsPath,
+                                                                 const std::filesystem::path& fsPath);
+std::shared_ptr<ShaderVariantsOpenGL> CreateShaderVariantsOpenGL(const std::filesystem::path& path);
+
+}  // namespace Mine
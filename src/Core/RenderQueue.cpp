@@ -0,0 +1,80 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace Mine;
+
+static constexpr int _DEPTH_BITS = 20;
+static constexpr int _MESH_BITS = 14;
+static constexpr int _MATERIAL_BITS = 16;
+static constexpr int _PROGRAM_BITS = 10;
+static constexpr int _PASS_BITS = 4;
+static constexpr size_t _RADIX_MIN_COUNT = 1024;  //below this the 8 histograms cost more than a comparison sort
+
+static uint64_t _Field(uint32_t value, int bits) { return (uint64_t)value & ((1ull << bits) - 1); }
+
+uint64_t Mine::MakeSortKey(SortKeyOrder order, uint32_t pass, uint32_t program, uint32_t material, uint32_t mesh, float depth) {
+  auto d = (uint32_t)(std::clamp(depth, 0.0f, 1.0f) * ((1u << _DEPTH_BITS) - 1));
+  uint64_t state = _Field(program, _PROGRAM_BITS) << (_MATERIAL_BITS + _MESH_BITS) |
+                   _Field(material, _MATERIAL_BITS) << _MESH_BITS |
+                   _Field(mesh, _MESH_BITS);
+  uint64_t key = _Field(pass, _PASS_BITS) << (64 - _PASS_BITS);
+  if (order == SortKeyOrder::FrontToBack) {
+    key |= (uint64_t)d << (64 - _PASS_BITS - _DEPTH_BITS) | state;
+  } else {
+    key |= state << _DEPTH_BITS | d;
+  }
+  return key;
+}
+
+void RenderQueue::Clear() { _records.clear(); }
+
+void RenderQueue::Push(uint64_t key, uint32_t index, int32_t lod) { _records.emplace_back(DrawRecord{key, index, lod}); }
+
+void RenderQueue::Sort() {
+  size_t count = _records.size();
+  if (count < 2) {
+    return;
+  }
+  if (count < _RADIX_MIN_COUNT) {
+    std::stable_sort(_records.begin(), _records.end(), [](const DrawRecord& a, const DrawRecord& b) { return a.key < b.key; });
+    return;
+  }
+  //one read for all 8 histograms
+  size_t histogram[8][256];
+  memset(histogram, 0, sizeof(histogram));
+  for (const auto& r : _records) {
+    for (int b = 0; b < 8; b++) {
+      histogram[b][(r.key >> (b * 8)) & 0xff]++;
+    }
+  }
+  _scratch.resize(count);
+  DrawRecord* src = _records.data();
+  DrawRecord* dst = _scratch.data();
+  for (int b = 0; b < 8; b++) {
+    auto& h = histogram[b];
+    if (h[(src[0].key >> (b * 8)) & 0xff] == count) {
+      continue;  //same byte everywhere
+    }
+    size_t offset = 0;
+    for (auto& c : h) {
+      size_t n = c;
+      c = offset;
+      offset += n;
+    }
+    for (size_t i = 0; i < count; i++) {
+      dst[h[(src[i].key >> (b * 8)) & 0xff]++] = src[i];
+    }
+    std::swap(src, dst);
+  }
+  if (src != _records.data()) {
+    _records.swap(_scratch);
+  }
+}
+
+const DrawRecord* RenderQueue::begin() const { return _records.data(); }
+
+const DrawRecord* RenderQueue::end() const { return _records.data() + _records.size(); }
+
+size_t RenderQueue::Size() const { return _records.size(); }
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace Mine {
+
+/*
+ * which fields lead the key after the pass
+ */
+enum class SortKeyOrder {
+  FrontToBack,  //pass | depth | program | material | mesh, opaque and depth only passes
+  State         //pass | program | material | mesh | depth, fewest switches
+};
+
+/*
+ * 64 bit key, pass 4 bits, program 10, material 16, mesh 14, depth 20.
+ * ids are truncated to their field, depth is clamped to [0, 1]
+ */
+uint64_t MakeSortKey(SortKeyOrder order, uint32_t pass, uint32_t program, uint32_t material, uint32_t mesh, float depth);
+constexpr uint32_t GetSortKeyPass(uint64_t key) { return (uint32_t)(key >> 60); }
+
+struct DrawRecord {
+  uint64_t key;
+  uint32_t index;  //item of the emitting pass
+  int32_t lod;
+};
+
+/*
+ * draws are pushed unsorted then stably sorted by key with an 8 bit lsd radix sort,
+ * bytes that are equal in every key are skipped
+ */
+class RenderQueue {
+ private:
+  std::vector<DrawRecord> _records;
+  std::vector<DrawRecord> _scratch;
+
+ public:
+  void Clear();
+  void Push(uint64_t key, uint32_t index, int32_t lod = 0);
+  void Sort();
+  const DrawRecord* begin() const;
+  const DrawRecord* end() const;
+  size_t Size() const;
+};
+
+}  // namespace Mine
@@ -0,0 +1,106 @@
+#include "ShadowAtlas.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <numeric>
+
+using namespace Mine;
+
+int Mine::FloorPowerOfTwo(int v) {
+  int p = 1;
+  while (p * 2 <= v) {
+    p *= 2;
+  }
+  return p;
+}
+
+//even bits to x, odd bits to y
+static uint32_t _CompactBits(uint64_t v) {
+  v &= 0x5555555555555555ull;
+  v = (v | (v >> 1)) & 0x3333333333333333ull;
+  v = (v | (v >> 2)) & 0x0f0f0f0f0f0f0f0full;
+  v = (v | (v >> 4)) & 0x00ff00ff00ff00ffull;
+  v = (v | (v >> 8)) & 0x0000ffff0000ffffull;
+  v = (v | (v >> 16)) & 0x00000000ffffffffull;
+  return (uint32_t)v;
+}
+
+std::vector<AtlasTile> Mine::PackAtlasTiles(int atlasSize, const std::vector<int>& sizes, const std::vector<float>& importance, int minSize) {
+  //Morton placement walks a square of 2^k cells, any other size puts tiles outside the texture
+  assert(atlasSize > 0 && (atlasSize & (atlasSize - 1)) == 0);
+  assert(importance.size() == sizes.size());
+  std::vector<AtlasTile> tiles(sizes.size(), AtlasTile{0, 0, 0});
+  uint64_t area = 0;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    if (sizes[i] >= minSize && sizes[i] > 0) {
+      tiles[i].size = FloorPowerOfTwo(std::min(sizes[i], atlasSize));
+      area += (uint64_t)tiles[i].size * tiles[i].size;
+    }
+  }
+  uint64_t capacity = (uint64_t)atlasSize * atlasSize;
+  while (area > capacity) {
+    //largest tile, the least important among equals
+    size_t pick = tiles.size();
+    for (size_t i = 0; i < tiles.size(); i++) {
+      if (tiles[i].size > 0 &&
+          (pick == tiles.size() || tiles[i].size > tiles[pick].size ||
+           (tiles[i].size == tiles[pick].size && importance[i] < importance[pick]))) {
+        pick = i;
+      }
+    }
+    if (tiles[pick].size / 2 < minSize) {
+      //nothing halves any more, drop the least important tile
+      for (size_t i = 0; i < tiles.size(); i++) {
+        if (tiles[i].size > 0 && importance[i] < importance[pick]) {
+          pick = i;
+        }
+      }
+      area -= (uint64_t)tiles[pick].size * tiles[pick].size;
+      tiles[pick].size = 0;
+      continue;
+    }
+    area -= (uint64_t)tiles[pick].size * tiles[pick].size * 3 / 4;
+    tiles[pick].size /= 2;
+  }
+
+  std::vector<size_t> order(tiles.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return tiles[a].size > tiles[b].size; });
+  //cursor is in texels of area, always a multiple of the current tile area
+  uint64_t cursor = 0;
+  for (auto i : order) {
+    auto& tile = tiles[i];
+    if (tile.size == 0) {
+      break;
+    }
+    uint64_t cell = (uint64_t)tile.size * tile.size;
+    uint64_t code = cursor / cell;
+    tile.x = (int)_CompactBits(code) * tile.size;
+    tile.y = (int)_CompactBits(code >> 1) * tile.size;
+    cursor += cell;
+  }
+  return tiles;
+}
+
+int Mine::FitAtlasSize(const std::vector<int>& sizes, int maxSize, int minSize) {
+  maxSize = FloorPowerOfTwo(maxSize);
+  int largest = 0;
+  uint64_t area = 0;
+  for (auto size : sizes) {
+    if (size >= minSize && size > 0) {
+      int tile = FloorPowerOfTwo(std::min(size, maxSize));
+      largest = std::max(largest, tile);
+      area += (uint64_t)tile * tile;
+    }
+  }
+  if (largest == 0) {
+    return 0;
+  }
+  //aligned power of two tiles in Morton order leave no gaps, area alone decides
+  int atlasSize = largest;
+  while (atlasSize < maxSize && (uint64_t)atlasSize * atlasSize < area) {
+    atlasSize *= 2;
+  }
+  return atlasSize;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+
+namespace Mine {
+
+/*
+ * square tile of an atlas, in texels
+ */
+struct AtlasTile {
+  int x;
+  int y;
+  int size;  //0 if the tile did not fit
+};
+
+/*
+ * largest power of two not above v, 1 for v < 1
+ */
+int FloorPowerOfTwo(int v);
+
+/*
+ * power of two tiles in a power of two atlas. sizes are rounded down to powers of two and the largest
+ * are halved until everything fits, the less important first among equals. once all are at minSize
+ * the least important tiles are left out.
+ * placed largest first in Morton order, so every tile is aligned to its size and no space is lost.
+ * returns one tile per size, same order
+ */
+std::vector<AtlasTile> PackAtlasTiles(int atlasSize, const std::vector<int>& sizes, const std::vector<float>& importance, int minSize);
+/*
+ * smallest power of two atlas PackAtlasTiles fills without halving, at most maxSize.
+ * 0 without any tile of minSize
+ */
+int FitAtlasSize(const std::vector<int>& sizes, int maxSize, int minSize);
+
+}  // namespace Mine
\ No newline at end of file
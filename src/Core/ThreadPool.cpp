@@ -0,0 +1,95 @@
+#include "ThreadPool.h"
+
+using namespace Mine;
+
+static thread_local bool _insidePool = false;
+
+ThreadPool::ThreadPool() : _func(nullptr), _count(0), _next(0), _done(0), _active(0), _generation(0), _stop(false) {
+  auto cores = std::thread::hardware_concurrency();
+  for (unsigned int i = 1; i < cores; i++) {
+    _workers.emplace_back([this]() { WorkerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _wake.notify_all();
+  for (auto& t : _workers) {
+    t.join();
+  }
+}
+
+size_t ThreadPool::GetThreadCount() const { return _workers.size() + 1; }
+
+size_t ThreadPool::RunTasks(const std::function<void(size_t)>& func, size_t count) {
+  size_t finished = 0;
+  for (size_t i = _next.fetch_add(1); i < count; i = _next.fetch_add(1)) {
+    func(i);
+    finished++;
+  }
+  return finished;
+}
+
+void ThreadPool::WorkerLoop() {
+  _insidePool = true;
+  uint64_t seen = 0;
+  while (true) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _wake.wait(lock, [&]() { return _stop || _generation != seen; });
+    if (_stop) {
+      return;
+    }
+    seen = _generation;
+    if (_func == nullptr) {  //woke up after the job is already finished
+      continue;
+    }
+    const auto* func = _func;
+    size_t count = _count;
+    _active++;
+    lock.unlock();
+
+    size_t finished = RunTasks(*func, count);
+
+    lock.lock();
+    _active--;
+    _done += finished;
+    if (_done == _count && _active == 0) {
+      _finish.notify_all();
+    }
+  }
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& func) {
+  if (count == 0) {
+    return;
+  }
+  if (_insidePool || _workers.empty() || count == 1) {
+    for (size_t i = 0; i < count; i++) {
+      func(i);
+    }
+    return;
+  }
+  std::lock_guard<std::mutex> submit(_submit);
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _func = &func;
+    _count = count;
+    _next = 0;
+    _done = 0;
+    _generation++;
+  }
+  _wake.notify_all();
+
+  _insidePool = true;
+  size_t finished = RunTasks(func, count);
+  _insidePool = false;
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  _done += finished;
+  //workers still holding this job must leave before next job resets _next
+  _finish.wait(lock, [&]() { return _done == _count && _active == 0; });
+  _func = nullptr;
+}
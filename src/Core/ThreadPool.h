@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Mine {
+
+/*
+ * fixed worker threads, one per core except the calling thread.
+ * ParallelFor blocks until every task is finished, the caller works too.
+ * calling ParallelFor inside a task runs serially, no deadlock
+ */
+class ThreadPool {
+ private:
+  ThreadPool();
+
+  std::vector<std::thread> _workers;
+  std::mutex _submit;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::condition_variable _finish;
+  const std::function<void(size_t)>* _func;
+  size_t _count;
+  std::atomic<size_t> _next;
+  size_t _done;
+  size_t _active;
+  uint64_t _generation;
+  bool _stop;
+
+  void WorkerLoop();
+  size_t RunTasks(const std::function<void(size_t)>& func, size_t count);
+
+ public:
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool(ThreadPool&&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ThreadPool& operator=(ThreadPool&&) = delete;
+  ~ThreadPool();
+
+  static ThreadPool& GetInstance() {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  size_t GetThreadCount() const;
+  void ParallelFor(size_t count, const std::function<void(size_t)>& func);
+};
+
+}  // namespace Mine